@@ -4,6 +4,7 @@
 
 #include <cassert>
 #include <cerrno>
+#include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -43,6 +44,7 @@ int print_help;
 
 int count_only;
 int keys_only;
+int statistics_only;
 
 char delimiter = '\t';
 const char* date_format = "%Y-%m-%d %H:%M:%S";
@@ -62,6 +64,7 @@ struct option kLongOptions[] = {
     {"key-filter", required_argument, NULL, kOptionKeyFilter},
     {"keys-only", no_argument, &keys_only, 1},
     {"schema", required_argument, NULL, 'S'},
+    {"statistics", no_argument, &statistics_only, 1},
     {"raw", no_argument, NULL, 'R'},
     {"prefix", required_argument, NULL, kOptionPrefix},
     {"version", no_argument, &print_version, 1},
@@ -308,6 +311,7 @@ int main(int argc, char** argv) try {
         "      --date=DATE            use DATE as timestamp\n"
         "      --key-filter=REGEX     only read keys matching REGEX\n"
         "      --keys-only            do not print values\n"
+        "      --statistics           print statistics stored with the table\n"
         "      --interval=INTERVAL    sample interval if both --date and --key "
         "are\n"
         "                             given\n"
@@ -337,7 +341,23 @@ int main(int argc, char** argv) try {
 
   table_handle->SeekToKey(first_key);
 
-  if (count_only) {
+  ca_table::TableStatistics statistics;
+  if (statistics_only) {
+    if (!table_handle->GetStatistics(statistics))
+      errx(EXIT_FAILURE, "%s: table has no statistics", argv[optind]);
+
+    printf("rows\t%" PRIu64 "\n", statistics.row_count);
+    printf("min-key\t%s\n", ca_table::Escape(statistics.min_key).c_str());
+    printf("max-key\t%s\n", ca_table::Escape(statistics.max_key).c_str());
+    printf("key-bytes\t%" PRIu64 "\n", statistics.key_bytes);
+    printf("value-bytes\t%" PRIu64 "\n", statistics.value_bytes);
+    if (statistics.has_offset_scores) {
+      printf("offset-scores\t%" PRIu64 "\n", statistics.offset_score_count);
+      for (const auto& encoding : statistics.offset_score_encodings)
+        printf("encoding-%u\t%" PRIu64 "\n", unsigned(encoding.first),
+               encoding.second);
+    }
+  } else if (count_only) {
     cantera::string_view key, value;
     if (!keys_only && !strcmp(format, "time-series")) {
       while (table_handle->ReadRow(key, value)) {
@@ -352,6 +372,9 @@ int main(int argc, char** argv) try {
         printf("%.*s\t%zu\n", static_cast<int>(key.size()), key.data(),
                ca_table::ca_offset_score_count(begin, end));
       }
+    } else if (!key_filter && first_key.empty() &&
+               table_handle->GetStatistics(statistics)) {
+      printf("%" PRIu64 "\n", statistics.row_count);
     } else {
       size_t count = 0;
       while (table_handle->ReadRow(key, value)) {
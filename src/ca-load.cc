@@ -13,6 +13,7 @@
 #include <ctime>
 #include <future>
 #include <map>
+#include <numeric>
 #include <regex>
 #include <string>
 #include <vector>
@@ -76,11 +77,23 @@ enum Option {
   kOutputBackend,
   kOutputCompression,
   kOutputCompressionLevel,
+  kOutputCompressionDictionarySize,
+  kOutputCompressionThreads,
+  kOutputFilterBitsPerKey,
+  kOutputKeyStatistics,
+  kOutputPostingBitmaps,
+  kOutputPostingBlockSize,
+  kOutputPostingSummary,
+  kOutputPredictionErrorBound,
+  kOutputRestartInterval,
   kOutputSeekable,
+  kOutputStatistics,
   kOutputTypeOption,
   kSchemaOption,
   kShardCountOption,
   kShardIndexOption,
+  kSortMemoryLimitOption,
+  kSortThreadsOption,
   kStripKeyPrefixOption,
   kThresholdOption,
 };
@@ -98,12 +111,30 @@ struct option kLongOptions[] = {
     {"output-compression", required_argument, nullptr, kOutputCompression},
     {"output-compression-level", required_argument, nullptr,
      kOutputCompressionLevel},
+    {"output-compression-dictionary-size", required_argument, nullptr,
+     kOutputCompressionDictionarySize},
+    {"output-compression-threads", required_argument, nullptr,
+     kOutputCompressionThreads},
+    {"output-filter-bits-per-key", required_argument, nullptr,
+     kOutputFilterBitsPerKey},
+    {"output-key-statistics", no_argument, nullptr, kOutputKeyStatistics},
+    {"output-posting-bitmaps", no_argument, nullptr, kOutputPostingBitmaps},
+    {"output-posting-block-size", required_argument, nullptr,
+     kOutputPostingBlockSize},
+    {"output-posting-summary", no_argument, nullptr, kOutputPostingSummary},
+    {"output-prediction-error-bound", required_argument, nullptr,
+     kOutputPredictionErrorBound},
+    {"output-restart-interval", required_argument, nullptr,
+     kOutputRestartInterval},
     {"output-seekable", no_argument, nullptr, kOutputSeekable},
+    {"output-statistics", no_argument, nullptr, kOutputStatistics},
     {"output-type", required_argument, nullptr, kOutputTypeOption},
     {"output-format", required_argument, nullptr, kOutputTypeOption},
     {"schema", required_argument, nullptr, kSchemaOption},
     {"shard-count", required_argument, nullptr, kShardCountOption},
     {"shard-index", required_argument, nullptr, kShardIndexOption},
+    {"sort-memory-limit", required_argument, nullptr, kSortMemoryLimitOption},
+    {"sort-threads", required_argument, nullptr, kSortThreadsOption},
     {"strip-key-prefix", required_argument, nullptr, kStripKeyPrefixOption},
     {"threshold", required_argument, nullptr, kThresholdOption},
     {"verbose", no_argument, &verbose, 1},
@@ -113,6 +144,10 @@ struct option kLongOptions[] = {
 
 std::unique_ptr<ca_table::TableBuilder> table_handle;
 
+// Scratch space for encoding and decoding posting lists.  Lists are only
+// encoded and decoded on the main thread, so one context is enough.
+ca_table::CodecContext codec_context;
+
 enum token_state {
   parse_key,
   parse_offset,
@@ -126,7 +161,6 @@ enum token_state {
 struct parse_state {
   enum token_state token_state = parse_key;
 
-  int no_match = 0;
   bool escape = false;
 };
 
@@ -150,6 +184,10 @@ std::string add_key_prefix;
 int do_map_documents;
 std::unique_ptr<ca_table::Schema> schema;
 
+// Document names of `values', whose offsets are resolved in one batch per
+// key when mapping documents.
+std::vector<std::string> value_documents;
+
 int do_summaries;
 
 struct LessThanOffset {
@@ -219,10 +257,59 @@ void FlushValues(const std::string& key,
       [](const auto& lhs, const auto& rhs) { return lhs.offset < rhs.offset; });
 
   ca_table_write_offset_score(table_handle.get(), c_key, &time_series[0],
-                              time_series.size());
+                              time_series.size(), &codec_context);
+}
+
+// Replaces the offsets of `values' with those of the summary table rows named
+// by `documents', and drops values whose document does not exist.  Later
+// summary tables take precedence.
+void MapDocuments(std::vector<ca_table::ca_offset_score>& values,
+                  std::vector<std::string>& documents) {
+  KJ_REQUIRE(values.size() == documents.size());
+
+  // Unresolved values, ordered by document name.
+  std::vector<size_t> pending(values.size());
+  std::iota(pending.begin(), pending.end(), 0);
+  std::sort(pending.begin(), pending.end(),
+            [&documents](size_t lhs, size_t rhs) {
+              return documents[lhs] < documents[rhs];
+            });
+
+  std::vector<bool> found(values.size());
+  for (auto i = schema->summary_tables.size(); i-- > 0 && !pending.empty();) {
+    auto& summary_table = schema->summary_tables[i];
+
+    std::vector<cantera::string_view> keys;
+    for (auto index : pending) keys.emplace_back(documents[index]);
+
+    summary_table.second->SeekToKeys(
+        keys, [&values, &found, &pending, &summary_table](size_t index) {
+          values[pending[index]].offset = summary_table.second->Offset() +
+                                          std::get<uint64_t>(summary_table);
+          found[pending[index]] = true;
+        });
+
+    pending.erase(
+        std::remove_if(pending.begin(), pending.end(),
+                       [&found](size_t index) { return found[index]; }),
+        pending.end());
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (found[i]) values[count++] = values[i];
+  }
+  values.resize(count);
+  documents.clear();
 }
 
 void FlushValues(const std::string& key) {
+  if (do_map_documents) {
+    MapDocuments(values, value_documents);
+    max_sorted_value_index = 0;
+    if (values.empty()) return;
+  }
+
   std::sort(values.begin() + max_sorted_value_index, values.end(),
             LessThanOffset());
 
@@ -280,18 +367,9 @@ void parse_data(const char* begin, const char* end, parse_state& state) {
       case parse_offset: {
         if (!was_escaped && ch == delimiter) {
           if (do_map_documents) {
-            state.no_match = 1;
-
-            for (auto i = schema->summary_tables.size(); i-- > 0;) {
-              if (schema->summary_tables[i].second->SeekToKey(offset)) {
-                current_offset = schema->summary_tables[i].second->Offset() +
-                                 std::get<uint64_t>(schema->summary_tables[i]);
-
-                state.no_match = 0;
-
-                break;
-              }
-            }
+            // Resolved by MapDocuments() when the key is flushed.
+            value_documents.emplace_back(offset);
+            current_offset = 0;
           } else {
             struct tm tm;
             char* end;
@@ -334,8 +412,6 @@ void parse_data(const char* begin, const char* end, parse_state& state) {
             } else {
               table_handle->InsertRow(add_key_prefix + current_key, value_string);
             }
-          } else if (state.no_match) {
-            state.no_match = 0;
           } else {
             ca_table::ca_score score;
             const char* start = value_string.c_str();
@@ -428,7 +504,8 @@ void MergeTimeSeriesCallback(const std::string& key,
       decoded_data_promises.emplace_back(
           std::async(std::launch::deferred, [&d] {
             TimeSeries result;
-            ca_table::ca_offset_score_parse(cantera::string_view{d.data(), d.size()}, &result);
+            ca_table::ca_offset_score_parse(cantera::string_view{d.data(), d.size()}, &result,
+                                            &codec_context);
             return result;
           }));
     }
@@ -572,6 +649,8 @@ void CopyTable(ca_table::Table* input, ca_table::TableBuilder* output) {
 int main(int argc, char** argv) try {
   Format input_format = kFormatAuto;
   bool input_unsorted = false;
+  uint64_t sort_memory_limit = 0;
+  uint64_t sort_threads = 0;
 
   DataType output_type = kDataTypeTimeSeries;
   const char* output_path;
@@ -580,7 +659,14 @@ int main(int argc, char** argv) try {
   ca_table::TableCompression output_compression =
       ca_table::kTableCompressionDefault;
   uint64_t output_compression_level = 0;
+  uint64_t output_compression_dictionary_size = 0;
+  uint64_t output_compression_threads = 0;
+  uint64_t output_filter_bits_per_key = 0;
+  bool output_key_statistics = false;
+  uint64_t output_restart_interval = 0;
   bool output_seekable = false;
+  bool output_statistics = false;
+  ca_table::OffsetScoreFormat output_format;
 
   const char* schema_path = NULL;
 
@@ -675,6 +761,54 @@ int main(int argc, char** argv) try {
         output_compression_level = ca_table::internal::StringToUInt64(optarg);
         break;
 
+      case kOutputCompressionDictionarySize:
+        output_compression_dictionary_size =
+            ca_table::internal::StringToUInt64(optarg);
+        break;
+
+      case kOutputCompressionThreads:
+        output_compression_threads =
+            ca_table::internal::StringToUInt64(optarg);
+        break;
+
+      case kOutputFilterBitsPerKey:
+        output_filter_bits_per_key =
+            ca_table::internal::StringToUInt64(optarg);
+        if (output_filter_bits_per_key > UINT8_MAX)
+          errx(EX_USAGE, "Filter bits per key must be at most %u", UINT8_MAX);
+        break;
+
+      case kOutputKeyStatistics:
+        output_key_statistics = true;
+        break;
+
+      case kOutputStatistics:
+        output_statistics = true;
+        break;
+
+      case kOutputPostingBitmaps:
+        output_format.bitmaps = true;
+        break;
+
+      case kOutputPostingBlockSize:
+        output_format.block_size = ca_table::internal::StringToUInt64(optarg);
+        break;
+
+      case kOutputPostingSummary:
+        output_format.summary = true;
+        break;
+
+      case kOutputPredictionErrorBound:
+        output_format.prediction_error_bound =
+            ca_table::internal::StringToDouble(optarg);
+        break;
+
+      case kOutputRestartInterval:
+        output_restart_interval = ca_table::internal::StringToUInt64(optarg);
+        if (output_restart_interval > UINT32_MAX)
+          errx(EX_USAGE, "Restart interval must be at most %u", UINT32_MAX);
+        break;
+
       case kOutputSeekable:
         output_seekable = true;
         break;
@@ -692,6 +826,14 @@ int main(int argc, char** argv) try {
         shard_index = ca_table::internal::StringToUInt64(optarg);
         break;
 
+      case kSortMemoryLimitOption:
+        sort_memory_limit = ca_table::internal::StringToUInt64(optarg);
+        break;
+
+      case kSortThreadsOption:
+        sort_threads = ca_table::internal::StringToUInt64(optarg);
+        break;
+
       case kStripKeyPrefixOption:
         strip_key_prefix = optarg;
         break;
@@ -725,10 +867,41 @@ int main(int argc, char** argv) try {
         "                               (default|none|zstd)\n"
         "      --output-compression-level=LEVEL\n"
         "                             output compression level\n"
+        "      --output-compression-dictionary-size=BYTES\n"
+        "                             train a compression dictionary of\n"
+        "                               BYTES bytes\n"
+        "      --output-compression-threads=N\n"
+        "                             compress output on N threads\n"
+        "      --output-filter-bits-per-key=BITS\n"
+        "                             add a key filter of BITS bits per key\n"
+        "      --output-key-statistics\n"
+        "                             store posting statistics for each key\n"
+        "      --output-posting-bitmaps\n"
+        "                             store long posting lists with a single\n"
+        "                               score as bitmaps\n"
+        "      --output-posting-block-size=N\n"
+        "                             store long sorted posting lists in\n"
+        "                               chunks of N values\n"
+        "      --output-posting-summary\n"
+        "                             store the count and offset range of\n"
+        "                               posting lists in a header\n"
+        "      --output-prediction-error-bound=E\n"
+        "                             store probability bands rounded to\n"
+        "                               within E of their exact values\n"
+        "      --output-restart-interval=N\n"
+        "                             store keys prefix compressed, with a\n"
+        "                               full key every N keys\n"
         "      --output-seekable      output needs to be seekable\n"
+        "      --output-statistics    store table statistics, which like other\n"
+        "                               optional sections needs a reader\n"
+        "                               that supports sections\n"
         "      --output-type=TYPE     type of output table\n"
         "                               (index|summaries|time-series)\n"
         "      --schema=PATH          schema file for index building\n"
+        "      --sort-memory-limit=BYTES\n"
+        "                             sort unsorted input in runs of at most\n"
+        "                               BYTES bytes\n"
+        "      --sort-threads=N       sort unsorted input on N threads\n"
         "      --strip-key-prefix=PREFIX\n"
         "                             remove PREFIX from keys\n"
         "      --threshold=SCORE      minimum score to include in output\n"
@@ -766,9 +939,8 @@ int main(int argc, char** argv) try {
     else if (!!strcmp(output_backend, "write-once"))
       errx(EX_USAGE, "summary tables can only be used with write-once backend");
 
-    if (output_compression != ca_table::kTableCompressionNone &&
-        output_compression != ca_table::kTableCompressionDefault)
-      errx(EX_USAGE, "summary tables cannot be compressed");
+    if (output_key_statistics)
+      errx(EX_USAGE, "summary tables cannot store key statistics");
 
     output_seekable = true;
     do_summaries = 1;
@@ -778,8 +950,18 @@ int main(int argc, char** argv) try {
   output_options.SetFileMode(0444)
       .SetCompression(output_compression)
       .SetCompressionLevel(output_compression_level)
+      .SetCompressionDictionarySize(output_compression_dictionary_size)
+      .SetCompressionThreads(output_compression_threads)
+      .SetFilterBitsPerKey(output_filter_bits_per_key)
+      .SetBlockRestartInterval(output_restart_interval)
       .SetInputUnsorted(input_unsorted)
-      .SetOutputSeekable(output_seekable);
+      .SetSortMemoryLimit(sort_memory_limit)
+      .SetSortThreads(sort_threads)
+      .SetOutputSeekable(output_seekable)
+      .SetStatistics(output_statistics)
+      .SetOffsetScoreStatistics(output_type != kDataTypeSummaries)
+      .SetKeyStatistics(output_key_statistics)
+      .SetOffsetScoreFormat(output_format);
 
   if (!output_backend) output_backend = "leveldb-table";
 
@@ -824,34 +1006,31 @@ int main(int argc, char** argv) try {
         case kDataTypeTimeSeries: {
           std::string key;
           std::vector<ca_table::ca_offset_score> data;
+          std::vector<std::string> documents;
+
+          auto flush_data = [output_type, &key, &data, &documents] {
+            if (output_type == kDataTypeIndex) MapDocuments(data, documents);
+            if (data.empty()) return;
+            ca_table::ca_table_write_offset_score(table_handle.get(), key,
+                                                  &data[0], data.size(),
+                                                  &codec_context);
+            data.clear();
+          };
+
           while (!reader.End()) {
             auto& row = reader.GetRow();
             KJ_REQUIRE(row.size() >= 2 && row.size() <= 3);
 
             if (row[0].second.value() != key) {
-              if (!data.empty()) {
-                ca_table::ca_table_write_offset_score(table_handle.get(), key, &data[0],
-                                            data.size());
-                data.clear();
-              }
+              flush_data();
               key = row[0].second.value().to_string();
             }
 
             uint64_t offset;
             if (output_type == kDataTypeIndex) {
-              bool match_found = false;
-              for (auto i = schema->summary_tables.size(); i-- > 0;) {
-                if (schema->summary_tables[i].second->SeekToKey(
-                        row[1].second.value())) {
-                  offset = schema->summary_tables[i].second->Offset() +
-                           std::get<uint64_t>(schema->summary_tables[i]);
-
-                  match_found = true;
-                  break;
-                }
-              }
-
-              if (!match_found) continue;
+              // Resolved by MapDocuments() when the key is flushed.
+              documents.emplace_back(row[1].second.value().to_string());
+              offset = 0;
             } else {
               auto time_string = row[1].second.value().to_string();
 
@@ -878,11 +1057,7 @@ int main(int argc, char** argv) try {
             data.emplace_back(offset, score);
           }
 
-          if (!data.empty()) {
-            ca_table::ca_table_write_offset_score(table_handle.get(), key, &data[0],
-                                        data.size());
-            data.clear();
-          }
+          flush_data();
         } break;
       }
     }
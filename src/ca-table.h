@@ -7,7 +7,10 @@
 #include <cstdlib>
 #include <experimental/string_view>
 #include <functional>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -23,6 +26,7 @@ using string_view = std::experimental::string_view;
 namespace table {
 
 struct ca_offset_score;
+struct OffsetScore;
 
 class Query;
 class Schema;
@@ -33,18 +37,26 @@ std::string Escape(const string_view& str);
 
 void LookupKey(const std::vector<Table*>& index_tables,
                const char* key,
-               std::function<void(std::vector<ca_offset_score>)>&& callback);
+               std::function<void(std::vector<OffsetScore>)>&& callback);
 
-void ProcessQuery(std::vector<ca_offset_score>& offsets, const Query* query,
+// If `need_scores' is false, the scores of `offsets' may be left zero, which
+// lets index lookups skip decoding them.
+void ProcessQuery(std::vector<OffsetScore>& offsets, const Query* query,
                   Schema* schema, bool make_headers = false,
-                  bool use_max = true);
+                  bool use_max = true, bool need_scores = true);
+
+// Sets how many threads queries processed on the calling thread may use to
+// decode long posting lists.  Zero, the default, means one per CPU.  Threads
+// that run queries side by side should split the CPUs between them, so that
+// list decoding does not start threads of its own on top of theirs.
+void SetQueryDecodeThreads(size_t thread_count);
 
 void PrintQuery(const Query* query);
 
 // Removes from `lhs' every offset contained `rhs', including duplicates.
 // Returns the number of elements left in `rhs'.
-size_t SubtractOffsets(struct ca_offset_score* lhs, size_t lhs_count,
-                       const struct ca_offset_score* rhs, size_t rhs_count);
+size_t SubtractOffsets(OffsetScore* lhs, size_t lhs_count,
+                       const OffsetScore* rhs, size_t rhs_count);
 
 /*****************************************************************************/
 
@@ -80,6 +92,36 @@ enum ca_offset_score_type {
 
   // Nothing at all.
   CA_OFFSET_SCORE_EMPTY = 16,
+
+  // Offsets in ascending order, split into chunks of a fixed number of
+  // values.  A header for each chunk gives its first and last offset, its
+  // size in bytes, and optionally its maximum score, so that readers can
+  // skip chunks without decoding them.  Each chunk is stored as a complete
+  // CA_OFFSET_SCORE_DELTA_OROCH_* or CA_OFFSET_SCORE_SINGLE_* value.
+  CA_OFFSET_SCORE_BLOCKED = 17,
+
+  // A header giving the number of values, the first and last offset and the
+  // size in bytes of what follows, which is one complete value in any other
+  // encoding.  Lets readers count values, find the last offset, or pass over
+  // the list without decoding it.
+  CA_OFFSET_SCORE_WITH_SUMMARY = 18,
+
+  // Offsets as in CA_OFFSET_SCORE_DELTA_OROCH_FLOAT.  Scores are stored as
+  // the XOR of each score's bits with those of the previous score, written
+  // to a bit stream as in Facebook's Gorilla, preceded by the stream's size
+  // in bytes.  Suits slowly varying non-integer scores.
+  CA_OFFSET_SCORE_DELTA_OROCH_XOR = 19,
+
+  // Offsets in ascending order without duplicates, all with the same score.
+  // The score is stored as a float, followed by the offsets as written by
+  // OffsetBitmap::Encode().
+  CA_OFFSET_SCORE_BITMAP = 20,
+
+  // Like CA_OFFSET_SCORE_WITH_PREDICTION, with offsets stored as in
+  // CA_OFFSET_SCORE_DELTA_OROCH_* and medians as in
+  // CA_OFFSET_SCORE_DELTA_OROCH_XOR.  Probability bands are stored as signed
+  // 8 or 16 bit multiples of a quantization step, relative to the median.
+  CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED = 21,
 };
 
 /*****************************************************************************/
@@ -105,6 +147,27 @@ struct ca_offset_score {
   float score_pct95 = std::numeric_limits<float>::quiet_NaN();
 };
 
+// An offset/score pair without probability bands, at half the size of
+// ca_offset_score.  The query engine works on these.
+struct OffsetScore {
+  OffsetScore() {}
+
+  OffsetScore(uint64_t offset, float score) : offset(offset), score(score) {}
+
+  uint64_t offset = 0;
+  float score = 0.0f;
+};
+
+// Probability bands of the element at `index' in a list of OffsetScore.
+struct OffsetScorePercentiles {
+  size_t index = 0;
+
+  float score_pct5 = std::numeric_limits<float>::quiet_NaN();
+  float score_pct25 = std::numeric_limits<float>::quiet_NaN();
+  float score_pct75 = std::numeric_limits<float>::quiet_NaN();
+  float score_pct95 = std::numeric_limits<float>::quiet_NaN();
+};
+
 struct ca_score {
   ca_score() {}
 
@@ -152,6 +215,30 @@ enum TableCompression : uint8_t {
   kTableCompressionLast = kTableCompressionZSTD
 };
 
+// Encodings that ca_format_offset_score() may choose for offset/score lists.
+// The defaults produce lists readable by all versions.
+struct OffsetScoreFormat {
+  // Stores sorted lists of more than twice this many values without
+  // probability bands as CA_OFFSET_SCORE_BLOCKED, with this many values per
+  // chunk.  Zero disables chunking.
+  size_t block_size = 0;
+
+  // Prefixes lists of more than one value with a CA_OFFSET_SCORE_WITH_SUMMARY
+  // header.  Older readers cannot parse it.
+  bool summary = false;
+
+  // Stores lists whose offsets are ascending and whose values all have the
+  // same score as CA_OFFSET_SCORE_BITMAP, unless that takes more than twice
+  // the space.  Older readers cannot parse it.
+  bool bitmaps = false;
+
+  // Stores lists with probability bands as
+  // CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED, with each band off by at most
+  // this much, plus float rounding.  Bands too far from their median fall
+  // back to exact storage.  Zero always stores bands exactly.
+  float prediction_error_bound = 0.0f;
+};
+
 class TableOptions {
  public:
   static TableOptions Create() { return TableOptions(); }
@@ -176,6 +263,20 @@ class TableOptions {
     return *this;
   }
 
+  // Compresses data blocks on this many threads.  The output is the same as
+  // when compressing on the calling thread.
+  TableOptions& SetCompressionThreads(unsigned compression_threads) {
+    compression_threads_ = compression_threads;
+    return *this;
+  }
+
+  // Trains a compression dictionary of at most this many bytes on the first
+  // blocks, and compresses all blocks with it.  Zero disables dictionaries.
+  TableOptions& SetCompressionDictionarySize(size_t size) {
+    compression_dictionary_size_ = size;
+    return *this;
+  }
+
   TableOptions& SetNoFSync(bool value = true) {
     no_fsync_ = value;
     return *this;
@@ -186,20 +287,105 @@ class TableOptions {
     return *this;
   }
 
+  // Makes the table seekable to the offsets returned by
+  // SeekableTable::Offset().  Uncompressed tables use file offsets, while
+  // compressed tables use virtual offsets made of a block number and an entry
+  // number within that block.
   TableOptions& SetOutputSeekable(bool value = true) {
     output_seekable_ = value;
     return *this;
   }
 
+  // Buffers at most about this many bytes of unsorted input in memory before
+  // writing it to a temporary file as a sorted run.  Zero uses the backend's
+  // default.
+  TableOptions& SetSortMemoryLimit(size_t sort_memory_limit) {
+    sort_memory_limit_ = sort_memory_limit;
+    return *this;
+  }
+
+  // Stores a summary of the table's contents in its own section, for
+  // Table::GetStatistics.  Write-once tables with this section, like those
+  // with any other optional section, cannot be read by versions that
+  // predate sections.
+  TableOptions& SetStatistics(bool value = true) {
+    statistics_ = value;
+    return *this;
+  }
+
+  // Records the number of offset/score pairs in values, and the mix of their
+  // encodings, in the table statistics, if those are stored.  Only for tables
+  // whose values are offset/score lists, such as index and time series
+  // tables.
+  TableOptions& SetOffsetScoreStatistics(bool value = true) {
+    offset_score_statistics_ = value;
+    return *this;
+  }
+
+  // Stores the number of offset/score pairs in each value, and the range of
+  // their offsets and scores, for Table::GetKeyStatistics.  Only for tables
+  // whose values are offset/score lists.  Not supported for uncompressed
+  // seekable output.
+  TableOptions& SetKeyStatistics(bool value = true) {
+    key_statistics_ = value;
+    return *this;
+  }
+
+  // Encodes offset/score lists written with ca_table_write_offset_score() in
+  // this format.
+  TableOptions& SetOffsetScoreFormat(const OffsetScoreFormat& format) {
+    offset_score_format_ = format;
+    return *this;
+  }
+
+  // Sorts runs of unsorted input on this many threads.
+  TableOptions& SetSortThreads(unsigned sort_threads) {
+    sort_threads_ = sort_threads;
+    return *this;
+  }
+
+  // Stores a Bloom filter over all keys, using about this many bits per key,
+  // so that lookups of absent keys can usually skip reading any data.  Zero
+  // disables the filter.  LevelDB tables store one filter per data block.
+  TableOptions& SetFilterBitsPerKey(uint8_t filter_bits_per_key) {
+    filter_bits_per_key_ = filter_bits_per_key;
+    return *this;
+  }
+
+  // Stores keys as suffixes following the prefix they share with the
+  // preceding key, with a full key every this many keys.  Zero stores all
+  // keys in full.  Not supported for uncompressed seekable output.  For
+  // LevelDB tables, zero keeps LevelDB's default.
+  TableOptions& SetBlockRestartInterval(uint32_t block_restart_interval) {
+    block_restart_interval_ = block_restart_interval;
+    return *this;
+  }
+
   int GetFileFlags() const { return file_flags_; }
   mode_t GetFileMode() const { return file_mode_; }
 
   TableCompression GetCompression() const { return compression_; }
   uint8_t GetCompressionLevel() const { return compression_level_; }
+  unsigned GetCompressionThreads() const { return compression_threads_; }
+  size_t GetCompressionDictionarySize() const {
+    return compression_dictionary_size_;
+  }
 
   bool GetNoFSync() const { return no_fsync_; }
   bool GetInputUnsorted() const { return input_unsorted_; }
   bool GetOutputSeekable() const { return output_seekable_; }
+  bool GetStatistics() const { return statistics_; }
+  bool GetOffsetScoreStatistics() const { return offset_score_statistics_; }
+  bool GetKeyStatistics() const { return key_statistics_; }
+  const OffsetScoreFormat& GetOffsetScoreFormat() const {
+    return offset_score_format_;
+  }
+
+  size_t GetSortMemoryLimit() const { return sort_memory_limit_; }
+  unsigned GetSortThreads() const { return sort_threads_; }
+
+  uint8_t GetFilterBitsPerKey() const { return filter_bits_per_key_; }
+  uint32_t GetBlockRestartInterval() const { return block_restart_interval_; }
 
  private:
   // File creation options.
@@ -209,22 +395,95 @@ class TableOptions {
   // Data compression options.
   TableCompression compression_ = kTableCompressionDefault;
   uint8_t compression_level_ = 0;
+  unsigned compression_threads_ = 0;
+  size_t compression_dictionary_size_ = 0;
 
   // Miscellaneous flags.
   bool no_fsync_ = false;
   bool input_unsorted_ = false;
   bool output_seekable_ = false;
+  bool statistics_ = false;
+  bool offset_score_statistics_ = false;
+  bool key_statistics_ = false;
+
+  // Offset/score list options.
+  OffsetScoreFormat offset_score_format_;
+
+  // Unsorted input options.
+  size_t sort_memory_limit_ = 0;
+  unsigned sort_threads_ = 0;
+
+  // Key filter options.
+  uint8_t filter_bits_per_key_ = 0;
+
+  // Key prefix compression options.
+  uint32_t block_restart_interval_ = 0;
 };
 
 /*****************************************************************************/
 
+// Summary of a table's contents, recorded when it was written.
+struct TableStatistics {
+  uint64_t row_count = 0;
+
+  // Smallest and largest keys.  Empty for empty tables.
+  std::string min_key;
+  std::string max_key;
+
+  // Total size of keys and values, before compression.
+  uint64_t key_bytes = 0;
+  uint64_t value_bytes = 0;
+
+  // The remaining fields are only filled in for tables written with
+  // TableOptions::SetOffsetScoreStatistics.
+  bool has_offset_scores = false;
+
+  // Total number of offset/score pairs.
+  uint64_t offset_score_count = 0;
+
+  // Number of rows by the ca_offset_score_type their value starts with.
+  std::map<uint8_t, uint64_t> offset_score_encodings;
+};
+
+// Summary of the offset/score list stored under a single key.
+struct KeyStatistics {
+  uint64_t count = 0;
+
+  uint64_t min_offset = 0;
+  uint64_t max_offset = 0;
+
+  // Range of the scores, ignoring NaNs.  If there are no other scores, the
+  // minimum is greater than the maximum.
+  float min_score = 0.0f;
+  float max_score = 0.0f;
+};
+
 class TableBuilder {
  public:
   virtual ~TableBuilder();
 
   virtual void InsertRow(const string_view& key, const string_view& value) = 0;
 
+  // Inserts an encoded offset/score list along with the statistics of its
+  // values, so that builders storing key statistics need not decode it.
+  // The default ignores the statistics.
+  virtual void InsertOffsetScoreRow(const string_view& key,
+                                    const string_view& value,
+                                    const KeyStatistics& statistics);
+
   virtual void Sync() = 0;
+
+  // Format of lists written with ca_table_write_offset_score().  Set by
+  // TableFactory::Create() from the table options.
+  const OffsetScoreFormat& GetOffsetScoreFormat() const {
+    return offset_score_format_;
+  }
+  void SetOffsetScoreFormat(const OffsetScoreFormat& format) {
+    offset_score_format_ = format;
+  }
+
+ private:
+  OffsetScoreFormat offset_score_format_;
 };
 
 class Table {
@@ -246,6 +505,16 @@ class Table {
   // used for speeding up prefix key searches.
   virtual bool SeekToKey(const string_view& key) = 0;
 
+  // Seeks to each of `keys', which must be in ascending order, and calls
+  // `callback' with the index of every key found while the cursor is on its
+  // row.  The callback may read rows or query the offset.
+  //
+  // Backends request the blocks of all keys from the file before visiting
+  // them, and decode each block at most once.  The default implementation
+  // calls SeekToKey() for every key.
+  virtual void SeekToKeys(const std::vector<string_view>& keys,
+                          const std::function<void(size_t index)>& callback);
+
   // Reads one row.  Returns true if a value was read successfully, or
   // false if end of file was reached instead.
   virtual bool ReadRow(string_view& key, string_view& value) = 0;
@@ -253,7 +522,40 @@ class Table {
   // Skips the given number of rows.
   virtual bool Skip(size_t count) = 0;
 
+  // Retrieves the statistics stored with the table, without reading any
+  // rows.  Returns false if the table has none.
+  virtual bool GetStatistics(TableStatistics& statistics);
+
+  // Retrieves the statistics stored for the given key, without reading its
+  // value.  Returns false if the key does not exist, or the table has no key
+  // statistics.
+  virtual bool GetKeyStatistics(const string_view& key,
+                                KeyStatistics& statistics);
+
+  // Looks up a single key, and passes its value to `callback', which must
+  // not keep it beyond the call.  Returns false if the key does not exist.
+  //
+  // Backends implement this without the cursor, so unlike the cursor
+  // functions above it may be called from several threads at once.  The
+  // default implementation moves the cursor, and is only safe while no other
+  // thread uses it; it merely serializes calls to Get() itself.
+  virtual bool Get(
+      const string_view& key,
+      const std::function<void(const string_view& value)>& callback) const;
+
+  // Looks up several keys, and calls `callback' with the index of each key
+  // found and its value.  Thread-safe like Get().  Sorted keys are looked up
+  // most efficiently.
+  virtual void MultiGet(
+      const std::vector<string_view>& keys,
+      const std::function<void(size_t index, const string_view& value)>&
+          callback) const;
+
   const struct stat st;
+
+ private:
+  // Serializes the default implementation of Get().
+  mutable std::mutex get_mutex_;
 };
 
 class SeekableTable : public Table {
@@ -263,6 +565,11 @@ class SeekableTable : public Table {
   virtual off_t Offset() = 0;
 
   virtual void Seek(off_t offset, int whence) = 0;
+
+  // Returns an offset greater than that of any entry.  This is the file size,
+  // except for compressed tables, whose virtual offsets advance by 65536 per
+  // block.
+  virtual off_t EndOffset();
 };
 
 /*****************************************************************************/
@@ -282,6 +589,37 @@ class TableFactory {
 
 /*****************************************************************************/
 
+struct BlockCacheStatistics {
+  // Number of block reads served from the cache.
+  uint64_t hits = 0;
+
+  // Number of block reads that had to load and decode the block.
+  uint64_t misses = 0;
+
+  // Number of blocks dropped to stay within the capacity.
+  uint64_t evictions = 0;
+
+  // Memory used by cached blocks, and the configured limit, in bytes.
+  size_t size = 0;
+  size_t capacity = 0;
+};
+
+// Sets the amount of memory available to the process-wide caches of decoded
+// table blocks, which are shared by all open tables.  Each backend has its
+// own cache of this capacity.  Zero disables caching.  LevelDB tables keep
+// the cache that existed when they were opened.
+void SetBlockCacheCapacity(size_t capacity);
+
+// Returns statistics for the write-once block cache.
+BlockCacheStatistics GetBlockCacheStatistics();
+
+// Controls whether tables opened from now on may be read through a memory
+// mapping rather than copied into private buffers, where the table format
+// allows it.  Enabled by default.
+void SetTableMemoryMapping(bool enable);
+
+/*****************************************************************************/
+
 void ca_schema_query(Schema* schema,
                      const struct query_statement& stmt);
 
@@ -290,20 +628,75 @@ void ca_schema_query_correlate(Schema* schema, const Query* query_A,
 
 /*****************************************************************************/
 
+// Header of a CA_OFFSET_SCORE_BLOCKED chunk.
+struct OffsetScoreChunk {
+  uint64_t first_offset = 0;
+  uint64_t last_offset = 0;
+  float max_score = std::numeric_limits<float>::infinity();
+  size_t count = 0;
+  string_view data;
+};
+
+// Scratch buffers for encoding and decoding offset/score lists.  Functions
+// that accept a context grow its buffers as needed and leave them allocated,
+// so a context reused for many lists stops allocating once it has seen the
+// largest one.  Passing no context allocates fresh buffers for every call.
+// A context must not be used by more than one thread at a time.
+struct CodecContext {
+  // Encoded list built by ca_table_write_offset_score().
+  std::vector<uint8_t> output;
+
+  // Chunks of a CA_OFFSET_SCORE_BLOCKED list being encoded.
+  std::vector<uint8_t> chunk_data;
+
+  // Headers of the chunks of a CA_OFFSET_SCORE_BLOCKED list being decoded.
+  std::vector<OffsetScoreChunk> chunks;
+
+  // Delta-encoded offsets and integer scores.
+  std::vector<uint64_t> offsets;
+  std::vector<int64_t> scores;
+
+  // Scores encoded as in CA_OFFSET_SCORE_DELTA_OROCH_XOR.
+  std::vector<uint8_t> score_xor;
+
+  // Lists with probability bands, decoded before conversion.
+  std::vector<ca_offset_score> values;
+
+  // Which values of a list with probability bands have them, one bit each,
+  // and their bands as multiples of the quantization step.
+  std::vector<uint8_t> prob_mask;
+  std::vector<int32_t> bands;
+
+  // Positions and high bits of the outliers of a patched bit-packed
+  // sequence.
+  std::vector<size_t> outlier_indexes;
+  std::vector<uint64_t> outlier_high_bits;
+};
+
+/*****************************************************************************/
+
+// Returns the statistics of `values', as stored by
+// TableOptions::SetKeyStatistics.
+KeyStatistics ca_offset_score_statistics(const struct ca_offset_score* values,
+                                         size_t count);
+
 void ca_table_write_offset_score(TableBuilder* table,
                                  const string_view& key,
                                  const struct ca_offset_score* values,
-                                 size_t count);
+                                 size_t count,
+                                 CodecContext* context = nullptr);
 
 /*****************************************************************************/
 
 void ca_format_integer(uint8_t** output, uint64_t value);
 
-size_t ca_offset_score_size(const struct ca_offset_score* values, size_t count);
+// Returns an upper bound for the size of `count' values encoded in `format'.
+size_t ca_offset_score_size(size_t count, const OffsetScoreFormat& format = {});
 
 size_t ca_format_offset_score(uint8_t* output, size_t output_size,
                               const struct ca_offset_score* values,
-                              size_t count);
+                              size_t count, CodecContext* context = nullptr,
+                              const OffsetScoreFormat& format = {});
 
 void ca_format_enable_trace(bool enable);
 
@@ -315,12 +708,90 @@ float ca_parse_float(const uint8_t** input);
 
 const char* ca_parse_string(const uint8_t** input);
 
-uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end);
+uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end,
+                                    CodecContext* context = nullptr);
 
 void ca_offset_score_parse(string_view input,
-                           std::vector<ca_offset_score>* output);
+                           std::vector<ca_offset_score>* output,
+                           CodecContext* context = nullptr);
+
+// Parses into the compact representation.  If `percentiles' is not null,
+// probability bands of the values that have them are appended to it, indexed
+// by their position in `output'.
+void ca_offset_score_parse(
+    string_view input, std::vector<OffsetScore>* output,
+    std::vector<OffsetScorePercentiles>* percentiles = nullptr,
+    CodecContext* context = nullptr);
+
+// Parses only the offsets, skipping over the scores without decoding them
+// where the encoding allows it.  The scores of the output are zero.
+void ca_offset_score_parse_offsets(string_view input,
+                                   std::vector<OffsetScore>* output,
+                                   CodecContext* context = nullptr);
+
+// Parses like ca_offset_score_parse(), or ca_offset_score_parse_offsets() if
+// `decode_scores' is false, but decodes the chunks of long
+// CA_OFFSET_SCORE_BLOCKED lists on up to `thread_count' threads, each writing
+// its own range of `output'.  Other encodings are decoded on the calling
+// thread, using `context' if it is not null.
+void ca_offset_score_parse_parallel(string_view input,
+                                    std::vector<OffsetScore>* output,
+                                    size_t thread_count,
+                                    bool decode_scores = true,
+                                    CodecContext* context = nullptr);
+
+size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end,
+                             CodecContext* context = nullptr);
+
+// Visits the offset/score pairs of an encoded list in stored order, decoding
+// as little as possible.  CA_OFFSET_SCORE_BLOCKED lists are decoded one chunk
+// at a time, and SkipTo() passes over whole chunks without decoding them.
+// It also passes over lists with a CA_OFFSET_SCORE_WITH_SUMMARY header.
+// Other encodings are decoded in full when reached.
+class OffsetScoreCursor {
+ public:
+  // `input' must outlive the cursor.  If `decode_scores' is false, scores are
+  // skipped as in ca_offset_score_parse_offsets(), and Get() returns zero
+  // scores.
+  OffsetScoreCursor(string_view input, bool decode_scores = true);
+
+  bool Valid() const { return index_ < values_.size(); }
+
+  const ca_offset_score& Get() const { return values_[index_]; }
+
+  void Next();
 
-size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end);
+  // Advances to the first pair whose offset is not less than `offset',
+  // assuming pairs are sorted by offset.  Never moves backwards.
+  void SkipTo(uint64_t offset);
+
+  // Returns an upper bound for the scores of the chunk holding the current
+  // pair, or infinity if the encoding records none.
+  float MaxScore() const { return max_score_; }
+
+  using Chunk = OffsetScoreChunk;
+
+ private:
+  // Decodes the next chunk or list into `values_'.  Returns false at the end
+  // of the input.
+  bool Load();
+
+  string_view input_;
+
+  bool decode_scores_;
+
+  // Chunks of the current CA_OFFSET_SCORE_BLOCKED list not yet decoded.
+  std::vector<Chunk> chunks_;
+  size_t chunk_index_ = 0;
+
+  std::vector<ca_offset_score> values_;
+  size_t index_ = 0;
+
+  // Reused for every chunk.
+  CodecContext context_;
+
+  float max_score_ = std::numeric_limits<float>::infinity();
+};
 
 /*****************************************************************************/
 
@@ -29,10 +29,10 @@ namespace {
 
 // Finds the first position of an array where the offset is not less than
 // `offset'.
-const struct ca_offset_score* CA_offset_score_lower_bound(
-    const struct ca_offset_score* begin, const struct ca_offset_score* end,
-    uint64_t offset) {
-  const struct ca_offset_score* middle;
+const OffsetScore* CA_offset_score_lower_bound(const OffsetScore* begin,
+                                               const OffsetScore* end,
+                                               uint64_t offset) {
+  const OffsetScore* middle;
   size_t half, len = end - begin;
 
   while (len > 0) {
@@ -82,9 +82,9 @@ std::string DayToDate(float day) {
 //   max_score: The upper bound of the range of score values to accept from
 //              key_offsets.
 void ProcessRange(const string_view& key,
-                  const std::vector<ca_offset_score>& offsets_A,
-                  const std::vector<ca_offset_score>& offsets_B,
-                  const std::vector<ca_offset_score>& key_offsets,
+                  const std::vector<OffsetScore>& offsets_A,
+                  const std::vector<OffsetScore>& offsets_B,
+                  const std::vector<OffsetScore>& key_offsets,
                   const size_t limit_A, const size_t limit_B,
                   const double prior_logit, const bool do_timestamps,
                   std::mutex& output_mutex, const float min_score = -HUGE_VAL,
@@ -194,9 +194,9 @@ void ProcessRange(const string_view& key,
 //   prior_logit: The log-odds of the prior probability of an item belonging to
 //                set A.
 //   output_mutex: Mutex controlling access to stdout.
-void ProcessSeries(std::string key, std::vector<ca_offset_score>&& key_offsets,
-                   const std::vector<ca_offset_score>& offsets_A,
-                   const std::vector<ca_offset_score>& offsets_B,
+void ProcessSeries(std::string key, std::vector<OffsetScore>&& key_offsets,
+                   const std::vector<OffsetScore>& offsets_A,
+                   const std::vector<OffsetScore>& offsets_B,
                    const size_t limit_A, const size_t limit_B,
                    const double prior_logit, const bool do_timestamps,
                    std::mutex& output_mutex) {
@@ -357,8 +357,8 @@ void ProcessSeries(std::string key, std::vector<ca_offset_score>&& key_offsets,
   }
 }
 
-void FilterByTimestamp(std::vector<ca_offset_score>& keys,
-                       const std::vector<ca_offset_score>& adj, float now) {
+void FilterByTimestamp(std::vector<OffsetScore>& keys,
+                       const std::vector<OffsetScore>& adj, float now) {
   auto i = keys.begin();
   auto j = adj.begin();
 
@@ -399,9 +399,9 @@ void FilterByTimestamp(std::vector<ca_offset_score>& keys,
   keys.erase(output, keys.end());
 }
 
-void FilterByTimestamp(std::vector<ca_offset_score>& keys,
-                       const std::vector<ca_offset_score>& offsets_A,
-                       const std::vector<ca_offset_score>& offsets_B) {
+void FilterByTimestamp(std::vector<OffsetScore>& keys,
+                       const std::vector<OffsetScore>& offsets_A,
+                       const std::vector<OffsetScore>& offsets_B) {
   auto i = keys.begin();
   auto a = offsets_A.begin();
   auto b = offsets_B.begin();
@@ -490,7 +490,7 @@ void ca_schema_query_correlate(Schema* schema, const Query* query_A,
   const auto b_is_timestamped =
       keywords.IsTimestamped(PrimaryKeywordForQuery(query_B));
 
-  std::vector<ca_offset_score> offsets_A, offsets_B;
+  std::vector<OffsetScore> offsets_A, offsets_B;
 
   ProcessQuery(offsets_A, query_A, schema, false, false);
   ProcessQuery(offsets_B, query_B, schema, false, false);
@@ -521,7 +521,8 @@ void ca_schema_query_correlate(Schema* schema, const Query* query_A,
 
   evenk::thread_pool<thread_pool_queue> thread_pool(std::thread::hardware_concurrency());
 
-  std::vector<ca_offset_score> key_offsets;
+  std::vector<OffsetScore> key_offsets;
+  CodecContext codec_context;
 
   // Mutex controlling access to stdout.
   std::mutex output_mutex;
@@ -536,7 +537,7 @@ void ca_schema_query_correlate(Schema* schema, const Query* query_A,
 
       key_offsets.clear();
 
-      ca_offset_score_parse(data, &key_offsets);
+      ca_offset_score_parse(data, &key_offsets, nullptr, &codec_context);
 
       if (key_offsets.size() < limit_A && key_offsets.size() < limit_B)
         continue;
@@ -2,16 +2,18 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdarg>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
-#include <set>
-#include <unordered_map>
 
 #include <kj/debug.h>
 
 #include "src/ca-table.h"
+#include "src/offset-bitmap.h"
 #include "src/rle.h"
 
 #include "third_party/oroch/oroch/integer_codec.h"
@@ -21,6 +23,21 @@ namespace table {
 
 namespace {
 
+// Smallest number of values per CA_OFFSET_SCORE_BLOCKED chunk.  Smaller
+// chunks would spend more on headers than they save.
+const size_t kMinOffsetScoreBlockSize = 16;
+
+// Upper bound for the size of a chunk header.
+const size_t kMaxOffsetScoreBlockHeaderSize = 3 * 10 + sizeof(float);
+
+// Smallest number of values stored as CA_OFFSET_SCORE_BITMAP.  Shorter lists
+// are cheap to combine in any encoding.
+const size_t kMinOffsetScoreBitmapSize = 256;
+
+// Upper bound for the size of a CA_OFFSET_SCORE_WITH_SUMMARY header,
+// including the type byte.
+const size_t kMaxOffsetScoreSummarySize = 1 + 4 * 10;
+
 template <typename T>
 T GCD(T a, T b) {
   while (b) {
@@ -103,9 +120,84 @@ void EncodeOffsetScoreSingle(uint8_t*& o, uint8_t* oe,
   }
 }
 
+// Writes bits to a byte stream, most significant bit first.
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t>& output) : output_(output) {}
+
+  // Writes the `bits' least significant bits of `value'.
+  void Put(uint32_t value, unsigned int bits) {
+    if (!bits) return;
+    buffer_ = (buffer_ << bits) | (value & (~uint64_t(0) >> (64 - bits)));
+    fill_ += bits;
+    while (fill_ >= 8) {
+      fill_ -= 8;
+      output_.push_back(buffer_ >> fill_);
+    }
+  }
+
+  void Flush() {
+    if (fill_) output_.push_back(buffer_ << (8 - fill_));
+    fill_ = 0;
+  }
+
+ private:
+  std::vector<uint8_t>& output_;
+  uint64_t buffer_ = 0;
+  unsigned int fill_ = 0;
+};
+
+// Encodes scores for CA_OFFSET_SCORE_DELTA_OROCH_XOR.  The first score is
+// stored as is.  For each following score, the XOR of its bits with those of
+// the previous score is stored as a single 0 bit if it is zero.  Otherwise a
+// 1 bit is followed either by 0 and the meaningful bits, if they fit within
+// the previous window of meaningful bits, or by 1, the number of leading
+// zeros in 5 bits, the number of meaningful bits less one in 5 bits, and the
+// meaningful bits.
+void EncodeScoresXOR(std::vector<uint8_t>& output,
+                     const struct ca_offset_score* values, size_t count) {
+  BitWriter writer(output);
+
+  uint32_t prev;
+  memcpy(&prev, &values[0].score, sizeof(prev));
+  writer.Put(prev, 32);
+
+  unsigned int window_leading = 32, window_bits = 0;
+
+  for (size_t i = 1; i < count; ++i) {
+    uint32_t bits;
+    memcpy(&bits, &values[i].score, sizeof(bits));
+    const uint32_t delta = bits ^ prev;
+    prev = bits;
+
+    if (!delta) {
+      writer.Put(0, 1);
+      continue;
+    }
+
+    const unsigned int leading = __builtin_clz(delta);
+    const unsigned int trailing = __builtin_ctz(delta);
+
+    if (leading >= window_leading &&
+        trailing >= 32 - window_leading - window_bits) {
+      writer.Put(2, 2);
+    } else {
+      window_leading = leading;
+      window_bits = 32 - leading - trailing;
+      writer.Put(3, 2);
+      writer.Put(window_leading, 5);
+      writer.Put(window_bits - 1, 5);
+    }
+
+    writer.Put(delta >> (32 - window_leading - window_bits), window_bits);
+  }
+
+  writer.Flush();
+}
+
 void EncodeOffsetScoreOroch(uint8_t*& o, uint8_t* oe,
                             const struct ca_offset_score* values,
-                            size_t count) {
+                            size_t count, CodecContext& context) {
   // Special handling of singular offset/score record.
   if (count == 1) {
     EncodeOffsetScoreSingle(o, oe, values);
@@ -122,6 +214,15 @@ void EncodeOffsetScoreOroch(uint8_t*& o, uint8_t* oe,
     }
   }
 
+  // Use the XOR encoding for non-integer scores, if it saves space.
+  auto& score_xor = context.score_xor;
+  score_xor.clear();
+  if (type == CA_OFFSET_SCORE_DELTA_OROCH_FLOAT) {
+    EncodeScoresXOR(score_xor, values, count);
+    if (score_xor.size() + 10 < count * sizeof(float))
+      type = CA_OFFSET_SCORE_DELTA_OROCH_XOR;
+  }
+
   // Store the chosen representation.
   *o++ = uint8_t(type);
 
@@ -133,7 +234,8 @@ void EncodeOffsetScoreOroch(uint8_t*& o, uint8_t* oe,
   oroch::varint_codec<uint64_t>::value_encode(o, first);
 
   // Delta-encode the offsets.
-  std::vector<uint64_t> offset_delta(count - 1);
+  auto& offset_delta = context.offsets;
+  offset_delta.resize(count - 1);
   for (size_t i = 1; i < count; i++)
     offset_delta[i - 1] = values[i].offset - values[i - 1].offset;
 
@@ -147,7 +249,8 @@ void EncodeOffsetScoreOroch(uint8_t*& o, uint8_t* oe,
 
   // Encode score according to the chosen representation.
   if (type == CA_OFFSET_SCORE_DELTA_OROCH_OROCH) {
-    std::vector<int64_t> score(count);
+    auto& score = context.scores;
+    score.resize(count);
     for (size_t i = 0; i < count; i++)
       score[i] = llrintf(values[i].score);
  
@@ -157,6 +260,10 @@ void EncodeOffsetScoreOroch(uint8_t*& o, uint8_t* oe,
     oroch::integer_codec<int64_t>::select(score_meta, score_i, score_e);
     score_meta.encode(o);
     oroch::integer_codec<int64_t>::encode(o, score_i, score_e, score_meta);
+  } else if (type == CA_OFFSET_SCORE_DELTA_OROCH_XOR) {
+    oroch::varint_codec<size_t>::value_encode(o, score_xor.size());
+    memcpy(o, score_xor.data(), score_xor.size());
+    o += score_xor.size();
   } else {
     for (size_t i = 0; i < count; i++) {
       static_assert(sizeof(float) == sizeof(uint32_t),
@@ -168,9 +275,84 @@ void EncodeOffsetScoreOroch(uint8_t*& o, uint8_t* oe,
   }
 }
 
+void EncodeOffsetScoreBlocked(uint8_t*& o, uint8_t* oe,
+                              const struct ca_offset_score* values,
+                              size_t count, size_t block_size,
+                              CodecContext& context) {
+  *o++ = CA_OFFSET_SCORE_BLOCKED;
+  oroch::varint_codec<size_t>::value_encode(o, count);
+  oroch::varint_codec<size_t>::value_encode(o, block_size);
+
+  // Flags.  Bit 0 means that chunk headers include the maximum score.
+  *o++ = 1;
+
+  // Encode the chunks first, since their headers precede them.
+  auto& data = context.chunk_data;
+  OffsetScoreFormat chunk_format;
+  chunk_format.block_size = block_size;
+  data.resize(ca_offset_score_size(count, chunk_format));
+  uint8_t* d = data.data();
+  uint64_t prev_offset = 0;
+
+  for (size_t i = 0; i < count; i += block_size) {
+    const auto chunk = values + i;
+    const auto chunk_count = std::min(block_size, count - i);
+
+    const auto chunk_begin = d;
+    EncodeOffsetScoreOroch(d, data.data() + data.size(), chunk, chunk_count,
+                           context);
+
+    KJ_REQUIRE(size_t(oe - o) >= kMaxOffsetScoreBlockHeaderSize,
+               "offset/score output buffer too small");
+    const auto first = chunk[0].offset;
+    const auto last = chunk[chunk_count - 1].offset;
+    oroch::varint_codec<uint64_t>::value_encode(o, first - prev_offset);
+    oroch::varint_codec<uint64_t>::value_encode(o, last - first);
+    oroch::varint_codec<size_t>::value_encode(o, d - chunk_begin);
+    prev_offset = last;
+
+    float max_score = chunk[0].score;
+    for (size_t j = 1; j < chunk_count; ++j)
+      max_score = std::max(max_score, chunk[j].score);
+    EncodeFloat(o, max_score);
+  }
+
+  KJ_REQUIRE(d - data.data() <= oe - o, "offset/score output buffer too small");
+  memcpy(o, data.data(), d - data.data());
+  o += d - data.data();
+}
+
+// Returns true if the offsets of `values' are strictly ascending, and all
+// scores have the same bit pattern.
+bool HasSingleScoreAscendingOffsets(const struct ca_offset_score* values,
+                                    size_t count) {
+  for (size_t i = 1; i < count; ++i) {
+    if (values[i].offset <= values[i - 1].offset ||
+        memcmp(&values[i].score, &values[0].score, sizeof(float)))
+      return false;
+  }
+
+  return true;
+}
+
+// Writes a summary header for the `count' values whose encoding has already
+// been written to `data', and moves the encoding to follow it.
+void EncodeOffsetScoreSummary(uint8_t*& o, const uint8_t* data, size_t size,
+                              const struct ca_offset_score* values,
+                              size_t count) {
+  *o++ = CA_OFFSET_SCORE_WITH_SUMMARY;
+  oroch::varint_codec<size_t>::value_encode(o, count);
+  oroch::varint_codec<uint64_t>::value_encode(o, values[0].offset);
+  oroch::varint_codec<uint64_t>::value_encode(o, values[count - 1].offset);
+  oroch::varint_codec<size_t>::value_encode(o, size);
+
+  memmove(o, data, size);
+  o += size;
+}
+
 void EncodeOffsetScoreWithPrediction(uint8_t*& o,
                                      const struct ca_offset_score* values,
-                                     size_t count) {
+                                     size_t count, CodecContext& context) {
   *o++ = CA_OFFSET_SCORE_WITH_PREDICTION;
   ca_format_integer(&o, count);
 
@@ -178,15 +360,20 @@ void EncodeOffsetScoreWithPrediction(uint8_t*& o,
 
   ca_format_integer(&o, values[0].offset);
 
-  std::set<uint64_t> steps;
+  // Distinct steps in ascending order.  A step is stored as its index in
+  // this list.
+  auto& steps = context.offsets;
+  steps.clear();
 
   for (size_t i = 1; i < count; ++i) {
     KJ_REQUIRE(values[i].offset >= values[i - 1].offset);
-    steps.insert(values[i].offset - values[i - 1].offset);
+    steps.emplace_back(values[i].offset - values[i - 1].offset);
   }
 
-  uint64_t prev_step = 0, next_key = 0;
-  std::unordered_map<uint64_t, uint64_t> step_keys;
+  std::sort(steps.begin(), steps.end());
+  steps.erase(std::unique(steps.begin(), steps.end()), steps.end());
+
+  uint64_t prev_step = 0;
   bool use_step_map = false;
 
   if (count > 1) {
@@ -196,8 +383,6 @@ void EncodeOffsetScoreWithPrediction(uint8_t*& o,
       use_step_map = true;
 
       for (auto step : steps) {
-        step_keys[step] = next_key++;
-
         ca_format_integer(&o, step - prev_step);
         prev_step = step;
       }
@@ -207,15 +392,18 @@ void EncodeOffsetScoreWithPrediction(uint8_t*& o,
   }
 
   if (use_step_map) {
-    for (size_t i = 1; i < count; ++i)
-      ca_format_integer(&o, step_keys[values[i].offset - values[i - 1].offset]);
+    for (size_t i = 1; i < count; ++i) {
+      const auto step = std::lower_bound(
+          steps.begin(), steps.end(), values[i].offset - values[i - 1].offset);
+      ca_format_integer(&o, step - steps.begin());
+    }
   } else {
     for (size_t i = 1; i < count; ++i)
       ca_format_integer(&o, values[i].offset - values[i - 1].offset);
   }
 
-  std::vector<uint8_t> prob_mask;
-  prob_mask.resize((count + 7) / 8, 0);
+  auto& prob_mask = context.prob_mask;
+  prob_mask.assign((count + 7) / 8, 0);
 
   for (size_t i = 0; i < count; ++i) {
     if (std::isfinite(values[i].score_pct5) &&
@@ -242,6 +430,79 @@ void EncodeOffsetScoreWithPrediction(uint8_t*& o,
   }
 }
 
+// Stores `values' as CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED, with
+// probability bands rounded to multiples of twice `error_bound' away from the
+// median.  Returns false without writing anything if a band is too far from
+// its median to be stored this way.
+bool EncodeOffsetScoreQuantized(uint8_t*& o,
+                                const struct ca_offset_score* values,
+                                size_t count, float error_bound,
+                                CodecContext& context) {
+  const double step = 2.0 * error_bound;
+
+  auto& prob_mask = context.prob_mask;
+  prob_mask.assign((count + 7) / 8, 0);
+  auto& bands = context.bands;
+  bands.clear();
+  int32_t max_band = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto& v = values[i];
+    if (!std::isfinite(v.score_pct5) || !std::isfinite(v.score_pct25) ||
+        !std::isfinite(v.score_pct75) || !std::isfinite(v.score_pct95))
+      continue;
+    prob_mask[i >> 3] |= (1 << (i & 7));
+
+    for (const auto band :
+         {v.score_pct5, v.score_pct25, v.score_pct75, v.score_pct95}) {
+      const auto q = std::nearbyint((double(band) - v.score) / step);
+      if (!(std::fabs(q) <= INT16_MAX)) return false;
+      bands.emplace_back(static_cast<int32_t>(q));
+      max_band = std::max(max_band, std::abs(bands.back()));
+    }
+  }
+
+  *o++ = CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED;
+  oroch::varint_codec<size_t>::value_encode(o, count);
+  oroch::varint_codec<uint64_t>::value_encode(o, values[0].offset);
+
+  auto& offset_delta = context.offsets;
+  offset_delta.resize(count - 1);
+  for (size_t i = 1; i < count; ++i)
+    offset_delta[i - 1] = values[i].offset - values[i - 1].offset;
+
+  oroch::integer_codec<uint64_t>::metadata offset_meta;
+  oroch::integer_codec<uint64_t>::select(offset_meta, offset_delta.begin(),
+                                         offset_delta.end());
+  offset_meta.encode(o);
+  oroch::integer_codec<uint64_t>::encode(o, offset_delta.begin(),
+                                         offset_delta.end(), offset_meta);
+
+  auto& score_xor = context.score_xor;
+  score_xor.clear();
+  EncodeScoresXOR(score_xor, values, count);
+  oroch::varint_codec<size_t>::value_encode(o, score_xor.size());
+  memcpy(o, score_xor.data(), score_xor.size());
+  o += score_xor.size();
+
+  struct CA_rle_context rle;
+  CA_rle_init_write(&rle, o);
+  for (const auto& b : prob_mask) CA_rle_put(&rle, b);
+  o = CA_rle_flush(&rle);
+
+  EncodeFloat(o, step);
+
+  const uint8_t band_size = (max_band <= INT8_MAX) ? 1 : 2;
+  *o++ = band_size;
+
+  for (const auto band : bands) {
+    *o++ = static_cast<uint8_t>(band);
+    if (band_size == 2) *o++ = static_cast<uint8_t>(band >> 8);
+  }
+
+  return true;
+}
+
 }  // namespace
 
 std::string Escape(const string_view& str) {
@@ -284,14 +545,29 @@ void ca_format_integer(uint8_t** output, uint64_t value) {
   *output = p;
 }
 
-size_t ca_offset_score_size(const struct ca_offset_score* values,
-                            size_t count) {
-  return 32 + count * sizeof(struct ca_offset_score);
+size_t ca_offset_score_size(size_t count, const OffsetScoreFormat& format) {
+  size_t result = 32 + count * sizeof(struct ca_offset_score);
+
+  // Blocked lists add a header to each chunk, and repeat the list header in
+  // each chunk.
+  if (const size_t block_size = format.block_size)
+    result += (count / block_size + 1) * (kMaxOffsetScoreBlockHeaderSize + 32);
+
+  if (format.summary) result += kMaxOffsetScoreSummarySize;
+
+  return result;
 }
 
 size_t ca_format_offset_score(uint8_t* output, size_t output_size,
                               const struct ca_offset_score* values,
-                              size_t count) {
+                              size_t count, CodecContext* context,
+                              const OffsetScoreFormat& format) {
+  const size_t block_size = format.block_size;
+  KJ_REQUIRE(!block_size || block_size >= kMinOffsetScoreBlockSize,
+             "offset/score block size too small", block_size);
+  const float error_bound = format.prediction_error_bound;
+  KJ_REQUIRE(error_bound >= 0.0f && std::isfinite(error_bound), error_bound);
+
   if (!count) {
     *output++ = CA_OFFSET_SCORE_EMPTY;
     return 1;
@@ -310,10 +586,54 @@ size_t ca_format_offset_score(uint8_t* output, size_t output_size,
 
   uint8_t* start = output;
 
-  if (has_probabilty_bands)
-    EncodeOffsetScoreWithPrediction(output, values, count);
-  else
-    EncodeOffsetScoreOroch(output, output + output_size, values, count);
+  // Leave room for the summary header, which depends on the encoded size.
+  const bool summary = format.summary && count > 1;
+  if (summary) output += kMaxOffsetScoreSummarySize;
+  uint8_t* data = output;
+
+  const bool blocked =
+      block_size && count > 2 * block_size && !has_probabilty_bands &&
+      std::is_sorted(values, values + count,
+                     [](const auto& lhs, const auto& rhs) {
+                       return lhs.offset < rhs.offset;
+                     });
+
+  CodecContext local_context;
+  if (!context) context = &local_context;
+
+  if (has_probabilty_bands) {
+    if (!error_bound ||
+        !EncodeOffsetScoreQuantized(output, values, count, error_bound,
+                                    *context)) {
+      EncodeOffsetScoreWithPrediction(output, values, count, *context);
+    }
+  } else if (blocked) {
+    EncodeOffsetScoreBlocked(output, start + output_size, values, count,
+                             block_size, *context);
+  } else {
+    EncodeOffsetScoreOroch(output, start + output_size, values, count,
+                           *context);
+  }
+
+  // Replace the list with a bitmap, unless that would more than double its
+  // size.  Bitmaps are cheaper to decode and to combine in queries.
+  if (format.bitmaps && count >= kMinOffsetScoreBitmapSize &&
+      !has_probabilty_bands && HasSingleScoreAscendingOffsets(values, count)) {
+    const auto bitmap = OffsetBitmap::FromOffsets(values, count);
+    if (1 + sizeof(float) + bitmap.EncodedSize() <=
+        2 * static_cast<size_t>(output - data)) {
+      output = data;
+      *output++ = CA_OFFSET_SCORE_BITMAP;
+      EncodeFloat(output, values[0].score);
+      bitmap.Encode(output);
+    }
+  }
+
+  if (summary) {
+    const size_t size = output - data;
+    output = start;
+    EncodeOffsetScoreSummary(output, data, size, values, count);
+  }
 
   return output - start;
 }
@@ -1,5 +1,6 @@
 #include <cassert>
 #include <cstdint>
+#include <thread>
 #include <vector>
 
 #include <sys/time.h>
@@ -21,7 +22,7 @@ int main(int argc, char** argv) {
     values.emplace_back(v);
   }
 
-  auto max_size = ca_table::ca_offset_score_size(&values[0], values.size());
+  auto max_size = ca_table::ca_offset_score_size(values.size());
 
   std::vector<uint8_t> encoded(max_size);
 
@@ -51,4 +52,31 @@ int main(int argc, char** argv) {
     printf("Decode: %.3f\n", (end.tv_sec - start.tv_sec) +
                                  1.0e-6 * (end.tv_usec - start.tv_usec));
   }
+
+  {
+    ca_table::OffsetScoreFormat format;
+    format.block_size = 4096;
+    max_size = ca_table::ca_offset_score_size(values.size(), format);
+    encoded.resize(max_size);
+    encoded.resize(ca_table::ca_format_offset_score(
+        &encoded[0], max_size, &values[0], values.size(), nullptr, format));
+
+    const auto thread_count = std::thread::hardware_concurrency();
+
+    std::vector<ca_table::OffsetScore> decoded;
+    gettimeofday(&start, nullptr);
+    ca_table::ca_offset_score_parse_parallel(
+        cantera::string_view{reinterpret_cast<const char*>(encoded.data()),
+                             encoded.size()},
+        &decoded, thread_count);
+    gettimeofday(&end, nullptr);
+
+    assert(std::equal(decoded.begin(), decoded.end(), values.begin(),
+                      values.end(), [](auto& lhs, auto& rhs) {
+      return lhs.offset == rhs.offset && lhs.score == rhs.score;
+    }));
+    printf("Blocked decode on %u threads: %.3f\n", thread_count,
+           (end.tv_sec - start.tv_sec) +
+               1.0e-6 * (end.tv_usec - start.tv_usec));
+  }
 }
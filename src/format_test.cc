@@ -1,27 +1,34 @@
 #include <algorithm>
 #include <cmath>
+#include <iterator>
+#include <limits>
 
 #include <kj/debug.h>
 
 #include "src/ca-table.h"
+#include "src/integer-decode.h"
+#include "src/offset-bitmap.h"
+#include "third_party/oroch/oroch/integer_codec.h"
 #include "third_party/gtest/gtest.h"
 
 using namespace cantera::table;
 
 namespace {
 
-void ValidateValues(ca_offset_score* values, size_t count) {
+void ValidateValues(ca_offset_score* values, size_t count,
+                    const OffsetScoreFormat& format = {}) {
   std::sort(values, values + count, [](const auto& lhs, const auto& rhs) {
     return lhs.score < rhs.score;
   });
 
-  auto compressed_size = ca_offset_score_size(values, count);
+  auto compressed_size = ca_offset_score_size(count, format);
 
   std::vector<uint8_t> compressed_data(compressed_size);
 
   {
     auto data = compressed_data.data();
-    auto size = ca_format_offset_score(data, compressed_size, values, count);
+    auto size = ca_format_offset_score(data, compressed_size, values, count,
+                                       nullptr, format);
 
     EXPECT_LE(size, compressed_size);
     compressed_data.resize(size);
@@ -44,6 +51,26 @@ void ValidateValues(ca_offset_score* values, size_t count) {
         ca_offset_score_max_offset(&compressed_data[0],
                                    &compressed_data[compressed_data.size()]));
   }
+
+  {
+    const cantera::string_view data(
+        reinterpret_cast<const char*>(compressed_data.data()),
+        compressed_data.size());
+
+    std::vector<OffsetScore> offsets;
+    ca_offset_score_parse_offsets(data, &offsets);
+
+    ASSERT_EQ(count, offsets.size());
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(values[i].offset, offsets[i].offset);
+      EXPECT_EQ(0.0f, offsets[i].score);
+    }
+
+    size_t i = 0;
+    for (OffsetScoreCursor cursor(data, false); cursor.Valid(); cursor.Next())
+      EXPECT_EQ(values[i++].offset, cursor.Get().offset);
+    EXPECT_EQ(count, i);
+  }
 }
 
 }  // namespace
@@ -81,7 +108,7 @@ TEST_F(FormatTest, OffsetScoreFuzzTest) {
       offset += step_min + (rand() % (step_max - step_min));
     }
 
-    auto max_size = ca_offset_score_size(&values[0], values.size());
+    auto max_size = ca_offset_score_size(values.size());
 
     std::vector<uint8_t> buffer(max_size);
 
@@ -120,6 +147,99 @@ TEST_F(FormatTest, OffsetScoreFuzzTest) {
       EXPECT_EQ(values.back().offset,
                 ca_offset_score_max_offset(&buffer[0], &buffer[buffer.size()]));
     }
+
+    // The compact representation keeps probability bands in a side table.
+    std::vector<OffsetScore> compact_values;
+    std::vector<OffsetScorePercentiles> percentiles;
+    ca_offset_score_parse(
+        cantera::string_view{reinterpret_cast<const char*>(buffer.data()),
+                             buffer.size()},
+        &compact_values, &percentiles);
+    ASSERT_EQ(values.size(), compact_values.size());
+
+    auto p = percentiles.begin();
+    for (size_t i = 0; i < values.size(); ++i) {
+      EXPECT_EQ(values[i].offset, compact_values[i].offset);
+      EXPECT_EQ(values[i].score, compact_values[i].score);
+
+      if (!values[i].HasPercentiles()) continue;
+      ASSERT_TRUE(p != percentiles.end());
+      EXPECT_EQ(i, p->index);
+      EXPECT_EQ(values[i].score_pct5, p->score_pct5);
+      EXPECT_EQ(values[i].score_pct95, p->score_pct95);
+      ++p;
+    }
+    EXPECT_TRUE(p == percentiles.end());
+  }
+}
+
+TEST_F(FormatTest, QuantizedPrediction) {
+  const float kErrorBound = 0.01f;
+
+  std::vector<ca_offset_score> values;
+  uint64_t offset = 1000;
+  for (size_t i = 0; i < 500; ++i) {
+    offset += 1 + i % 5;
+    ca_offset_score v(offset, 10.0f + i * 0.25f);
+    if (i % 7) {
+      v.score_pct25 = v.score - 0.1f * (i % 11);
+      v.score_pct75 = v.score + 0.3f;
+      v.score_pct5 = v.score_pct25 - ((i % 50) ? 0.5f : 200.0f);
+      v.score_pct95 = v.score_pct75 + 1.0f / (1 + i);
+    }
+    values.emplace_back(v);
+  }
+
+  std::vector<uint8_t> exact(ca_offset_score_size(values.size()));
+  exact.resize(ca_format_offset_score(exact.data(), exact.size(), values.data(),
+                                      values.size()));
+  EXPECT_EQ(CA_OFFSET_SCORE_WITH_PREDICTION, exact[0]);
+
+  OffsetScoreFormat format;
+  format.prediction_error_bound = kErrorBound;
+  std::vector<uint8_t> buffer(ca_offset_score_size(values.size(), format));
+  buffer.resize(ca_format_offset_score(buffer.data(), buffer.size(),
+                                       values.data(), values.size(), nullptr,
+                                       format));
+
+  // Bands too far from the median are stored exactly.
+  ca_offset_score far_value(1, 0.0f);
+  far_value.score_pct5 = far_value.score_pct25 = -1e6f;
+  far_value.score_pct75 = far_value.score_pct95 = 1e6f;
+  std::vector<uint8_t> far_buffer(ca_offset_score_size(1, format));
+  far_buffer.resize(ca_format_offset_score(
+      far_buffer.data(), far_buffer.size(), &far_value, 1, nullptr, format));
+
+  EXPECT_EQ(CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED, buffer[0]);
+  EXPECT_EQ(CA_OFFSET_SCORE_WITH_PREDICTION, far_buffer[0]);
+  EXPECT_GT(exact.size() / 2, buffer.size());
+
+  EXPECT_EQ(values.size(),
+            ca_offset_score_count(buffer.data(), buffer.data() + buffer.size()));
+  EXPECT_EQ(values.back().offset,
+            ca_offset_score_max_offset(buffer.data(),
+                                       buffer.data() + buffer.size()));
+
+  std::vector<ca_offset_score> decoded_values;
+  ca_offset_score_parse(
+      cantera::string_view{reinterpret_cast<const char*>(buffer.data()),
+                           buffer.size()},
+      &decoded_values);
+  ASSERT_EQ(values.size(), decoded_values.size());
+
+  for (size_t i = 0; i < values.size(); ++i) {
+    const auto& expected = values[i];
+    const auto& actual = decoded_values[i];
+    EXPECT_EQ(expected.offset, actual.offset);
+    EXPECT_EQ(expected.score, actual.score);
+    ASSERT_EQ(expected.HasPercentiles(), actual.HasPercentiles());
+    if (!expected.HasPercentiles()) continue;
+
+    const auto tolerance = kErrorBound * 1.001f;
+    EXPECT_NEAR(expected.score_pct5, actual.score_pct5, tolerance);
+    EXPECT_NEAR(expected.score_pct25, actual.score_pct25, tolerance);
+    EXPECT_NEAR(expected.score_pct75, actual.score_pct75, tolerance);
+    EXPECT_NEAR(expected.score_pct95, actual.score_pct95, tolerance);
   }
 }
 
@@ -218,3 +338,450 @@ TEST_F(FormatTest, SingleValue) {
 
   ValidateValues(&value, 1);
 }
+
+TEST_F(FormatTest, SlowlyVaryingScore) {
+  static const size_t kValueCount = 1024;
+  struct ca_offset_score values[kValueCount];
+
+  float price = 123.25f;
+  for (size_t i = 0; i < kValueCount; ++i) {
+    values[i].offset = i;
+    values[i].score = price;
+    if (i % 3) price += 0.125f;
+  }
+
+  std::vector<uint8_t> buffer(ca_offset_score_size(kValueCount));
+  buffer.resize(ca_format_offset_score(buffer.data(), buffer.size(), values,
+                                       kValueCount));
+  EXPECT_EQ(CA_OFFSET_SCORE_DELTA_OROCH_XOR, buffer[0]);
+  EXPECT_GT(kValueCount * sizeof(float) / 2, buffer.size());
+
+  ValidateValues(values, kValueCount);
+}
+
+TEST_F(FormatTest, SpecialFloatScore) {
+  std::vector<ca_offset_score> values;
+  for (const auto score :
+       {-0.0f, 0.5f, 0.0f, std::numeric_limits<float>::infinity(), 0.5f,
+        -std::numeric_limits<float>::infinity(), 1e-40f, 0.5f, 0.5f,
+        std::numeric_limits<float>::max(), 0.75f, 0.75f, 0.75f, 0.75f}) {
+    values.emplace_back(values.size(), score);
+  }
+
+  ValidateValues(values.data(), values.size());
+}
+
+TEST_F(FormatTest, BlockedOffsetScore) {
+  std::vector<ca_offset_score> values;
+  uint64_t offset = 12345;
+  for (size_t i = 0; i < 1000; ++i) {
+    offset += 1 + (i * 7919) % 1000;
+    values.emplace_back(offset, (i % 3) ? float(i % 100) : i * 0.5f);
+  }
+
+  OffsetScoreFormat format;
+  format.block_size = 128;
+
+  // Lists not sorted by offset are stored unblocked.
+  auto unsorted_values = values;
+  ValidateValues(unsorted_values.data(), unsorted_values.size(), format);
+
+  std::vector<uint8_t> buffer(ca_offset_score_size(values.size(), format));
+  buffer.resize(ca_format_offset_score(buffer.data(), buffer.size(),
+                                       values.data(), values.size(), nullptr,
+                                       format));
+
+  EXPECT_EQ(CA_OFFSET_SCORE_BLOCKED, buffer[0]);
+  EXPECT_EQ(values.size(),
+            ca_offset_score_count(buffer.data(), buffer.data() + buffer.size()));
+  EXPECT_EQ(values.back().offset,
+            ca_offset_score_max_offset(buffer.data(),
+                                       buffer.data() + buffer.size()));
+
+  const cantera::string_view data(reinterpret_cast<const char*>(buffer.data()),
+                                  buffer.size());
+  std::vector<ca_offset_score> decoded_values;
+  ca_offset_score_parse(data, &decoded_values);
+  ASSERT_EQ(values.size(), decoded_values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(values[i].offset, decoded_values[i].offset);
+    EXPECT_EQ(values[i].score, decoded_values[i].score);
+  }
+
+  // Walk the list with the cursor, skipping ahead by varying distances.
+  OffsetScoreCursor cursor(data);
+  size_t i = 0;
+  for (uint64_t target = values[0].offset; cursor.Valid();
+       target += 1 + (target * 31) % 200000) {
+    cursor.SkipTo(target);
+    while (i < values.size() && values[i].offset < target) ++i;
+    if (i == values.size()) break;
+    ASSERT_TRUE(cursor.Valid());
+    EXPECT_EQ(values[i].offset, cursor.Get().offset);
+    EXPECT_LE(cursor.Get().score, cursor.MaxScore());
+  }
+  EXPECT_FALSE(cursor.Valid() && i == values.size());
+
+  // Lists in other encodings, and sequences of lists, are visited in full.
+  std::vector<uint8_t> small_buffer(ca_offset_score_size(10));
+  small_buffer.resize(ca_format_offset_score(
+      small_buffer.data(), small_buffer.size(), values.data(), 10));
+  small_buffer.insert(small_buffer.end(), buffer.begin(), buffer.end());
+
+  OffsetScoreCursor all(cantera::string_view(
+      reinterpret_cast<const char*>(small_buffer.data()), small_buffer.size()));
+  size_t count = 0;
+  for (; all.Valid(); all.Next()) ++count;
+  EXPECT_EQ(10 + values.size(), count);
+}
+
+TEST_F(FormatTest, ParallelParse) {
+  std::vector<ca_offset_score> values;
+  uint64_t offset = 0;
+  for (size_t i = 0; i < 300000; ++i) {
+    offset += 1 + i % 17;
+    values.emplace_back(offset, float(i % 1000));
+  }
+
+  // A short list, a blocked list, a short list, and a blocked list with a
+  // summary header.
+  std::vector<uint8_t> buffer;
+  auto append = [&buffer](const ca_offset_score* values, size_t count,
+                          const OffsetScoreFormat& format) {
+    const auto size = buffer.size();
+    buffer.resize(size + ca_offset_score_size(count, format));
+    buffer.resize(size + ca_format_offset_score(&buffer[size],
+                                                buffer.size() - size, values,
+                                                count, nullptr, format));
+  };
+  OffsetScoreFormat blocked, summarized;
+  blocked.block_size = 512;
+  summarized.block_size = 1024;
+  summarized.summary = true;
+  append(values.data(), 100, {});
+  append(values.data() + 100, 100000, blocked);
+  append(values.data() + 100100, 100, {});
+  append(values.data() + 100200, values.size() - 100200, summarized);
+
+  const cantera::string_view data(reinterpret_cast<const char*>(buffer.data()),
+                                  buffer.size());
+
+  for (const size_t thread_count : {1, 4}) {
+    std::vector<OffsetScore> decoded(1, OffsetScore(1, 2.0f));
+    ca_offset_score_parse_parallel(data, &decoded, thread_count);
+    ASSERT_EQ(values.size() + 1, decoded.size());
+    EXPECT_EQ(1U, decoded[0].offset);
+    for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i].offset, decoded[i + 1].offset);
+      ASSERT_EQ(values[i].score, decoded[i + 1].score);
+    }
+
+    decoded.clear();
+    ca_offset_score_parse_parallel(data, &decoded, thread_count, false);
+    ASSERT_EQ(values.size(), decoded.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i].offset, decoded[i].offset);
+      ASSERT_EQ(0.0f, decoded[i].score);
+    }
+  }
+}
+
+TEST_F(FormatTest, CodecContext) {
+  CodecContext context;
+
+  // Alternate between long and short lists of every kind, so that buffers
+  // left over from a long list are reused for a shorter one.
+  for (size_t i = 0; i < 40; ++i) {
+    const size_t count = (i % 2) ? 3 + i : 5000 - 100 * i;
+
+    std::vector<ca_offset_score> values;
+    uint64_t offset = 1000 * i;
+    for (size_t j = 0; j < count; ++j) {
+      offset += 1 + (j * 7919 + i) % 300;
+      switch (i % 4) {
+        case 0: values.emplace_back(offset, float(j % 50)); break;
+        case 1: values.emplace_back(offset, 20.0f + 0.001f * j); break;
+        case 2: values.emplace_back(offset, rand() * 0.01f); break;
+        case 3:
+          values.emplace_back(offset, float(j));
+          values.back().score_pct5 = j - 2.0f;
+          values.back().score_pct25 = j - 1.0f;
+          values.back().score_pct75 = j + 1.0f;
+          values.back().score_pct95 = j + 2.0f;
+          break;
+      }
+    }
+
+    OffsetScoreFormat format;
+    if (i % 8 == 4) format.block_size = 256;
+    if (i % 8 == 7) format.prediction_error_bound = 0.25f;
+
+    std::vector<uint8_t> expected(ca_offset_score_size(values.size(), format));
+    expected.resize(ca_format_offset_score(expected.data(), expected.size(),
+                                           values.data(), values.size(),
+                                           nullptr, format));
+
+    std::vector<uint8_t> buffer(ca_offset_score_size(values.size(), format));
+    buffer.resize(ca_format_offset_score(buffer.data(), buffer.size(),
+                                         values.data(), values.size(),
+                                         &context, format));
+
+    ASSERT_EQ(expected, buffer);
+
+    const auto begin = buffer.data();
+    const auto end = buffer.data() + buffer.size();
+    EXPECT_EQ(count, ca_offset_score_count(begin, end, &context));
+    EXPECT_EQ(values.back().offset,
+              ca_offset_score_max_offset(begin, end, &context));
+
+    const cantera::string_view data(reinterpret_cast<const char*>(begin),
+                                    buffer.size());
+
+    std::vector<ca_offset_score> decoded;
+    ca_offset_score_parse(data, &decoded, &context);
+    ASSERT_EQ(count, decoded.size());
+    for (size_t j = 0; j < count; ++j) {
+      ASSERT_EQ(values[j].offset, decoded[j].offset);
+      ASSERT_EQ(values[j].score, decoded[j].score);
+      if (values[j].HasPercentiles()) {
+        ASSERT_NEAR(values[j].score_pct95, decoded[j].score_pct95, 0.25f);
+      }
+    }
+
+    std::vector<OffsetScore> offsets;
+    ca_offset_score_parse_offsets(data, &offsets, &context);
+    ASSERT_EQ(count, offsets.size());
+    for (size_t j = 0; j < count; ++j)
+      ASSERT_EQ(values[j].offset, offsets[j].offset);
+  }
+}
+
+TEST_F(FormatTest, OffsetScoreSummary) {
+  std::vector<ca_offset_score> values;
+  for (size_t i = 0; i < 200; ++i) values.emplace_back(1000 + i * 3, i % 7);
+
+  OffsetScoreFormat format;
+  format.summary = true;
+  auto unsorted_values = values;
+  ValidateValues(unsorted_values.data(), unsorted_values.size(), format);
+  ValidateValues(unsorted_values.data(), 1, format);
+
+  // Store the first half as one list, and the second half as a blocked list.
+  std::vector<uint8_t> buffer;
+  for (const size_t block_size : {0, 16}) {
+    const auto half = values.data() + (block_size ? 100 : 0);
+    format.block_size = block_size;
+    auto size = buffer.size();
+    buffer.resize(size + ca_offset_score_size(100, format));
+    buffer.resize(size + ca_format_offset_score(&buffer[size],
+                                                buffer.size() - size, half,
+                                                100, nullptr, format));
+    EXPECT_EQ(CA_OFFSET_SCORE_WITH_SUMMARY, buffer[size]);
+  }
+
+  EXPECT_EQ(values.size(),
+            ca_offset_score_count(buffer.data(), buffer.data() + buffer.size()));
+  EXPECT_EQ(values.back().offset,
+            ca_offset_score_max_offset(buffer.data(),
+                                       buffer.data() + buffer.size()));
+
+  const cantera::string_view data(reinterpret_cast<const char*>(buffer.data()),
+                                  buffer.size());
+  std::vector<ca_offset_score> decoded_values;
+  ca_offset_score_parse(data, &decoded_values);
+  ASSERT_EQ(values.size(), decoded_values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(values[i].offset, decoded_values[i].offset);
+    EXPECT_EQ(values[i].score, decoded_values[i].score);
+  }
+
+  OffsetScoreCursor cursor(data);
+  size_t i = 0;
+  for (uint64_t target = 0; cursor.Valid(); target += 37) {
+    cursor.SkipTo(target);
+    while (i < values.size() && values[i].offset < target) ++i;
+    if (i == values.size()) break;
+    ASSERT_TRUE(cursor.Valid());
+    EXPECT_EQ(values[i].offset, cursor.Get().offset);
+  }
+  EXPECT_FALSE(cursor.Valid());
+}
+
+TEST_F(FormatTest, BitmapOffsetScore) {
+  // Dense runs, a sparse tail, and a gap of several bitmap groups.
+  std::vector<ca_offset_score> values;
+  for (uint64_t offset = 70000; offset < 200000; offset += 1 + offset % 3)
+    values.emplace_back(offset, 1.0f);
+  for (uint64_t offset = 1000000; offset < 1100000; offset += 97)
+    values.emplace_back(offset, 1.0f);
+
+  OffsetScoreFormat format;
+  format.bitmaps = true;
+  std::vector<uint8_t> buffer(ca_offset_score_size(10, format));
+  buffer.resize(ca_format_offset_score(buffer.data(), buffer.size(),
+                                       values.data(), 10, nullptr, format));
+  EXPECT_NE(CA_OFFSET_SCORE_BITMAP, buffer[0]);
+
+  buffer.resize(ca_offset_score_size(values.size(), format));
+  buffer.resize(ca_format_offset_score(buffer.data(), buffer.size(),
+                                       values.data(), values.size(), nullptr,
+                                       format));
+  EXPECT_EQ(CA_OFFSET_SCORE_BITMAP, buffer[0]);
+
+  EXPECT_EQ(values.size(),
+            ca_offset_score_count(buffer.data(), buffer.data() + buffer.size()));
+  EXPECT_EQ(values.back().offset,
+            ca_offset_score_max_offset(buffer.data(),
+                                       buffer.data() + buffer.size()));
+
+  const cantera::string_view data(reinterpret_cast<const char*>(buffer.data()),
+                                  buffer.size());
+  std::vector<ca_offset_score> decoded_values;
+  ca_offset_score_parse(data, &decoded_values);
+  ASSERT_EQ(values.size(), decoded_values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    EXPECT_EQ(values[i].offset, decoded_values[i].offset);
+    EXPECT_EQ(values[i].score, decoded_values[i].score);
+  }
+
+  OffsetBitmap bitmap;
+  ASSERT_TRUE(ca_offset_score_parse_bitmap(data, &bitmap));
+  EXPECT_EQ(values.size(), bitmap.Count());
+
+  // Set operations match those on sorted lists.
+  std::vector<uint64_t> rhs_offsets;
+  for (uint64_t offset = 0; offset < 1200000; offset += 1 + offset % 13)
+    rhs_offsets.emplace_back(offset);
+  std::vector<OffsetScore> rhs;
+  for (const auto offset : rhs_offsets) rhs.emplace_back(offset, 0.0f);
+  const auto rhs_bitmap = OffsetBitmap::FromOffsets(rhs.data(), rhs.size());
+
+  std::vector<uint64_t> lhs_offsets;
+  for (const auto& v : values) lhs_offsets.emplace_back(v.offset);
+
+  std::vector<uint64_t> expected;
+  std::vector<OffsetScore> result;
+  auto check = [&expected, &result](const OffsetBitmap& bitmap) {
+    result.clear();
+    bitmap.AppendTo(&result, 0.0f);
+    ASSERT_EQ(expected.size(), result.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+      EXPECT_EQ(expected[i], result[i].offset);
+  };
+
+  std::set_intersection(lhs_offsets.begin(), lhs_offsets.end(),
+                        rhs_offsets.begin(), rhs_offsets.end(),
+                        std::back_inserter(expected));
+  auto tmp = bitmap;
+  tmp.IntersectWith(rhs_bitmap);
+  check(tmp);
+
+  std::vector<OffsetScore> filtered = rhs;
+  filtered.resize(bitmap.Filter(filtered.data(), filtered.size(), true));
+  ASSERT_EQ(expected.size(), filtered.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), filtered.begin(),
+                         [](uint64_t lhs, const OffsetScore& rhs) {
+                           return lhs == rhs.offset;
+                         }));
+
+  expected.clear();
+  std::set_union(lhs_offsets.begin(), lhs_offsets.end(), rhs_offsets.begin(),
+                 rhs_offsets.end(), std::back_inserter(expected));
+  tmp = bitmap;
+  tmp.UnionWith(rhs_bitmap);
+  check(tmp);
+
+  expected.clear();
+  std::set_difference(lhs_offsets.begin(), lhs_offsets.end(),
+                      rhs_offsets.begin(), rhs_offsets.end(),
+                      std::back_inserter(expected));
+  tmp = bitmap;
+  tmp.Subtract(rhs_bitmap);
+  check(tmp);
+
+  expected.clear();
+  std::set_difference(rhs_offsets.begin(), rhs_offsets.end(),
+                      lhs_offsets.begin(), lhs_offsets.end(),
+                      std::back_inserter(expected));
+  tmp = rhs_bitmap;
+  tmp.Subtract(bitmap);
+  check(tmp);
+  EXPECT_FALSE(tmp.Contains(values[0].offset));
+  EXPECT_TRUE(tmp.Contains(expected[0]));
+}
+
+TEST_F(FormatTest, DecodeKernels) {
+  using namespace cantera::table::internal;
+
+  srand(1234);
+
+  for (size_t iteration = 0; iteration < 2000; ++iteration) {
+    // Mix narrow values with occasional wide ones, so that oroch picks
+    // bit-packed, frame of reference, patched and varint encodings.
+    std::vector<uint64_t> values(rand() % 700);
+    const uint64_t origin = (rand() % 2) ? rand() : 0;
+    const size_t nbits = 1 + rand() % 64;
+    const size_t outlier_rate = 1 + rand() % 50;
+    for (auto& v : values) {
+      v = (uint64_t(rand()) << 33) ^ (uint64_t(rand()) << 16) ^ rand();
+      if (rand() % outlier_rate) v &= ~uint64_t(0) >> (64 - nbits);
+      v += origin;
+    }
+
+    oroch::integer_codec<uint64_t>::metadata meta;
+    oroch::integer_codec<uint64_t>::select(meta, values.begin(), values.end());
+    std::vector<uint8_t> encoded(meta.metaspace() + meta.dataspace());
+    auto o = encoded.data();
+    meta.encode(o);
+    oroch::integer_codec<uint64_t>::encode(o, values.begin(), values.end(),
+                                           meta);
+    ASSERT_EQ(encoded.data() + encoded.size(), o);
+
+    std::vector<uint64_t> sums = values;
+    PrefixSum(sums.data(), sums.size(), origin, kDecodeKernelScalar);
+
+    for (const auto kernel :
+         {kDecodeKernelScalar, kDecodeKernelSSE41, kDecodeKernelAVX2}) {
+      if (!DecodeKernelSupported(kernel)) continue;
+
+      std::vector<uint64_t> decoded(values.size());
+      const uint8_t* begin = encoded.data();
+      DecodeUInt64s(decoded.data(), decoded.size(), begin,
+                    encoded.data() + encoded.size(), kernel);
+      EXPECT_EQ(encoded.data() + encoded.size(), begin);
+      ASSERT_EQ(values, decoded) << kernel;
+
+      PrefixSum(decoded.data(), decoded.size(), origin, kernel);
+      ASSERT_EQ(sums, decoded) << kernel;
+    }
+  }
+  // Varints of mixed lengths, mostly one and two bytes.
+  for (size_t iteration = 0; iteration < 200; ++iteration) {
+    std::vector<uint64_t> values(rand() % 700);
+    for (auto& v : values) {
+      const int width = rand() % 16;
+      v = uint64_t(rand()) % (width < 6 ? 0x80 : width < 14 ? 0x4000 : 1 << 30);
+    }
+
+    oroch::integer_codec<uint64_t>::metadata meta;
+    meta.value_desc.encoding = oroch::encoding_t::varint;
+    std::vector<uint8_t> encoded(
+        meta.metaspace() +
+        oroch::varint_codec<uint64_t>::space(values.begin(), values.end()));
+    auto o = encoded.data();
+    meta.encode(o);
+    oroch::varint_codec<uint64_t>::encode(o, values.begin(), values.end());
+    ASSERT_EQ(encoded.data() + encoded.size(), o);
+
+    for (const auto kernel : {kDecodeKernelScalar, kDecodeKernelSSE41}) {
+      if (!DecodeKernelSupported(kernel)) continue;
+
+      std::vector<uint64_t> decoded(values.size());
+      const uint8_t* begin = encoded.data();
+      DecodeUInt64s(decoded.data(), decoded.size(), begin,
+                    encoded.data() + encoded.size(), kernel);
+      EXPECT_EQ(encoded.data() + encoded.size(), begin);
+      ASSERT_EQ(values, decoded) << kernel;
+    }
+  }
+}
@@ -0,0 +1,419 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "src/integer-decode.h"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <vector>
+
+#include <kj/debug.h>
+
+#include "src/ca-table.h"
+
+#if defined(__x86_64__) && defined(HAVE_IMMINTRIN_H)
+#define CA_TABLE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#include "third_party/oroch/oroch/integer_codec.h"
+
+namespace cantera {
+namespace table {
+namespace internal {
+
+namespace {
+
+using Metadata = oroch::integer_codec<uint64_t>::metadata;
+
+// Bit-packed sequences shorter than this are decoded by oroch, since the
+// vector kernels need some setup for each sequence.
+const size_t kMinVectorUnpackCount = 64;
+
+void UnpackBitsScalar(uint64_t* output, size_t count, const uint8_t*& begin,
+                      size_t nbits, uint64_t origin) {
+  oroch::bitfor_codec<uint64_t>::parameters params(origin, nbits);
+  oroch::bitfor_codec<uint64_t>::decode(output, output + count, begin, params);
+}
+
+#if CA_TABLE_X86_KERNELS
+
+// Unpacks oroch::bitpck_codec blocks.  Each 16 byte block holds the values
+// as a little endian bit stream, so value `i' of a block spans bits
+// [i * nbits, (i + 1) * nbits) of the two 64-bit words.  For four values at
+// a time, both words a value may touch are picked from a register holding
+// the block followed by zeros, and shifted into place.
+__attribute__((target("avx2"))) void UnpackBitsAVX2(uint64_t* output,
+                                                    size_t count,
+                                                    const uint8_t*& begin,
+                                                    size_t nbits,
+                                                    uint64_t origin) {
+  static const size_t kBlockSize = oroch::bitpck_codec<uint64_t>::block_size;
+
+  const size_t capacity = oroch::bitpck_codec<uint64_t>::capacity(nbits);
+  const size_t groups = (capacity + 3) / 4;
+
+  __m256i low_words[32], high_words[32], low_shifts[32], high_shifts[32];
+  for (size_t g = 0; g < groups; ++g) {
+    int32_t low_word[4], high_word[4];
+    int64_t low_shift[4], high_shift[4];
+    for (size_t k = 0; k < 4; ++k) {
+      // Lanes past the end of the block read the zero words 2 and 3.
+      const size_t bit = std::min((g * 4 + k) * nbits, size_t(128));
+      low_word[k] = bit / 64;
+      high_word[k] = std::min(bit / 64 + 1, size_t(2));
+      low_shift[k] = bit % 64;
+      // A shift of 64 yields zero, which is what we want for values that
+      // start at a word boundary.
+      high_shift[k] = 64 - bit % 64;
+    }
+    low_words[g] = _mm256_setr_epi32(
+        2 * low_word[0], 2 * low_word[0] + 1, 2 * low_word[1],
+        2 * low_word[1] + 1, 2 * low_word[2], 2 * low_word[2] + 1,
+        2 * low_word[3], 2 * low_word[3] + 1);
+    high_words[g] = _mm256_setr_epi32(
+        2 * high_word[0], 2 * high_word[0] + 1, 2 * high_word[1],
+        2 * high_word[1] + 1, 2 * high_word[2], 2 * high_word[2] + 1,
+        2 * high_word[3], 2 * high_word[3] + 1);
+    low_shifts[g] = _mm256_setr_epi64x(low_shift[0], low_shift[1],
+                                       low_shift[2], low_shift[3]);
+    high_shifts[g] = _mm256_setr_epi64x(high_shift[0], high_shift[1],
+                                        high_shift[2], high_shift[3]);
+  }
+
+  const __m256i mask = _mm256_set1_epi64x(~uint64_t(0) >> (64 - nbits));
+  const __m256i base = _mm256_set1_epi64x(origin);
+
+  // Each block writes up to three values past its end, which the next block
+  // overwrites.  Blocks near the end of the output go through a buffer.
+  uint64_t buffer[128 + 3];
+
+  while (count > 0) {
+    uint64_t* o = (count >= groups * 4) ? output : buffer;
+
+    const __m256i block = _mm256_inserti128_si256(
+        _mm256_setzero_si256(),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin)), 0);
+    begin += kBlockSize;
+
+    for (size_t g = 0; g < groups; ++g) {
+      const __m256i low = _mm256_permutevar8x32_epi32(block, low_words[g]);
+      const __m256i high = _mm256_permutevar8x32_epi32(block, high_words[g]);
+      __m256i value = _mm256_or_si256(_mm256_srlv_epi64(low, low_shifts[g]),
+                                      _mm256_sllv_epi64(high, high_shifts[g]));
+      value = _mm256_add_epi64(_mm256_and_si256(value, mask), base);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + g * 4), value);
+    }
+
+    const auto n = std::min(capacity, count);
+    if (o == buffer) std::copy(buffer, buffer + n, output);
+    output += n;
+    count -= n;
+  }
+}
+
+// Shuffle for DecodeVarintsSSE41, selected by the continuation bits of eight
+// input bytes.  It gathers each leading one- or two-byte varint into a 16-bit
+// lane, low byte first.
+struct VarintShuffle {
+  uint8_t shuffle[16];
+  // Number of varints gathered, and the input bytes they take.
+  uint8_t count;
+  uint8_t length;
+};
+
+std::array<VarintShuffle, 256> MakeVarintShuffles() {
+  std::array<VarintShuffle, 256> result;
+  for (unsigned mask = 0; mask < 256; ++mask) {
+    auto& entry = result[mask];
+    // Indexes with the high bit set make the shuffle store zero.
+    std::fill(std::begin(entry.shuffle), std::end(entry.shuffle), 0x80);
+    unsigned count = 0, pos = 0;
+    while (pos < 8) {
+      if (!(mask & (1 << pos))) {
+        entry.shuffle[2 * count++] = pos;
+        pos += 1;
+      } else if (pos + 1 < 8 && !(mask & (1 << (pos + 1)))) {
+        entry.shuffle[2 * count] = pos;
+        entry.shuffle[2 * count++ + 1] = pos + 1;
+        pos += 2;
+      } else {
+        break;
+      }
+    }
+    entry.count = count;
+    entry.length = pos;
+  }
+  return result;
+}
+
+// Decodes LEB128 varints.  Sixteen input bytes are inspected at a time.
+// When none of the first eight has its continuation bit set, they are
+// widened to eight values at once.  Otherwise the one- and two-byte values
+// among them, up to the first longer value, are gathered into 16-bit lanes
+// with a shuffle chosen by their continuation bits, have their continuation
+// bits masked off, and are widened.  A value of three or more bytes in
+// front is decoded by oroch.
+__attribute__((target("sse4.1"))) void DecodeVarintsSSE41(
+    uint64_t* output, size_t count, const uint8_t*& begin,
+    const uint8_t* end) {
+  static const std::array<VarintShuffle, 256> shuffles = MakeVarintShuffles();
+
+  const __m128i low_mask = _mm_set1_epi16(0x007f);
+  const __m128i high_mask = _mm_set1_epi16(0x7f00);
+
+  size_t i = 0;
+
+  while (count - i >= 8 && end - begin >= 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    const unsigned continuation = _mm_movemask_epi8(bytes) & 0xff;
+    auto o = reinterpret_cast<__m128i*>(output + i);
+
+    if (!continuation) {
+      _mm_storeu_si128(o, _mm_cvtepu8_epi64(bytes));
+      _mm_storeu_si128(o + 1, _mm_cvtepu8_epi64(_mm_srli_si128(bytes, 2)));
+      _mm_storeu_si128(o + 2, _mm_cvtepu8_epi64(_mm_srli_si128(bytes, 4)));
+      _mm_storeu_si128(o + 3, _mm_cvtepu8_epi64(_mm_srli_si128(bytes, 6)));
+      i += 8;
+      begin += 8;
+      continue;
+    }
+
+    const VarintShuffle& entry = shuffles[continuation];
+    if (!entry.count) {
+      output[i++] = oroch::varint_codec<uint64_t>::value_decode(begin);
+      continue;
+    }
+
+    // All eight lanes are stored, and those past `count' overwritten later.
+    const __m128i lanes = _mm_shuffle_epi8(
+        bytes, _mm_loadu_si128(
+                   reinterpret_cast<const __m128i*>(entry.shuffle)));
+    const __m128i values =
+        _mm_or_si128(_mm_and_si128(lanes, low_mask),
+                     _mm_srli_epi16(_mm_and_si128(lanes, high_mask), 1));
+    _mm_storeu_si128(o, _mm_cvtepu16_epi64(values));
+    _mm_storeu_si128(o + 1, _mm_cvtepu16_epi64(_mm_srli_si128(values, 4)));
+    _mm_storeu_si128(o + 2, _mm_cvtepu16_epi64(_mm_srli_si128(values, 8)));
+    _mm_storeu_si128(o + 3, _mm_cvtepu16_epi64(_mm_srli_si128(values, 12)));
+    i += entry.count;
+    begin += entry.length;
+  }
+
+  for (; i < count; ++i)
+    output[i] = oroch::varint_codec<uint64_t>::value_decode(begin);
+}
+
+__attribute__((target("avx2"))) void PrefixSumAVX2(uint64_t* values,
+                                                   size_t count,
+                                                   uint64_t base) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sum = _mm256_set1_epi64x(base);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    auto p = reinterpret_cast<__m256i*>(values + i);
+    __m256i x = _mm256_loadu_si256(p);
+    // Add each lane to the lanes after it: first shifted by one lane, then
+    // by two.
+    x = _mm256_add_epi64(
+        x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x90), zero, 0x03));
+    x = _mm256_add_epi64(
+        x, _mm256_blend_epi32(_mm256_permute4x64_epi64(x, 0x40), zero, 0x0f));
+    x = _mm256_add_epi64(x, sum);
+    _mm256_storeu_si256(p, x);
+    sum = _mm256_permute4x64_epi64(x, 0xff);
+  }
+
+  base = i ? values[i - 1] : base;
+  for (; i < count; ++i) {
+    base += values[i];
+    values[i] = base;
+  }
+}
+
+#endif  // CA_TABLE_X86_KERNELS
+
+void UnpackBits(uint64_t* output, size_t count, const uint8_t*& begin,
+                size_t nbits, uint64_t origin, DecodeKernel kernel) {
+  KJ_REQUIRE(nbits > 0 && nbits <= 64, nbits);
+
+#if CA_TABLE_X86_KERNELS
+  if (kernel == kDecodeKernelAVX2 && count >= kMinVectorUnpackCount) {
+    UnpackBitsAVX2(output, count, begin, nbits, origin);
+    return;
+  }
+#endif
+
+  UnpackBitsScalar(output, count, begin, nbits, origin);
+}
+
+// Decodes the outlier indexes or values of a bitpfr sequence.
+template <typename T>
+void DecodeOutliers(std::vector<T>& output, const uint8_t*& begin,
+                    const oroch::detail::encoding_descriptor<T>& desc) {
+  if (desc.encoding == oroch::encoding_t::bitpck)
+    oroch::bitpck_codec<T>::decode(output.begin(), output.end(), begin,
+                                   desc.nbits);
+  else
+    oroch::varint_codec<T>::decode(output.begin(), output.end(), begin);
+}
+
+void SkipVarints(size_t count, const uint8_t*& begin) {
+  while (count--) {
+    while (*begin++ & 0x80) {
+    }
+  }
+}
+
+// Skips a sequence written with one of the basic oroch encodings.
+template <typename T>
+void SkipBasic(size_t count, const uint8_t*& begin,
+               const oroch::detail::encoding_descriptor<T>& desc) {
+  switch (desc.encoding) {
+    case oroch::encoding_t::naught:
+      break;
+
+    case oroch::encoding_t::normal:
+      begin += oroch::normal_codec<T>::space(count);
+      break;
+
+    case oroch::encoding_t::varint:
+    case oroch::encoding_t::varfor:
+      SkipVarints(count, begin);
+      break;
+
+    case oroch::encoding_t::bitpck:
+    case oroch::encoding_t::bitfor:
+    case oroch::encoding_t::bitpfr:
+      KJ_REQUIRE(desc.nbits > 0 && desc.nbits <= 64, desc.nbits);
+      begin += oroch::bitpck_codec<T>::space(count, desc.nbits);
+      break;
+
+    default:
+      KJ_FAIL_REQUIRE("unknown oroch encoding", desc.encoding);
+  }
+}
+
+}  // namespace
+
+DecodeKernel BestDecodeKernel() {
+  static const DecodeKernel kernel = [] {
+    if (DecodeKernelSupported(kDecodeKernelAVX2)) return kDecodeKernelAVX2;
+    if (DecodeKernelSupported(kDecodeKernelSSE41)) return kDecodeKernelSSE41;
+    return kDecodeKernelScalar;
+  }();
+  return kernel;
+}
+
+bool DecodeKernelSupported(DecodeKernel kernel) {
+  switch (kernel) {
+    case kDecodeKernelScalar:
+      return true;
+
+#if CA_TABLE_X86_KERNELS
+    case kDecodeKernelSSE41:
+      return __builtin_cpu_supports("sse4.1");
+
+    case kDecodeKernelAVX2:
+      return __builtin_cpu_supports("sse4.1") &&
+             __builtin_cpu_supports("avx2");
+#endif
+
+    default:
+      return false;
+  }
+}
+
+void DecodeUInt64s(uint64_t* output, size_t count, const uint8_t*& begin,
+                   const uint8_t* end, DecodeKernel kernel,
+                   CodecContext* context) {
+  Metadata meta;
+  meta.decode(begin);
+
+  const auto& desc = meta.value_desc;
+
+  switch (desc.encoding) {
+    case oroch::encoding_t::bitpck:
+      UnpackBits(output, count, begin, desc.nbits, 0, kernel);
+      break;
+
+    case oroch::encoding_t::bitfor:
+      UnpackBits(output, count, begin, desc.nbits, desc.origin, kernel);
+      break;
+
+    case oroch::encoding_t::bitpfr: {
+      UnpackBits(output, count, begin, desc.nbits, desc.origin, kernel);
+
+      // Patch in the high bits of the outliers, as in
+      // oroch::bitpfr_codec::decode_patch().
+      CodecContext local_context;
+      if (!context) context = &local_context;
+      auto& indexes = context->outlier_indexes;
+      auto& high_bits = context->outlier_high_bits;
+      indexes.resize(meta.noutliers);
+      high_bits.resize(meta.noutliers);
+      DecodeOutliers(indexes, begin, meta.outlier_index_desc);
+      DecodeOutliers(high_bits, begin, meta.outlier_value_desc);
+
+      size_t index = 0;
+      for (size_t i = 0; i < indexes.size(); ++i) {
+        index += indexes[i];
+        KJ_REQUIRE(index < count, index, count);
+        output[index] = ((output[index] - desc.origin) |
+                         (high_bits[i] << desc.nbits)) +
+                        desc.origin;
+        ++index;
+      }
+    } break;
+
+    case oroch::encoding_t::varint:
+#if CA_TABLE_X86_KERNELS
+      if (kernel != kDecodeKernelScalar) {
+        DecodeVarintsSSE41(output, count, begin, end);
+        break;
+      }
+#endif
+      oroch::integer_codec<uint64_t>::decode(output, output + count, begin,
+                                             meta);
+      break;
+
+    default:
+      oroch::integer_codec<uint64_t>::decode(output, output + count, begin,
+                                             meta);
+  }
+}
+
+void SkipInt64s(size_t count, const uint8_t*& begin) {
+  oroch::integer_codec<int64_t>::metadata meta;
+  meta.decode(begin);
+
+  SkipBasic(count, begin, meta.value_desc);
+
+  if (meta.value_desc.encoding == oroch::encoding_t::bitpfr) {
+    SkipBasic(meta.noutliers, begin, meta.outlier_index_desc);
+    SkipBasic(meta.noutliers, begin, meta.outlier_value_desc);
+  }
+}
+
+void PrefixSum(uint64_t* values, size_t count, uint64_t base,
+               DecodeKernel kernel) {
+#if CA_TABLE_X86_KERNELS
+  if (kernel == kDecodeKernelAVX2) {
+    PrefixSumAVX2(values, count, base);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < count; ++i) {
+    base += values[i];
+    values[i] = base;
+  }
+}
+
+}  // namespace internal
+}  // namespace table
+}  // namespace cantera
@@ -0,0 +1,60 @@
+#ifndef STORAGE_CA_TABLE_INTEGER_DECODE_H_
+#define STORAGE_CA_TABLE_INTEGER_DECODE_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cantera {
+namespace table {
+
+struct CodecContext;
+
+namespace internal {
+
+// Instruction sets the integer decoding kernels can be built for.  Every
+// kernel produces the same output as the scalar oroch codecs.
+enum DecodeKernel {
+  kDecodeKernelScalar,
+  kDecodeKernelSSE41,
+  kDecodeKernelAVX2,
+};
+
+// Returns the fastest kernel supported by the running CPU.
+DecodeKernel BestDecodeKernel();
+
+// Returns true if `kernel' can run on this CPU.
+bool DecodeKernelSupported(DecodeKernel kernel);
+
+// Decodes `count' values written by oroch::integer_codec<uint64_t>::encode,
+// starting with their metadata, into `output'.  Bit-packed and varint
+// encodings are decoded with `kernel'; other encodings are passed to oroch.
+// Scratch space comes from `context' if it is not null.
+void DecodeUInt64s(uint64_t* output, size_t count, const uint8_t*& begin,
+                   const uint8_t* end, DecodeKernel kernel,
+                   CodecContext* context = nullptr);
+
+inline void DecodeUInt64s(uint64_t* output, size_t count,
+                          const uint8_t*& begin, const uint8_t* end,
+                          CodecContext* context = nullptr) {
+  DecodeUInt64s(output, count, begin, end, BestDecodeKernel(), context);
+}
+
+// Advances `begin' past `count' values written by
+// oroch::integer_codec<int64_t>::encode, starting with their metadata,
+// without decoding them.
+void SkipInt64s(size_t count, const uint8_t*& begin);
+
+// Replaces each value with the sum of `base' and all values up to and
+// including itself, wrapping around on overflow.
+void PrefixSum(uint64_t* values, size_t count, uint64_t base,
+               DecodeKernel kernel);
+
+inline void PrefixSum(uint64_t* values, size_t count, uint64_t base) {
+  PrefixSum(values, count, base, BestDecodeKernel());
+}
+
+}  // namespace internal
+}  // namespace table
+}  // namespace cantera
+
+#endif  // !STORAGE_CA_TABLE_INTEGER_DECODE_H_
@@ -0,0 +1,329 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "src/offset-bitmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include <kj/debug.h>
+
+#include "third_party/oroch/oroch/integer_codec.h"
+
+namespace cantera {
+namespace table {
+
+namespace {
+
+using SizeCodec = oroch::varint_codec<size_t>;
+using OffsetCodec = oroch::varint_codec<uint64_t>;
+
+const size_t kBitmapBytes = 65536 / 8;
+
+}  // namespace
+
+const size_t OffsetBitmap::kMaxArraySize;
+const size_t OffsetBitmap::kBitmapWords;
+
+void OffsetBitmap::Container::Normalize() {
+  if (IsBitmap()) {
+    cardinality = 0;
+    for (const auto word : bitmap) cardinality += __builtin_popcountll(word);
+    if (cardinality > kMaxArraySize) return;
+
+    array.clear();
+    array.reserve(cardinality);
+    for (size_t i = 0; i < kBitmapWords; ++i) {
+      for (auto word = bitmap[i]; word; word &= word - 1)
+        array.emplace_back((i << 6) | __builtin_ctzll(word));
+    }
+    std::vector<uint64_t>().swap(bitmap);
+  } else {
+    cardinality = array.size();
+    if (cardinality <= kMaxArraySize) return;
+
+    bitmap.assign(kBitmapWords, 0);
+    for (const auto low : array) bitmap[low >> 6] |= uint64_t(1) << (low & 63);
+    std::vector<uint16_t>().swap(array);
+  }
+}
+
+size_t OffsetBitmap::Count() const {
+  size_t result = 0;
+  for (const auto& container : containers_) result += container.cardinality;
+  return result;
+}
+
+bool OffsetBitmap::Contains(uint64_t offset) const {
+  const auto key = offset >> 16;
+  const auto low = static_cast<uint16_t>(offset);
+
+  const auto container = std::lower_bound(
+      containers_.begin(), containers_.end(), key,
+      [](const Container& lhs, uint64_t key) { return lhs.key < key; });
+  if (container == containers_.end() || container->key != key) return false;
+
+  if (container->IsBitmap())
+    return (container->bitmap[low >> 6] >> (low & 63)) & 1;
+
+  return std::binary_search(container->array.begin(), container->array.end(),
+                            low);
+}
+
+void OffsetBitmap::IntersectWith(const OffsetBitmap& rhs) {
+  std::vector<Container> result;
+
+  auto r = rhs.containers_.begin();
+  for (auto& lhs : containers_) {
+    while (r != rhs.containers_.end() && r->key < lhs.key) ++r;
+    if (r == rhs.containers_.end()) break;
+    if (r->key != lhs.key) continue;
+
+    if (lhs.IsBitmap() && r->IsBitmap()) {
+      for (size_t i = 0; i < kBitmapWords; ++i) lhs.bitmap[i] &= r->bitmap[i];
+    } else if (lhs.IsBitmap()) {
+      std::vector<uint16_t> array;
+      for (const auto low : r->array) {
+        if ((lhs.bitmap[low >> 6] >> (low & 63)) & 1) array.emplace_back(low);
+      }
+      std::vector<uint64_t>().swap(lhs.bitmap);
+      lhs.array.swap(array);
+    } else if (r->IsBitmap()) {
+      lhs.array.erase(
+          std::remove_if(lhs.array.begin(), lhs.array.end(),
+                         [&bitmap = r->bitmap](uint16_t low) {
+                           return !((bitmap[low >> 6] >> (low & 63)) & 1);
+                         }),
+          lhs.array.end());
+    } else {
+      lhs.array.erase(
+          std::set_intersection(lhs.array.begin(), lhs.array.end(),
+                                r->array.begin(), r->array.end(),
+                                lhs.array.begin()),
+          lhs.array.end());
+    }
+
+    lhs.Normalize();
+    if (lhs.cardinality) result.emplace_back(std::move(lhs));
+  }
+
+  containers_.swap(result);
+}
+
+void OffsetBitmap::UnionWith(const OffsetBitmap& rhs) {
+  std::vector<Container> result;
+  result.reserve(containers_.size() + rhs.containers_.size());
+
+  auto l = containers_.begin();
+  auto r = rhs.containers_.begin();
+  while (l != containers_.end() || r != rhs.containers_.end()) {
+    if (r == rhs.containers_.end() ||
+        (l != containers_.end() && l->key < r->key)) {
+      result.emplace_back(std::move(*l++));
+      continue;
+    }
+
+    if (l == containers_.end() || r->key < l->key) {
+      result.emplace_back(*r++);
+      continue;
+    }
+
+    auto& lhs = *l;
+    if (!lhs.IsBitmap() && r->IsBitmap()) {
+      std::vector<uint16_t> array;
+      array.swap(lhs.array);
+      lhs.bitmap = r->bitmap;
+      for (const auto low : array)
+        lhs.bitmap[low >> 6] |= uint64_t(1) << (low & 63);
+    } else if (lhs.IsBitmap() && r->IsBitmap()) {
+      for (size_t i = 0; i < kBitmapWords; ++i) lhs.bitmap[i] |= r->bitmap[i];
+    } else if (lhs.IsBitmap()) {
+      for (const auto low : r->array)
+        lhs.bitmap[low >> 6] |= uint64_t(1) << (low & 63);
+    } else {
+      std::vector<uint16_t> array;
+      array.reserve(lhs.array.size() + r->array.size());
+      std::set_union(lhs.array.begin(), lhs.array.end(), r->array.begin(),
+                     r->array.end(), std::back_inserter(array));
+      lhs.array.swap(array);
+    }
+
+    lhs.Normalize();
+    result.emplace_back(std::move(lhs));
+    ++l;
+    ++r;
+  }
+
+  containers_.swap(result);
+}
+
+void OffsetBitmap::Subtract(const OffsetBitmap& rhs) {
+  std::vector<Container> result;
+
+  auto r = rhs.containers_.begin();
+  for (auto& lhs : containers_) {
+    while (r != rhs.containers_.end() && r->key < lhs.key) ++r;
+    if (r == rhs.containers_.end() || r->key != lhs.key) {
+      result.emplace_back(std::move(lhs));
+      continue;
+    }
+
+    if (lhs.IsBitmap() && r->IsBitmap()) {
+      for (size_t i = 0; i < kBitmapWords; ++i) lhs.bitmap[i] &= ~r->bitmap[i];
+    } else if (lhs.IsBitmap()) {
+      for (const auto low : r->array)
+        lhs.bitmap[low >> 6] &= ~(uint64_t(1) << (low & 63));
+    } else if (r->IsBitmap()) {
+      lhs.array.erase(
+          std::remove_if(lhs.array.begin(), lhs.array.end(),
+                         [&bitmap = r->bitmap](uint16_t low) {
+                           return (bitmap[low >> 6] >> (low & 63)) & 1;
+                         }),
+          lhs.array.end());
+    } else {
+      lhs.array.erase(
+          std::set_difference(lhs.array.begin(), lhs.array.end(),
+                              r->array.begin(), r->array.end(),
+                              lhs.array.begin()),
+          lhs.array.end());
+    }
+
+    lhs.Normalize();
+    if (lhs.cardinality) result.emplace_back(std::move(lhs));
+  }
+
+  containers_.swap(result);
+}
+
+size_t OffsetBitmap::Filter(OffsetScore* values, size_t count,
+                            bool keep_members) const {
+  auto container = containers_.begin();
+  size_t result = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto key = values[i].offset >> 16;
+    const auto low = static_cast<uint16_t>(values[i].offset);
+
+    while (container != containers_.end() && container->key < key)
+      ++container;
+
+    bool member = false;
+    if (container != containers_.end() && container->key == key) {
+      if (container->IsBitmap())
+        member = (container->bitmap[low >> 6] >> (low & 63)) & 1;
+      else
+        member = std::binary_search(container->array.begin(),
+                                    container->array.end(), low);
+    }
+
+    if (member == keep_members) values[result++] = values[i];
+  }
+
+  return result;
+}
+
+size_t OffsetBitmap::EncodedSize() const {
+  size_t result = SizeCodec::value_space(containers_.size());
+  uint64_t prev_key = 0;
+
+  for (const auto& container : containers_) {
+    result += OffsetCodec::value_space(container.key - prev_key);
+    result += SizeCodec::value_space(container.cardinality - 1);
+    result += container.IsBitmap() ? kBitmapBytes
+                                   : container.cardinality * sizeof(uint16_t);
+    prev_key = container.key;
+  }
+
+  return result;
+}
+
+void OffsetBitmap::Encode(uint8_t*& output) const {
+  SizeCodec::value_encode(output, containers_.size());
+  uint64_t prev_key = 0;
+
+  for (const auto& container : containers_) {
+    OffsetCodec::value_encode(output, container.key - prev_key);
+    SizeCodec::value_encode(output, container.cardinality - 1);
+    prev_key = container.key;
+
+    if (container.IsBitmap()) {
+      memcpy(output, container.bitmap.data(), kBitmapBytes);
+      output += kBitmapBytes;
+    } else {
+      memcpy(output, container.array.data(),
+             container.cardinality * sizeof(uint16_t));
+      output += container.cardinality * sizeof(uint16_t);
+    }
+  }
+}
+
+void OffsetBitmap::Decode(const uint8_t*& begin, const uint8_t* end) {
+  containers_.clear();
+  containers_.resize(SizeCodec::value_decode(begin));
+
+  uint64_t key = 0;
+  for (auto& container : containers_) {
+    key += OffsetCodec::value_decode(begin);
+    container.key = key;
+    container.cardinality = SizeCodec::value_decode(begin) + 1;
+    KJ_REQUIRE(container.cardinality <= 65536, container.cardinality);
+
+    if (container.cardinality > kMaxArraySize) {
+      KJ_REQUIRE(begin <= end && kBitmapBytes <= size_t(end - begin),
+                 "truncated offset bitmap");
+      container.bitmap.resize(kBitmapWords);
+      memcpy(container.bitmap.data(), begin, kBitmapBytes);
+      begin += kBitmapBytes;
+    } else {
+      const auto size = container.cardinality * sizeof(uint16_t);
+      KJ_REQUIRE(begin <= end && size <= size_t(end - begin),
+                 "truncated offset bitmap");
+      container.array.resize(container.cardinality);
+      memcpy(container.array.data(), begin, size);
+      begin += size;
+    }
+  }
+}
+
+size_t OffsetBitmap::Skip(const uint8_t*& begin, const uint8_t* end,
+                          uint64_t* max_offset) {
+  const auto container_count = SizeCodec::value_decode(begin);
+  size_t result = 0;
+
+  uint64_t key = 0;
+  for (size_t i = 0; i < container_count; ++i) {
+    key += OffsetCodec::value_decode(begin);
+    const auto cardinality = SizeCodec::value_decode(begin) + 1;
+    const auto size = (cardinality > kMaxArraySize)
+                          ? kBitmapBytes
+                          : cardinality * sizeof(uint16_t);
+    KJ_REQUIRE(begin <= end && size <= size_t(end - begin),
+               "truncated offset bitmap");
+    result += cardinality;
+
+    if (max_offset && i + 1 == container_count) {
+      uint16_t low = 0;
+      if (cardinality > kMaxArraySize) {
+        for (size_t j = kBitmapWords; j-- > 0;) {
+          uint64_t word;
+          memcpy(&word, begin + j * sizeof(word), sizeof(word));
+          if (!word) continue;
+          low = (j << 6) | (63 - __builtin_clzll(word));
+          break;
+        }
+      } else {
+        memcpy(&low, begin + size - sizeof(low), sizeof(low));
+      }
+      *max_offset = (key << 16) | low;
+    }
+
+    begin += size;
+  }
+
+  return result;
+}
+
+}  // namespace table
+}  // namespace cantera
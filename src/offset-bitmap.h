@@ -0,0 +1,150 @@
+#ifndef STORAGE_CA_TABLE_OFFSET_BITMAP_H_
+#define STORAGE_CA_TABLE_OFFSET_BITMAP_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "src/ca-table.h"
+
+namespace cantera {
+namespace table {
+
+// A set of offsets, stored as in Roaring bitmaps: offsets are grouped by
+// their upper 48 bits, and the lower 16 bits of each group are kept either
+// as a sorted array or, for groups of more than 4096 offsets, as a bitmap.
+// Set operations on two bitmaps combine groups a word at a time.
+class OffsetBitmap {
+ public:
+  OffsetBitmap() = default;
+
+  // Builds a set from offsets in ascending order.  Duplicates are allowed.
+  template <typename T>
+  static OffsetBitmap FromOffsets(const T* values, size_t count);
+
+  bool Empty() const { return containers_.empty(); }
+
+  // Returns the number of offsets in the set.
+  size_t Count() const;
+
+  bool Contains(uint64_t offset) const;
+
+  void IntersectWith(const OffsetBitmap& rhs);
+
+  void UnionWith(const OffsetBitmap& rhs);
+
+  void Subtract(const OffsetBitmap& rhs);
+
+  // Moves the elements of `values', which must be sorted by offset, whose
+  // offsets are members of the set if `keep_members' is true, or not members
+  // otherwise, to the front.  Returns the number of elements moved.
+  size_t Filter(OffsetScore* values, size_t count, bool keep_members) const;
+
+  // Appends the offsets of the set to `output' in ascending order, each with
+  // the score `score'.
+  template <typename T>
+  void AppendTo(std::vector<T>* output, float score) const;
+
+  // Returns the number of bytes written by Encode().
+  size_t EncodedSize() const;
+
+  // Writes the groups of the set, as stored in CA_OFFSET_SCORE_BITMAP lists.
+  void Encode(uint8_t*& output) const;
+
+  // Replaces the contents of the set with a set written by Encode().
+  void Decode(const uint8_t*& begin, const uint8_t* end);
+
+  // Advances `begin' past a set written by Encode(), and returns the number
+  // of offsets in it.  If `max_offset' is not null, the largest offset in the
+  // set is stored there.
+  static size_t Skip(const uint8_t*& begin, const uint8_t* end,
+                     uint64_t* max_offset = nullptr);
+
+ private:
+  // Groups with more offsets than this are stored as bitmaps.
+  static const size_t kMaxArraySize = 4096;
+
+  static const size_t kBitmapWords = 65536 / 64;
+
+  struct Container {
+    // Upper 48 bits of the offsets in the group.
+    uint64_t key = 0;
+
+    size_t cardinality = 0;
+
+    // Lower 16 bits of the offsets, if `cardinality' is at most
+    // kMaxArraySize.
+    std::vector<uint16_t> array;
+
+    // Otherwise, kBitmapWords words with one bit per offset.
+    std::vector<uint64_t> bitmap;
+
+    bool IsBitmap() const { return !bitmap.empty(); }
+
+    // Converts between the array and bitmap forms as needed after the
+    // contents have changed, and updates `cardinality'.
+    void Normalize();
+  };
+
+  template <typename Function>
+  void ForEach(Function&& function) const;
+
+  std::vector<Container> containers_;
+};
+
+template <typename T>
+OffsetBitmap OffsetBitmap::FromOffsets(const T* values, size_t count) {
+  OffsetBitmap result;
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto key = values[i].offset >> 16;
+    const auto low = static_cast<uint16_t>(values[i].offset);
+
+    if (result.containers_.empty() || result.containers_.back().key != key) {
+      result.containers_.emplace_back();
+      result.containers_.back().key = key;
+    }
+
+    auto& array = result.containers_.back().array;
+    if (array.empty() || array.back() != low) array.emplace_back(low);
+  }
+
+  for (auto& container : result.containers_) container.Normalize();
+
+  return result;
+}
+
+template <typename Function>
+void OffsetBitmap::ForEach(Function&& function) const {
+  for (const auto& container : containers_) {
+    const auto base = container.key << 16;
+
+    if (!container.IsBitmap()) {
+      for (const auto low : container.array) function(base | low);
+      continue;
+    }
+
+    for (size_t i = 0; i < kBitmapWords; ++i) {
+      for (auto word = container.bitmap[i]; word; word &= word - 1)
+        function(base | (i << 6) | __builtin_ctzll(word));
+    }
+  }
+}
+
+template <typename T>
+void OffsetBitmap::AppendTo(std::vector<T>* output, float score) const {
+  output->reserve(output->size() + Count());
+  ForEach([output, score](uint64_t offset) {
+    output->emplace_back(offset, score);
+  });
+}
+
+// If every list in `input' is stored as CA_OFFSET_SCORE_BITMAP, stores the
+// union of their offsets in `output' and returns true.  Otherwise returns
+// false, and leaves `output' in an unspecified state.
+bool ca_offset_score_parse_bitmap(string_view input, OffsetBitmap* output);
+
+}  // namespace table
+}  // namespace cantera
+
+#endif  // !STORAGE_CA_TABLE_OFFSET_BITMAP_H_
@@ -24,21 +24,36 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
+#include <exception>
+#include <mutex>
+
 #include <err.h>
 #include <sysexits.h>
 
 #include <kj/debug.h>
 
 #include "src/ca-table.h"
+#include "src/integer-decode.h"
+#include "src/offset-bitmap.h"
 #include "src/rle.h"
 
+#include "third_party/evenk/evenk/synch_queue.h"
+#include "third_party/evenk/evenk/thread_pool.h"
 #include "third_party/oroch/oroch/integer_codec.h"
 
+template <typename T>
+using thread_pool_queue = evenk::synch_queue<T>;
+
 namespace cantera {
 namespace table {
 
 namespace {
 
+// Smallest number of values decoded by one thread pool task.  Smaller tasks
+// would not pay for starting threads.
+const size_t kMinParallelParseValues = 1 << 16;
+
 void InitRLE(struct CA_rle_context* ctx, const uint8_t* input) {
   ctx->data = (uint8_t*)input;
   ctx->run = 0;
@@ -86,8 +101,9 @@ const char* ca_parse_string(const uint8_t** input) {
   return result;
 }
 
+template <typename T>
 void ParseOffsetScoreFlexi(const uint8_t*& begin, const uint8_t* end,
-                           std::vector<ca_offset_score>* output) {
+                           std::vector<T>* output, bool decode_scores) {
   auto base_index = output->size();
   auto count = ca_parse_integer(&begin);
 
@@ -159,6 +175,13 @@ void ParseOffsetScoreFlexi(const uint8_t*& begin, const uint8_t* end,
 
   parse_score_count = (0 != (score_flags & 0x80)) ? 1 : count;
 
+  if (!decode_scores) {
+    // Scores take 4, 1, 2 or 3 bytes each.
+    const size_t score_size = (score_flags & 0x03) ? (score_flags & 0x03) : 4;
+    begin += parse_score_count * score_size;
+    return;
+  }
+
   switch (score_flags & 0x03) {
     case 0x00:
       for (i = 0; i < parse_score_count; ++i) {
@@ -263,9 +286,91 @@ size_t CountOffsetScoreFlexi(const uint8_t*& begin, const uint8_t* end) {
   return count;
 }
 
+// Reads bits from a byte stream, most significant bit first.
+class BitReader {
+ public:
+  BitReader(const uint8_t* begin, const uint8_t* end)
+      : begin_(begin), end_(end) {}
+
+  // Reads `bits' bits, at most 32.
+  uint32_t Get(unsigned int bits) {
+    if (!bits) return 0;
+    if (fill_ < bits) {
+      while (fill_ <= 56 && begin_ != end_) {
+        buffer_ = (buffer_ << 8) | *begin_++;
+        fill_ += 8;
+      }
+      KJ_REQUIRE(fill_ >= bits, "truncated score stream");
+    }
+    fill_ -= bits;
+    return (buffer_ >> fill_) & (~uint64_t(0) >> (64 - bits));
+  }
+
+ private:
+  const uint8_t* begin_;
+  const uint8_t* end_;
+  uint64_t buffer_ = 0;
+  unsigned int fill_ = 0;
+};
+
+// Decodes the scores of a CA_OFFSET_SCORE_DELTA_OROCH_XOR list, as written by
+// EncodeScoresXOR() in format.cc.
+template <typename T>
+void DecodeScoresXOR(T* values, size_t count, const uint8_t*& begin,
+                     const uint8_t* end) {
+  size_t size = 0;
+  oroch::varint_codec<size_t>::value_decode(size, begin);
+  KJ_REQUIRE(begin <= end && size <= size_t(end - begin),
+             "truncated score stream");
+
+  BitReader reader(begin, begin + size);
+  begin += size;
+
+  uint32_t bits = reader.Get(32);
+  memcpy(&values[0].score, &bits, sizeof(bits));
+
+  unsigned int window_leading = 0, window_bits = 0;
+
+  for (size_t i = 1; i < count; ++i) {
+    if (reader.Get(1)) {
+      if (reader.Get(1)) {
+        window_leading = reader.Get(5);
+        window_bits = reader.Get(5) + 1;
+        KJ_REQUIRE(window_leading + window_bits <= 32, "corrupt score stream");
+      } else {
+        KJ_REQUIRE(window_bits > 0, "corrupt score stream");
+      }
+      bits ^= reader.Get(window_bits)
+              << (32 - window_leading - window_bits);
+    }
+    memcpy(&values[i].score, &bits, sizeof(bits));
+  }
+}
+
+// Advances `begin' past the `count' scores of a CA_OFFSET_SCORE_DELTA_OROCH_*
+// list of the given type.
+void SkipOrochScores(size_t count, const uint8_t*& begin,
+                     ca_offset_score_type type) {
+  switch (type) {
+    case CA_OFFSET_SCORE_DELTA_OROCH_OROCH:
+      internal::SkipInt64s(count, begin);
+      break;
+
+    case CA_OFFSET_SCORE_DELTA_OROCH_XOR: {
+      size_t size = 0;
+      oroch::varint_codec<size_t>::value_decode(size, begin);
+      begin += size;
+    } break;
+
+    default:
+      begin += count * sizeof(float);
+  }
+}
+
+template <typename T>
 void ParseOffsetScoreOroch(const uint8_t*& begin, const uint8_t* end,
-                           std::vector<ca_offset_score>* output,
-                           bool integer_score) {
+                           std::vector<T>* output, ca_offset_score_type type,
+                           bool decode_scores, CodecContext& context) {
   auto base_index = output->size();
 
   // Get the number of encoded offset/score records.
@@ -285,23 +390,23 @@ void ParseOffsetScoreOroch(const uint8_t*& begin, const uint8_t* end,
   values[0].offset = offset;
 
   // Get delta values for offsets.
-  std::vector<uint64_t> offset_delta(count - 1);
-  oroch::integer_codec<uint64_t>::metadata offset_meta;
-  offset_meta.decode(begin);
-  auto offset_i = offset_delta.begin();
-  auto offset_e = offset_delta.end();
-  oroch::integer_codec<uint64_t>::decode(offset_i, offset_e, begin,
-                                         offset_meta);
+  auto& offset_delta = context.offsets;
+  offset_delta.resize(count - 1);
+  internal::DecodeUInt64s(offset_delta.data(), offset_delta.size(), begin,
+                          end, &context);
 
   // Convert delta values to original offset values.
-  for (size_t i = 1; i < count; i++) {
-    offset += offset_delta[i - 1];
-    values[i].offset = offset;
-  }
+  internal::PrefixSum(offset_delta.data(), offset_delta.size(), offset);
+  for (size_t i = 1; i < count; i++) values[i].offset = offset_delta[i - 1];
 
   // Decode score values.
-  if (integer_score) {
-    std::vector<int64_t> score(count);
+  if (!decode_scores) {
+    SkipOrochScores(count, begin, type);
+  } else if (type == CA_OFFSET_SCORE_DELTA_OROCH_XOR) {
+    DecodeScoresXOR(values, count, begin, end);
+  } else if (type == CA_OFFSET_SCORE_DELTA_OROCH_OROCH) {
+    auto& score = context.scores;
+    score.resize(count);
     oroch::integer_codec<int64_t>::metadata score_meta;
     score_meta.decode(begin);
     auto score_i = score.begin();
@@ -319,7 +424,7 @@ void ParseOffsetScoreOroch(const uint8_t*& begin, const uint8_t* end,
 }
 
 uint64_t GetMaxOffsetOroch(const uint8_t*& begin, const uint8_t* end,
-                           bool integer_score) {
+                           ca_offset_score_type type, CodecContext& context) {
   // Get the number of encoded offset/score records.
   size_t count = 0;
   oroch::varint_codec<size_t>::value_decode(count, begin);
@@ -333,35 +438,23 @@ uint64_t GetMaxOffsetOroch(const uint8_t*& begin, const uint8_t* end,
   oroch::varint_codec<uint64_t>::value_decode(offset, begin);
 
   // Get delta values for offsets.
-  std::vector<uint64_t> offset_delta(count - 1);
-  oroch::integer_codec<uint64_t>::metadata offset_meta;
-  offset_meta.decode(begin);
-  auto offset_i = offset_delta.begin();
-  auto offset_e = offset_delta.end();
-  oroch::integer_codec<uint64_t>::decode(offset_i, offset_e, begin,
-                                         offset_meta);
+  auto& offset_delta = context.offsets;
+  offset_delta.resize(count - 1);
+  internal::DecodeUInt64s(offset_delta.data(), offset_delta.size(), begin,
+                          end, &context);
 
-  // Convert delta values to original offset values.
-  for (size_t i = 1; i < count; i++) offset += offset_delta[i - 1];
+  // The last offset is the sum of all deltas.
+  for (const auto delta : offset_delta) offset += delta;
 
   // Skip score values.
-  if (integer_score) {
-    std::vector<int64_t> score(count);
-    oroch::integer_codec<int64_t>::metadata score_meta;
-    score_meta.decode(begin);
-    auto score_i = score.begin();
-    auto score_e = score.end();
-    oroch::integer_codec<int64_t>::decode(score_i, score_e, begin,
-                                          score_meta);
-  } else {
-    begin += count * sizeof(float);
-  }
+  SkipOrochScores(count, begin, type);
 
   return offset;
 }
 
 size_t CountOffsetScoreOroch(const uint8_t*& begin, const uint8_t* end,
-                             bool integer_score) {
+                             ca_offset_score_type type,
+                             CodecContext& context) {
   // Get the number of encoded offset/score records.
   size_t count = 0;
   oroch::varint_codec<size_t>::value_decode(count, begin);
@@ -375,32 +468,20 @@ size_t CountOffsetScoreOroch(const uint8_t*& begin, const uint8_t* end,
   oroch::varint_codec<uint64_t>::value_decode(offset, begin);
 
   // Get delta values for offsets.
-  std::vector<uint64_t> offset_delta(count - 1);
-  oroch::integer_codec<uint64_t>::metadata offset_meta;
-  offset_meta.decode(begin);
-  auto offset_i = offset_delta.begin();
-  auto offset_e = offset_delta.end();
-  oroch::integer_codec<uint64_t>::decode(offset_i, offset_e, begin,
-                                         offset_meta);
+  auto& offset_delta = context.offsets;
+  offset_delta.resize(count - 1);
+  internal::DecodeUInt64s(offset_delta.data(), offset_delta.size(), begin,
+                          end, &context);
 
   // Skip score values.
-  if (integer_score) {
-    std::vector<int64_t> score(count);
-    oroch::integer_codec<int64_t>::metadata score_meta;
-    score_meta.decode(begin);
-    auto score_i = score.begin();
-    auto score_e = score.end();
-    oroch::integer_codec<int64_t>::decode(score_i, score_e, begin, 
-                                          score_meta);
-  } else {
-    begin += count * sizeof(float);
-  }
+  SkipOrochScores(count, begin, type);
 
   return count;
 }
 
 void ParseOffsetScoreWithPrediction(const uint8_t*& begin, const uint8_t* end,
-                                    std::vector<ca_offset_score>* output) {
+                                    std::vector<ca_offset_score>* output,
+                                    CodecContext& context) {
   auto base_index = output->size();
   auto count = ca_parse_integer(&begin);
 
@@ -412,7 +493,9 @@ void ParseOffsetScoreWithPrediction(const uint8_t*& begin, const uint8_t* end,
   output->resize(base_index + count);
   (*output)[base_index].offset = ca_parse_integer(&begin);
 
-  std::vector<uint64_t> steps;
+  // Distinct steps between offsets, if stored.
+  auto& steps = context.offsets;
+  steps.clear();
 
   if (count > 1) {
     auto step_count = ca_parse_integer(&begin);
@@ -444,7 +527,7 @@ void ParseOffsetScoreWithPrediction(const uint8_t*& begin, const uint8_t* end,
     }
   }
 
-  std::vector<uint8_t> prob_mask;
+  auto& prob_mask = context.prob_mask;
   prob_mask.resize((count + 7) / 8);
 
   struct CA_rle_context rle;
@@ -473,22 +556,146 @@ void ParseOffsetScoreWithPrediction(const uint8_t*& begin, const uint8_t* end,
   }
 }
 
+void ParseOffsetScoreQuantized(const uint8_t*& begin, const uint8_t* end,
+                               std::vector<ca_offset_score>* output,
+                               CodecContext& context) {
+  const auto base_index = output->size();
+
+  size_t count = 0;
+  oroch::varint_codec<size_t>::value_decode(count, begin);
+  if (!count) {
+    KJ_REQUIRE(begin == end, "unexpected zero-sized offset/score array");
+    return;
+  }
+
+  output->resize(base_index + count);
+  auto values = &(*output)[base_index];
+
+  uint64_t offset = 0;
+  oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+  values[0].offset = offset;
+
+  auto& offset_delta = context.offsets;
+  offset_delta.resize(count - 1);
+  internal::DecodeUInt64s(offset_delta.data(), offset_delta.size(), begin,
+                          end, &context);
+  internal::PrefixSum(offset_delta.data(), offset_delta.size(), offset);
+  for (size_t i = 1; i < count; ++i) values[i].offset = offset_delta[i - 1];
+
+  DecodeScoresXOR(values, count, begin, end);
+
+  auto& prob_mask = context.prob_mask;
+  prob_mask.resize((count + 7) / 8);
+  size_t band_count = 0;
+
+  struct CA_rle_context rle;
+  InitRLE(&rle, begin);
+  for (auto& b : prob_mask) {
+    b = ReadRLEByte(&rle);
+    band_count += 4 * __builtin_popcount(b);
+  }
+
+  KJ_REQUIRE(rle.run == 0, rle.run);
+  begin = rle.data;
+
+  KJ_REQUIRE(begin <= end && size_t(end - begin) >= sizeof(float) + 1,
+             "truncated offset/score list");
+  float step;
+  memcpy(&step, begin, sizeof(step));
+  begin += sizeof(step);
+
+  const auto band_size = *begin++;
+  KJ_REQUIRE(band_size == 1 || band_size == 2, band_size);
+  KJ_REQUIRE(band_count * band_size <= size_t(end - begin),
+             "truncated offset/score list");
+
+  auto read_band = [&begin, band_size, step](float median) {
+    int32_t band;
+    if (band_size == 1) {
+      band = static_cast<int8_t>(*begin++);
+    } else {
+      band = static_cast<int16_t>(begin[0] | (begin[1] << 8));
+      begin += 2;
+    }
+    return static_cast<float>(median + double(band) * step);
+  };
+
+  for (size_t i = 0; i < count; ++i) {
+    if (0 == (prob_mask[i >> 3] & (1 << (i & 7)))) continue;
+
+    auto& v = values[i];
+    v.score_pct5 = read_band(v.score);
+    v.score_pct25 = read_band(v.score);
+    v.score_pct75 = read_band(v.score);
+    v.score_pct95 = read_band(v.score);
+  }
+}
+
+void ParseOffsetScoreWithPrediction(const uint8_t*& begin, const uint8_t* end,
+                                    std::vector<ca_offset_score>* output,
+                                    ca_offset_score_type type,
+                                    CodecContext& context) {
+  if (type == CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED)
+    ParseOffsetScoreQuantized(begin, end, output, context);
+  else
+    ParseOffsetScoreWithPrediction(begin, end, output, context);
+}
+
+void ParseOffsetScoreWithPrediction(
+    const uint8_t*& begin, const uint8_t* end,
+    std::vector<ca_offset_score>* output,
+    std::vector<OffsetScorePercentiles>*, ca_offset_score_type type,
+    CodecContext& context) {
+  ParseOffsetScoreWithPrediction(begin, end, output, type, context);
+}
+
+// Lists with probability bands are rare, so they are parsed in full and then
+// split into scores and percentiles.
+void ParseOffsetScoreWithPrediction(
+    const uint8_t*& begin, const uint8_t* end, std::vector<OffsetScore>* output,
+    std::vector<OffsetScorePercentiles>* percentiles,
+    ca_offset_score_type type, CodecContext& context) {
+  auto& tmp = context.values;
+  tmp.clear();
+  ParseOffsetScoreWithPrediction(begin, end, &tmp, type, context);
+
+  output->reserve(output->size() + tmp.size());
+  for (const auto& v : tmp) {
+    if (percentiles && v.HasPercentiles()) {
+      percentiles->emplace_back();
+      auto& p = percentiles->back();
+      p.index = output->size();
+      p.score_pct5 = v.score_pct5;
+      p.score_pct25 = v.score_pct25;
+      p.score_pct75 = v.score_pct75;
+      p.score_pct95 = v.score_pct95;
+    }
+    output->emplace_back(v.offset, v.score);
+  }
+}
+
 size_t CountOffsetScoreWithPrediction(const uint8_t*& begin,
-                                      const uint8_t* end) {
-  std::vector<ca_offset_score> tmp;
+                                      const uint8_t* end,
+                                      ca_offset_score_type type,
+                                      CodecContext& context) {
+  auto& tmp = context.values;
+  tmp.clear();
 
-  ParseOffsetScoreWithPrediction(begin, end, &tmp);
+  ParseOffsetScoreWithPrediction(begin, end, &tmp, type, context);
 
   return tmp.size();
 }
 
-uint64_t GetMaxOffsetWithPrediction(const uint8_t*& begin, const uint8_t* end) {
+uint64_t GetMaxOffsetWithPrediction(const uint8_t*& begin, const uint8_t* end,
+                                    CodecContext& context) {
   auto count = ca_parse_integer(&begin);
   KJ_REQUIRE(count > 0);
 
   auto result = ca_parse_integer(&begin);
 
-  std::vector<uint64_t> steps;
+  // Distinct steps between offsets, if stored.
+  auto& steps = context.offsets;
+  steps.clear();
 
   if (count > 1) {
     auto step_count = ca_parse_integer(&begin);
@@ -516,7 +723,7 @@ uint64_t GetMaxOffsetWithPrediction(const uint8_t*& begin, const uint8_t* end) {
     for (size_t i = 1; i < count; ++i) result += ca_parse_integer(&begin);
   }
 
-  std::vector<uint8_t> prob_mask;
+  auto& prob_mask = context.prob_mask;
   prob_mask.resize((count + 7) / 8);
 
   struct CA_rle_context rle;
@@ -535,98 +742,451 @@ uint64_t GetMaxOffsetWithPrediction(const uint8_t*& begin, const uint8_t* end) {
   return result;
 }
 
+// Reads a CA_OFFSET_SCORE_BLOCKED list following its type byte, without
+// decoding its chunks.  Returns the number of values, and leaves `begin' at
+// the end of the list.
+size_t ParseOffsetScoreBlocks(const uint8_t*& begin, const uint8_t* end,
+                              std::vector<OffsetScoreCursor::Chunk>& chunks) {
+  size_t count = 0, block_size = 0;
+  oroch::varint_codec<size_t>::value_decode(count, begin);
+  oroch::varint_codec<size_t>::value_decode(block_size, begin);
+  KJ_REQUIRE(block_size > 0, "invalid offset/score block size");
+  KJ_REQUIRE(begin < end, "truncated offset/score list");
+
+  const uint8_t flags = *begin++;
+
+  chunks.clear();
+  chunks.resize((count + block_size - 1) / block_size);
+
+  size_t data_size = 0;
+  uint64_t offset = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    auto& chunk = chunks[i];
+
+    uint64_t delta = 0, range = 0;
+    size_t size = 0;
+    oroch::varint_codec<uint64_t>::value_decode(delta, begin);
+    oroch::varint_codec<uint64_t>::value_decode(range, begin);
+    oroch::varint_codec<size_t>::value_decode(size, begin);
+
+    chunk.first_offset = offset + delta;
+    chunk.last_offset = chunk.first_offset + range;
+    chunk.count = std::min(block_size, count - i * block_size);
+    offset = chunk.last_offset;
+    data_size += size;
+
+    // The data follows all headers, so only its size is known for now.
+    chunk.data = string_view(nullptr, size);
+
+    if (flags & 1) {
+      memcpy(&chunk.max_score, begin, sizeof(float));
+      begin += sizeof(float);
+    }
+  }
+
+  KJ_REQUIRE(begin <= end && data_size <= size_t(end - begin),
+             "truncated offset/score list");
+
+  for (auto& chunk : chunks) {
+    const auto size = chunk.data.size();
+    chunk.data = string_view(reinterpret_cast<const char*>(begin), size);
+    begin += size;
+  }
+
+  return count;
+}
+
+template <typename T>
+void ParseOffsetScores(string_view input, std::vector<T>* output,
+                       std::vector<OffsetScorePercentiles>* percentiles,
+                       bool decode_scores, CodecContext& context);
+
+// Contents of a CA_OFFSET_SCORE_WITH_SUMMARY header.
+struct OffsetScoreSummary {
+  size_t count = 0;
+  uint64_t first_offset = 0;
+  uint64_t last_offset = 0;
+  string_view data;
+};
+
+// Parses a CA_OFFSET_SCORE_WITH_SUMMARY header, and advances `begin' past the
+// encoded values that follow it.
+OffsetScoreSummary ParseOffsetScoreSummary(const uint8_t*& begin,
+                                           const uint8_t* end) {
+  OffsetScoreSummary result;
+  size_t size = 0;
+  oroch::varint_codec<size_t>::value_decode(result.count, begin);
+  oroch::varint_codec<uint64_t>::value_decode(result.first_offset, begin);
+  oroch::varint_codec<uint64_t>::value_decode(result.last_offset, begin);
+  oroch::varint_codec<size_t>::value_decode(size, begin);
+  KJ_REQUIRE(begin <= end && size <= size_t(end - begin),
+             "truncated offset/score list");
+
+  result.data = string_view(reinterpret_cast<const char*>(begin), size);
+  begin += size;
+
+  return result;
+}
+
+template <typename T>
+void ParseOffsetScoreBlocked(const uint8_t*& begin, const uint8_t* end,
+                             std::vector<T>* output,
+                             std::vector<OffsetScorePercentiles>* percentiles,
+                             bool decode_scores, CodecContext& context) {
+  const auto base_index = output->size();
+
+  // The chunks are parsed with the same context, so take the chunk headers
+  // out of it while they are in use.
+  std::vector<OffsetScoreCursor::Chunk> chunks;
+  chunks.swap(context.chunks);
+  const auto count = ParseOffsetScoreBlocks(begin, end, chunks);
+
+  output->reserve(base_index + count);
+  for (const auto& chunk : chunks)
+    ParseOffsetScores(chunk.data, output, percentiles, decode_scores, context);
+
+  chunks.swap(context.chunks);
+
+  KJ_REQUIRE(output->size() - base_index == count, count);
+}
+
+// Parses one encoded list, starting at its type byte.  If `decode_scores' is
+// false, the scores of the output are left zero.
+template <typename T>
+void ParseOffsetScoreValue(const uint8_t*& begin, const uint8_t* end,
+                           std::vector<T>* output,
+                           std::vector<OffsetScorePercentiles>* percentiles,
+                           bool decode_scores, CodecContext& context) {
+  const auto base_index = output->size();
+  uint64_t offset;
+  float fscore;
+  uint32_t uscore;
+  uint32_t* pscore;
+
+  auto type = static_cast<ca_offset_score_type>(*begin++);
+
+  switch (type) {
+    case CA_OFFSET_SCORE_BLOCKED:
+      ParseOffsetScoreBlocked(begin, end, output, percentiles, decode_scores,
+                              context);
+      return;
+
+    case CA_OFFSET_SCORE_BITMAP: {
+      KJ_REQUIRE(end - begin >= 4, "truncated offset/score list");
+      memcpy(&fscore, begin, sizeof(fscore));
+      begin += sizeof(fscore);
+
+      OffsetBitmap bitmap;
+      bitmap.Decode(begin, end);
+      bitmap.AppendTo(output, decode_scores ? fscore : 0.0f);
+    }
+      return;
+
+    case CA_OFFSET_SCORE_WITH_SUMMARY: {
+      const auto summary = ParseOffsetScoreSummary(begin, end);
+      output->reserve(base_index + summary.count);
+      ParseOffsetScores(summary.data, output, percentiles, decode_scores,
+                        context);
+      KJ_REQUIRE(output->size() - base_index == summary.count, summary.count);
+    }
+      return;
+
+    case CA_OFFSET_SCORE_WITH_PREDICTION:
+    case CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED:
+      ParseOffsetScoreWithPrediction(begin, end, output, percentiles, type,
+                                     context);
+      break;
+
+    case CA_OFFSET_SCORE_FLEXI:
+      ParseOffsetScoreFlexi(begin, end, output, decode_scores);
+      return;
+
+    case CA_OFFSET_SCORE_DELTA_OROCH_FLOAT:
+    case CA_OFFSET_SCORE_DELTA_OROCH_OROCH:
+    case CA_OFFSET_SCORE_DELTA_OROCH_XOR:
+      ParseOffsetScoreOroch(begin, end, output, type, decode_scores, context);
+      return;
+
+    case CA_OFFSET_SCORE_SINGLE_FLOAT:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      pscore = reinterpret_cast<uint32_t*>(&fscore);
+      *pscore = *reinterpret_cast<const uint32_t*>(begin);
+      output->emplace_back(offset, fscore);
+      begin += sizeof(float);
+      break;
+
+    case CA_OFFSET_SCORE_SINGLE_POSITIVE_1:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      uscore = *begin++;
+      output->emplace_back(offset, uscore);
+      break;
+
+    case CA_OFFSET_SCORE_SINGLE_NEGATIVE_1:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      uscore = *begin++;
+      output->emplace_back(offset, static_cast<int32_t>(~uscore));
+      break;
+
+    case CA_OFFSET_SCORE_SINGLE_POSITIVE_2:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      uscore = *begin++;
+      uscore |= *begin++ << 8;
+      output->emplace_back(offset, uscore);
+      break;
+
+    case CA_OFFSET_SCORE_SINGLE_NEGATIVE_2:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      uscore = *begin++;
+      uscore |= *begin++ << 8;
+      output->emplace_back(offset, static_cast<int32_t>(~uscore));
+      break;
+
+    case CA_OFFSET_SCORE_SINGLE_POSITIVE_3:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      uscore = *begin++;
+      uscore |= *begin++ << 8;
+      uscore |= *begin++ << 16;
+      output->emplace_back(offset, uscore);
+      break;
+
+    case CA_OFFSET_SCORE_SINGLE_NEGATIVE_3:
+      oroch::varint_codec<uint64_t>::value_decode(offset, begin);
+      uscore = *begin++;
+      uscore |= *begin++ << 8;
+      uscore |= *begin++ << 16;
+      output->emplace_back(offset, static_cast<int32_t>(~uscore));
+      break;
+
+    case CA_OFFSET_SCORE_EMPTY:
+      break;
+
+    default:
+      KJ_FAIL_REQUIRE("unknown offset score format", type);
+  }
+
+  // The remaining encodings hold a single value or are rare, so they are
+  // decoded in full.
+  if (!decode_scores) {
+    for (auto i = base_index; i < output->size(); ++i)
+      (*output)[i].score = 0.0f;
+  }
+}
+
+template <typename T>
+void ParseOffsetScores(string_view input, std::vector<T>* output,
+                       std::vector<OffsetScorePercentiles>* percentiles,
+                       bool decode_scores, CodecContext& context) {
+  while (!input.empty()) {
+    auto begin = reinterpret_cast<const uint8_t*>(input.begin());
+    auto end = reinterpret_cast<const uint8_t*>(input.end());
+    auto begin_save = begin;
+
+    ParseOffsetScoreValue(begin, end, output, percentiles, decode_scores,
+                          context);
+
+    input.remove_prefix(begin - begin_save);
+  }
+}
+
 void ca_offset_score_parse(string_view input,
-                           std::vector<ca_offset_score>* output) {
+                           std::vector<ca_offset_score>* output,
+                           CodecContext* context) {
+  CodecContext local_context;
+  ParseOffsetScores(input, output, nullptr, true,
+                    context ? *context : local_context);
+}
+
+void ca_offset_score_parse(string_view input, std::vector<OffsetScore>* output,
+                           std::vector<OffsetScorePercentiles>* percentiles,
+                           CodecContext* context) {
+  CodecContext local_context;
+  ParseOffsetScores(input, output, percentiles, true,
+                    context ? *context : local_context);
+}
+
+void ca_offset_score_parse_offsets(string_view input,
+                                   std::vector<OffsetScore>* output,
+                                   CodecContext* context) {
+  CodecContext local_context;
+  ParseOffsetScores(input, output, nullptr, false,
+                    context ? *context : local_context);
+}
+
+// Work for ca_offset_score_parse_parallel(): lists decoded up front, and
+// chunks of CA_OFFSET_SCORE_BLOCKED lists, each with its position in
+// `output'.  Lists that precede all chunks are decoded into `output'
+// directly.
+struct ParallelParse {
+  std::vector<OffsetScore>* output = nullptr;
+  size_t count = 0;
+  std::vector<std::pair<size_t, std::vector<OffsetScore>>> lists;
+  std::vector<std::pair<size_t, OffsetScoreCursor::Chunk>> chunks;
+};
+
+void CollectParallelParse(string_view input, bool decode_scores,
+                          ParallelParse& parse, CodecContext& context) {
   while (!input.empty()) {
     auto begin = reinterpret_cast<const uint8_t*>(input.begin());
     auto end = reinterpret_cast<const uint8_t*>(input.end());
     auto begin_save = begin;
-    uint64_t offset;
-    float fscore;
-    uint32_t uscore;
-    uint32_t* pscore;
 
-    auto type = static_cast<ca_offset_score_type>(*begin++);
+    switch (*begin) {
+      case CA_OFFSET_SCORE_WITH_SUMMARY: {
+        ++begin;
+        const auto summary = ParseOffsetScoreSummary(begin, end);
+        CollectParallelParse(summary.data, decode_scores, parse, context);
+      } break;
 
-    switch (type) {
-      case CA_OFFSET_SCORE_WITH_PREDICTION:
-        ParseOffsetScoreWithPrediction(begin, end, output);
-        break;
+      case CA_OFFSET_SCORE_BLOCKED: {
+        ++begin;
+        auto& chunks = context.chunks;
+        ParseOffsetScoreBlocks(begin, end, chunks);
+        for (const auto& chunk : chunks) {
+          parse.chunks.emplace_back(parse.count, chunk);
+          parse.count += chunk.count;
+        }
+      } break;
 
-      case CA_OFFSET_SCORE_FLEXI:
-        ParseOffsetScoreFlexi(begin, end, output);
-        break;
+      default:
+        if (parse.chunks.empty()) {
+          ParseOffsetScoreValue(begin, end, parse.output, nullptr,
+                                decode_scores, context);
+          parse.count = parse.output->size();
+          break;
+        }
 
-      case CA_OFFSET_SCORE_DELTA_OROCH_FLOAT:
-        ParseOffsetScoreOroch(begin, end, output, false);
-        break;
+        parse.lists.emplace_back(parse.count, std::vector<OffsetScore>());
+        ParseOffsetScoreValue(begin, end, &parse.lists.back().second, nullptr,
+                              decode_scores, context);
+        parse.count += parse.lists.back().second.size();
+    }
 
-      case CA_OFFSET_SCORE_DELTA_OROCH_OROCH:
-        ParseOffsetScoreOroch(begin, end, output, true);
-        break;
+    input.remove_prefix(begin - begin_save);
+  }
+}
 
-      case CA_OFFSET_SCORE_SINGLE_FLOAT:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        pscore = reinterpret_cast<uint32_t*>(&fscore);
-        *pscore = *reinterpret_cast<const uint32_t*>(begin);
-        output->emplace_back(offset, fscore);
-        begin += sizeof(float);
-        break;
+void ca_offset_score_parse_parallel(string_view input,
+                                    std::vector<OffsetScore>* output,
+                                    size_t thread_count, bool decode_scores,
+                                    CodecContext* context) {
+  CodecContext local_context;
+  if (!context) context = &local_context;
+
+  ParallelParse parse;
+  parse.output = output;
+  parse.count = output->size();
+  CollectParallelParse(input, decode_scores, parse, *context);
+
+  output->resize(parse.count);
+  for (const auto& list : parse.lists) {
+    std::copy(list.second.begin(), list.second.end(),
+              output->begin() + list.first);
+  }
 
-      case CA_OFFSET_SCORE_SINGLE_POSITIVE_1:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        uscore = *begin++;
-        output->emplace_back(offset, uscore);
-        break;
+  const auto& chunks = parse.chunks;
+  if (chunks.empty()) return;
+
+  auto decode_chunks = [&chunks, output, decode_scores](
+                           size_t first, size_t last, CodecContext& context) {
+    std::vector<OffsetScore> values;
+    for (size_t i = first; i < last; ++i) {
+      const auto& chunk = chunks[i].second;
+      values.clear();
+      ParseOffsetScores(chunk.data, &values, nullptr, decode_scores, context);
+      KJ_REQUIRE(values.size() == chunk.count, values.size(), chunk.count);
+      std::copy(values.begin(), values.end(),
+                output->begin() + chunks[i].first);
+    }
+  };
+
+  // Give each thread a few batches of chunks, to even out the load.
+  thread_count = std::max<size_t>(thread_count, 1);
+  const auto chunk_values =
+      std::max<size_t>(1, (parse.count - chunks[0].first) / chunks.size());
+  const auto batch_size = std::max<size_t>(
+      (kMinParallelParseValues + chunk_values - 1) / chunk_values,
+      chunks.size() / (4 * thread_count));
+  const auto batch_count = (chunks.size() + batch_size - 1) / batch_size;
+
+  if (thread_count == 1 || batch_count == 1) {
+    decode_chunks(0, chunks.size(), *context);
+    return;
+  }
 
-      case CA_OFFSET_SCORE_SINGLE_NEGATIVE_1:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        uscore = *begin++;
-        output->emplace_back(offset, static_cast<int32_t>(~uscore));
-        break;
+  std::mutex error_lock;
+  std::exception_ptr error;
+
+  {
+    evenk::thread_pool<thread_pool_queue> thread_pool(
+        std::min(thread_count, batch_count));
+
+    for (size_t i = 0; i < chunks.size(); i += batch_size) {
+      const auto last = std::min(chunks.size(), i + batch_size);
+      thread_pool.submit([&decode_chunks, &error_lock, &error, i, last] {
+        try {
+          CodecContext batch_context;
+          decode_chunks(i, last, batch_context);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_lock);
+          if (!error) error = std::current_exception();
+        }
+      });
+    }
 
-      case CA_OFFSET_SCORE_SINGLE_POSITIVE_2:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        uscore = *begin++;
-        uscore |= *begin++ << 8;
-        output->emplace_back(offset, uscore);
-        break;
+    thread_pool.wait();
+  }
 
-      case CA_OFFSET_SCORE_SINGLE_NEGATIVE_2:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        uscore = *begin++;
-        uscore |= *begin++ << 8;
-        output->emplace_back(offset, static_cast<int32_t>(~uscore));
-        break;
+  if (error) std::rethrow_exception(error);
+}
 
-      case CA_OFFSET_SCORE_SINGLE_POSITIVE_3:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        uscore = *begin++;
-        uscore |= *begin++ << 8;
-        uscore |= *begin++ << 16;
-        output->emplace_back(offset, uscore);
-        break;
+bool ca_offset_score_parse_bitmap(string_view input, OffsetBitmap* output) {
+  *output = OffsetBitmap();
 
-      case CA_OFFSET_SCORE_SINGLE_NEGATIVE_3:
-        oroch::varint_codec<uint64_t>::value_decode(offset, begin);
-        uscore = *begin++;
-        uscore |= *begin++ << 8;
-        uscore |= *begin++ << 16;
-        output->emplace_back(offset, static_cast<int32_t>(~uscore));
-        break;
+  while (!input.empty()) {
+    auto begin = reinterpret_cast<const uint8_t*>(input.begin());
+    auto end = reinterpret_cast<const uint8_t*>(input.end());
+    auto begin_save = begin;
+
+    switch (*begin++) {
+      case CA_OFFSET_SCORE_BITMAP: {
+        KJ_REQUIRE(end - begin >= 4, "truncated offset/score list");
+        begin += sizeof(float);
+
+        if (output->Empty()) {
+          output->Decode(begin, end);
+        } else {
+          OffsetBitmap bitmap;
+          bitmap.Decode(begin, end);
+          output->UnionWith(bitmap);
+        }
+      } break;
+
+      case CA_OFFSET_SCORE_WITH_SUMMARY: {
+        OffsetBitmap bitmap;
+        if (!ca_offset_score_parse_bitmap(
+                ParseOffsetScoreSummary(begin, end).data, &bitmap))
+          return false;
+        output->UnionWith(bitmap);
+      } break;
 
       case CA_OFFSET_SCORE_EMPTY:
         break;
 
       default:
-        KJ_FAIL_REQUIRE("unknown offset score format", type);
+        return false;
     }
 
     input.remove_prefix(begin - begin_save);
   }
+
+  return true;
 }
 
-size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end) {
+size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end,
+                             CodecContext* context) {
+  CodecContext local_context;
+  if (!context) context = &local_context;
+
   size_t result = 0;
 
   while (begin < end) {
@@ -635,8 +1195,22 @@ size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end) {
     auto type = static_cast<ca_offset_score_type>(*begin++);
 
     switch (type) {
+      case CA_OFFSET_SCORE_BLOCKED:
+        result += ParseOffsetScoreBlocks(begin, end, context->chunks);
+        break;
+
+      case CA_OFFSET_SCORE_WITH_SUMMARY:
+        result += ParseOffsetScoreSummary(begin, end).count;
+        break;
+
+      case CA_OFFSET_SCORE_BITMAP:
+        begin += sizeof(float);
+        result += OffsetBitmap::Skip(begin, end);
+        break;
+
       case CA_OFFSET_SCORE_WITH_PREDICTION:
-        result += CountOffsetScoreWithPrediction(begin, end);
+      case CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED:
+        result += CountOffsetScoreWithPrediction(begin, end, type, *context);
         break;
 
       case CA_OFFSET_SCORE_FLEXI:
@@ -644,11 +1218,9 @@ size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end) {
         break;
 
       case CA_OFFSET_SCORE_DELTA_OROCH_FLOAT:
-        result += CountOffsetScoreOroch(begin, end, false);
-        break;
-
       case CA_OFFSET_SCORE_DELTA_OROCH_OROCH:
-        result += CountOffsetScoreOroch(begin, end, true);
+      case CA_OFFSET_SCORE_DELTA_OROCH_XOR:
+        result += CountOffsetScoreOroch(begin, end, type, *context);
         break;
 
       case CA_OFFSET_SCORE_SINGLE_FLOAT:
@@ -689,7 +1261,11 @@ size_t ca_offset_score_count(const uint8_t* begin, const uint8_t* end) {
   return result;
 }
 
-uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end) {
+uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end,
+                                    CodecContext* context) {
+  CodecContext local_context;
+  if (!context) context = &local_context;
+
   uint64_t result = 0;
 
   while (begin < end) {
@@ -697,10 +1273,32 @@ uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end) {
     uint64_t offset = 0;
 
     switch (type) {
+      case CA_OFFSET_SCORE_BLOCKED: {
+        auto& chunks = context->chunks;
+        ParseOffsetScoreBlocks(begin, end, chunks);
+        if (!chunks.empty()) offset = chunks.back().last_offset;
+      } break;
+
+      case CA_OFFSET_SCORE_WITH_SUMMARY:
+        offset = ParseOffsetScoreSummary(begin, end).last_offset;
+        break;
+
+      case CA_OFFSET_SCORE_BITMAP:
+        begin += sizeof(float);
+        OffsetBitmap::Skip(begin, end, &offset);
+        break;
+
       case CA_OFFSET_SCORE_WITH_PREDICTION:
-        offset = GetMaxOffsetWithPrediction(begin, end);
+        offset = GetMaxOffsetWithPrediction(begin, end, *context);
         break;
 
+      case CA_OFFSET_SCORE_WITH_PREDICTION_QUANTIZED: {
+        auto& tmp = context->values;
+        tmp.clear();
+        ParseOffsetScoreQuantized(begin, end, &tmp, *context);
+        if (!tmp.empty()) offset = tmp.back().offset;
+      } break;
+
       case CA_OFFSET_SCORE_FLEXI: {
         auto count = ca_parse_integer(&begin);
         if (count == 0) break;
@@ -774,11 +1372,9 @@ uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end) {
       } break;
 
       case CA_OFFSET_SCORE_DELTA_OROCH_FLOAT:
-        offset = GetMaxOffsetOroch(begin, end, false);
-        break;
-
       case CA_OFFSET_SCORE_DELTA_OROCH_OROCH:
-        offset = GetMaxOffsetOroch(begin, end, true);
+      case CA_OFFSET_SCORE_DELTA_OROCH_XOR:
+        offset = GetMaxOffsetOroch(begin, end, type, *context);
         break;
 
       case CA_OFFSET_SCORE_SINGLE_FLOAT:
@@ -817,5 +1413,89 @@ uint64_t ca_offset_score_max_offset(const uint8_t* begin, const uint8_t* end) {
   return result;
 }
 
+/*****************************************************************************/
+
+OffsetScoreCursor::OffsetScoreCursor(string_view input, bool decode_scores)
+    : input_(input), decode_scores_(decode_scores) {
+  Load();
+}
+
+void OffsetScoreCursor::Next() {
+  if (++index_ >= values_.size()) Load();
+}
+
+void OffsetScoreCursor::SkipTo(uint64_t offset) {
+  while (Valid()) {
+    if (values_.back().offset >= offset) {
+      index_ = std::lower_bound(values_.begin() + index_, values_.end(), offset,
+                                [](const ca_offset_score& lhs,
+                                   uint64_t offset) {
+                                  return lhs.offset < offset;
+                                }) -
+               values_.begin();
+      return;
+    }
+
+    // Pass over chunks that end before `offset' without decoding them.
+    while (chunk_index_ < chunks_.size() &&
+           chunks_[chunk_index_].last_offset < offset)
+      ++chunk_index_;
+
+    Load();
+  }
+}
+
+bool OffsetScoreCursor::Load() {
+  values_.clear();
+  index_ = 0;
+
+  while (values_.empty()) {
+    if (chunk_index_ < chunks_.size()) {
+      const auto& chunk = chunks_[chunk_index_++];
+      max_score_ = chunk.max_score;
+      ParseOffsetScores(chunk.data, &values_, nullptr, decode_scores_,
+                        context_);
+      continue;
+    }
+
+    chunks_.clear();
+    chunk_index_ = 0;
+    max_score_ = std::numeric_limits<float>::infinity();
+
+    if (input_.empty()) return false;
+
+    auto begin = reinterpret_cast<const uint8_t*>(input_.begin());
+    auto end = reinterpret_cast<const uint8_t*>(input_.end());
+    auto begin_save = begin;
+
+    if (*begin == CA_OFFSET_SCORE_BLOCKED) {
+      ++begin;
+      ParseOffsetScoreBlocks(begin, end, chunks_);
+    } else if (*begin == CA_OFFSET_SCORE_WITH_SUMMARY) {
+      ++begin;
+      const auto summary = ParseOffsetScoreSummary(begin, end);
+
+      if (!summary.data.empty() &&
+          summary.data[0] == CA_OFFSET_SCORE_BLOCKED) {
+        // Blocked lists have their own chunk headers, so continue with those.
+        begin = reinterpret_cast<const uint8_t*>(summary.data.begin());
+      } else {
+        // Treat the whole list as one chunk, so SkipTo() can pass over it.
+        chunks_.emplace_back();
+        chunks_.back().first_offset = summary.first_offset;
+        chunks_.back().last_offset = summary.last_offset;
+        chunks_.back().data = summary.data;
+      }
+    } else {
+      ParseOffsetScoreValue(begin, end, &values_, nullptr, decode_scores_,
+                            context_);
+    }
+
+    input_.remove_prefix(begin - begin_save);
+  }
+
+  return true;
+}
+
 }  // namespace table
 }  // namespace cantera
@@ -30,6 +30,7 @@
 #include <memory>
 #include <random>
 #include <set>
+#include <thread>
 #include <unordered_map>
 
 #include <ca-cas/client.h>
@@ -40,6 +41,7 @@
 
 #include "src/ca-table.h"
 #include "src/keywords.h"
+#include "src/offset-bitmap.h"
 #include "src/query.h"
 #include "src/util.h"
 
@@ -59,16 +61,28 @@ std::unordered_map<uint64_t, Json::Value> extra_data;
 std::unique_ptr<kj::AsyncIoContext> aio_context;
 std::unique_ptr<cantera::CASClient> cas_client;
 
+// Scratch space for decoding posting lists.  Queries may be processed on
+// several threads at once, so each thread has its own.
+thread_local CodecContext codec_context;
+
+// Threads for decoding posting lists looked up on this thread, as set by
+// SetQueryDecodeThreads().
+thread_local size_t decode_threads = 0;
+
+size_t DecodeThreads() {
+  if (decode_threads) return decode_threads;
+  return std::max(1U, std::thread::hardware_concurrency());
+}
+
 void CreateCASClient() {
   // TODO(mortehu): Create this in `main()` instead.
   aio_context = std::make_unique<kj::AsyncIoContext>(kj::setupAsyncIo());
   cas_client = std::make_unique<cantera::CASClient>(*aio_context);
 }
 
-std::vector<ca_offset_score> UnionOffsets(
-    const std::vector<ca_offset_score>& lhs,
-    const std::vector<ca_offset_score>& rhs) {
-  std::vector<ca_offset_score> result;
+std::vector<OffsetScore> UnionOffsets(const std::vector<OffsetScore>& lhs,
+                                      const std::vector<OffsetScore>& rhs) {
+  std::vector<OffsetScore> result;
 
   result.reserve(lhs.size() + rhs.size());
 
@@ -93,10 +107,10 @@ std::vector<ca_offset_score> UnionOffsets(
   return result;
 }
 
-size_t IntersectOffsets(struct ca_offset_score* lhs, size_t lhs_count,
-                        const struct ca_offset_score* rhs, size_t rhs_count) {
-  struct ca_offset_score *output, *o;
-  const struct ca_offset_score *lhs_end, *rhs_end;
+size_t IntersectOffsets(OffsetScore* lhs, size_t lhs_count,
+                        const OffsetScore* rhs, size_t rhs_count) {
+  OffsetScore *output, *o;
+  const OffsetScore *lhs_end, *rhs_end;
 
   output = o = lhs;
 
@@ -134,7 +148,7 @@ bool IsValidDomainName(const std::string& name) {
 }
 
 // Removes duplicate offsets, keeping either the maximum or minimum score.
-void RemoveDuplicates(std::vector<ca_offset_score>& data, const bool use_max) {
+void RemoveDuplicates(std::vector<OffsetScore>& data, const bool use_max) {
   auto in = data.begin();
   auto out = data.begin();
 
@@ -169,8 +183,8 @@ std::string TimeToDateString(double time) {
 }
 
 template <typename Filter>
-void Join(std::vector<ca_offset_score>& lhs,
-          const std::vector<ca_offset_score>& rhs, Filter filter) {
+void Join(std::vector<OffsetScore>& lhs, const std::vector<OffsetScore>& rhs,
+          Filter filter) {
   auto out = lhs.begin();
 
   auto l = lhs.begin();
@@ -195,34 +209,116 @@ void Join(std::vector<ca_offset_score>& lhs,
   lhs.erase(out, lhs.end());
 }
 
+// Returns true if `token' is a keyword handled by LookupIndexKey() rather than
+// an index key.
+bool IsKeyword(const char* token) {
+  const char* delimiter = strchr(token, ':');
+  return (delimiter > token + 3 && !memcmp(delimiter - 3, "-in", 3)) ||
+         !strncmp(token, "in-", 3);
+}
+
+// Returns true if a binary operator reads the scores of its left operand, or
+// passes them on to a parent that needs scores.
+bool LhsNeedsScores(OperatorType operator_type, bool need_scores) {
+  switch (operator_type) {
+    case kOperatorOr:
+    case kOperatorAnd:
+    case kOperatorSubtract:
+    case kOperatorRandomSample:
+      return need_scores;
+
+    case kOperatorOrderBy:
+      // The scores are replaced by those of the right operand.
+      return false;
+
+    default:
+      return true;
+  }
+}
+
 }  // namespace
 
+// If `need_scores' is false, only offsets are decoded, and all scores are
+// zero.
 void LookupIndexKey(
     const std::vector<TableWithLock>& index_tables, const char* key,
-    std::function<void(std::vector<ca_offset_score>)>&& callback) {
+    std::function<void(std::vector<OffsetScore>)>&& callback,
+    bool need_scores = true) {
   const auto unescaped_key = DecodeURIComponent(key);
 
   for (size_t i = 0; i < index_tables.size(); ++i) {
-    std::vector<ca_offset_score> new_offsets;
+    std::vector<OffsetScore> new_offsets;
+
+    // Get() is thread-safe, so no lock is needed.
+    if (!index_tables[i].table->Get(
+            unescaped_key,
+            [&new_offsets, need_scores](const string_view& data) {
+              ca_offset_score_parse_parallel(data, &new_offsets,
+                                             DecodeThreads(), need_scores,
+                                             &codec_context);
+            }))
+      continue;
 
-    {
-      TableWithLock::lock_guard_type lock(index_tables[i].lock);
+    callback(std::move(new_offsets));
+  }
+}
 
-      if (!index_tables[i].table->SeekToKey(unescaped_key)) continue;
+// Returns false if the key statistics of all index tables show that no score
+// stored under the leaf `query->lhs' passes the scalar score filter `query'.
+bool ScoreFilterMayMatch(const std::vector<TableWithLock>& index_tables,
+                         const Query* query) {
+  const auto value = query->value;
+  std::function<bool(double, double)> may_match;
+  switch (query->operator_type) {
+    case kOperatorEQ:
+      may_match = [value](double min, double max) {
+        return min <= value && max >= value;
+      };
+      break;
+    case kOperatorGT:
+      may_match = [value](double, double max) { return max > value; };
+      break;
+    case kOperatorGE:
+      may_match = [value](double, double max) { return max >= value; };
+      break;
+    case kOperatorLT:
+      may_match = [value](double min, double) { return min < value; };
+      break;
+    case kOperatorLE:
+      may_match = [value](double min, double) { return min <= value; };
+      break;
+    case kOperatorInRange: {
+      const auto low = std::min(query->value, query->value2);
+      const auto high = std::max(query->value, query->value2);
+      may_match = [low, high](double min, double max) {
+        return max >= low && min <= high;
+      };
+    } break;
+    default:
+      return true;
+  }
 
-      string_view key, data;
-      KJ_REQUIRE(index_tables[i].table->ReadRow(key, data));
-      ca_offset_score_parse(data, &new_offsets);
-    }
+  // Keywords are not stored under their own name.
+  const char* token = query->lhs->identifier;
+  if (IsKeyword(token)) return true;
 
-    callback(std::move(new_offsets));
+  const auto key = DecodeURIComponent(token);
+  for (const auto& index_table : index_tables) {
+    KeyStatistics statistics;
+    {
+      TableWithLock::lock_guard_type lock(index_table.lock);
+      if (!index_table.table->GetKeyStatistics(key, statistics)) return true;
+    }
+    if (may_match(statistics.min_score, statistics.max_score)) return true;
   }
+
+  return false;
 }
 
 void LookupIndexKey(
     const std::vector<TableWithLock>& index_tables, const char* token,
-    bool make_headers,
-    std::function<void(std::vector<ca_offset_score>)>&& callback) {
+    bool make_headers, bool need_scores,
+    std::function<void(std::vector<OffsetScore>)>&& callback) {
   const char* delimiter = strchr(token, ':');
 
   if (delimiter > token + 3 && !memcmp(delimiter - 3, "-in", 3)) {
@@ -281,26 +377,45 @@ void LookupIndexKey(
     // we use an std::set to get unique sorted elements instead.
     std::set<uint64_t> offset_buffer;
 
-    // Look up one "name:X" token per potential hostname found.
-    for (const auto& name : names) {
-      LookupIndexKey(
-          index_tables, (field + name.first).c_str(),
-          [&name, &header_key, &offset_buffer, make_headers](auto new_offsets) {
-            for (const auto& offset : new_offsets) {
-              offset_buffer.emplace(offset.offset);
-
-              // Record headers.
-              if (!name.second.first.empty() && !make_headers) {
-                extra_data[offset.offset]["_header"] =
-                    Json::Value(name.second.first);
-                extra_data[offset.offset]["_header_key"] =
-                    Json::Value(name.second.second);
-              }
-            }
-          });
+    // Look up one "name:X" token per potential hostname found.  The keys are
+    // sorted, so that each index table can find them all in one pass.
+    const auto unescaped_field = DecodeURIComponent(field);
+    using Header = std::pair<std::string, std::string>;
+    std::vector<std::pair<std::string, const Header*>> lookups;
+    for (const auto& name : names)
+      lookups.emplace_back(unescaped_field + name.first, &name.second);
+    std::sort(lookups.begin(), lookups.end());
+
+    std::vector<string_view> keys;
+    for (const auto& lookup : lookups) keys.emplace_back(lookup.first);
+
+    for (const auto& index_table : index_tables) {
+      TableWithLock::lock_guard_type lock(index_table.lock);
+
+      index_table.table->SeekToKeys(keys, [&index_table, &lookups,
+                                           &offset_buffer,
+                                           make_headers](size_t index) {
+        string_view row_key, data;
+        KJ_REQUIRE(index_table.table->ReadRow(row_key, data));
+
+        std::vector<OffsetScore> new_offsets;
+        ca_offset_score_parse_offsets(data, &new_offsets, &codec_context);
+
+        const auto& header = *lookups[index].second;
+        for (const auto& offset : new_offsets) {
+          offset_buffer.emplace(offset.offset);
+
+          // Record headers.
+          if (!header.first.empty() && !make_headers) {
+            extra_data[offset.offset]["_header"] = Json::Value(header.first);
+            extra_data[offset.offset]["_header_key"] =
+                Json::Value(header.second);
+          }
+        }
+      });
     }
 
-    std::vector<ca_offset_score> tmp;
+    std::vector<OffsetScore> tmp;
     for (auto offset : offset_buffer) tmp.emplace_back(offset, 0.0f);
     callback(std::move(tmp));
   } else if (!strncmp(token, "in-", 3)) {
@@ -326,7 +441,7 @@ void LookupIndexKey(
 
       string_view row_key, data;
       while (index_tables[i].table->ReadRow(row_key, data)) {
-        std::vector<ca_offset_score> new_offsets;
+        std::vector<OffsetScore> new_offsets;
 
         if (!HasPrefix(row_key, key)) {
           if (row_key < key) continue;
@@ -340,29 +455,29 @@ void LookupIndexKey(
                         }))
           continue;
 
-        ca_offset_score_parse(data, &new_offsets);
+        ca_offset_score_parse_offsets(data, &new_offsets, &codec_context);
 
         for (const auto& offset : new_offsets)
           offset_buffer.emplace(offset.offset);
       }
     }
 
-    std::vector<ca_offset_score> tmp;
+    std::vector<OffsetScore> tmp;
     for (auto offset : offset_buffer) tmp.emplace_back(offset, 0.0f);
     callback(std::move(tmp));
   } else {
-    LookupIndexKey(index_tables, token, std::move(callback));
+    LookupIndexKey(index_tables, token, std::move(callback), need_scores);
   }
 }
 
-size_t SubtractOffsets(struct ca_offset_score* lhs, size_t lhs_count,
-                       const struct ca_offset_score* rhs, size_t rhs_count) {
+size_t SubtractOffsets(OffsetScore* lhs, size_t lhs_count,
+                       const OffsetScore* rhs, size_t rhs_count) {
   // We can't use std::set_difference() here, because it will not delete
   // duplicate offsets from `lhs' unless the same duplicate count exists in
   // `rhs'.
 
-  struct ca_offset_score *output, *o;
-  const struct ca_offset_score *lhs_end, *rhs_end;
+  OffsetScore *output, *o;
+  const OffsetScore *lhs_end, *rhs_end;
 
   output = o = lhs;
 
@@ -391,8 +506,168 @@ size_t SubtractOffsets(struct ca_offset_score* lhs, size_t lhs_count,
   return o - output;
 }
 
-void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
-                     Schema* schema, bool make_headers) {
+void ProcessSubQuery(std::vector<OffsetScore>& offsets, const Query* query,
+                     Schema* schema, bool make_headers, bool need_scores);
+
+namespace {
+
+// The offsets of a subquery whose scores are not needed.  Index keys stored as
+// CA_OFFSET_SCORE_BITMAP are kept as bitmaps, so that AND, OR and SUBTRACT
+// can combine them without expanding them to lists.
+struct OffsetSet {
+  bool Empty() const { return is_bitmap ? bitmap.Empty() : offsets.empty(); }
+
+  // Converts the set to a list sorted by offset.
+  void MakeList() {
+    if (!is_bitmap) return;
+    offsets.clear();
+    bitmap.AppendTo(&offsets, 0.0f);
+    bitmap = OffsetBitmap();
+    is_bitmap = false;
+  }
+
+  bool is_bitmap = false;
+  OffsetBitmap bitmap;
+  std::vector<OffsetScore> offsets;
+};
+
+// Returns true if `query' is an AND, OR or SUBTRACT of two subqueries.
+bool IsSetOperation(const Query* query) {
+  if (query->type != kQueryBinaryOperator || !query->rhs) return false;
+
+  switch (query->operator_type) {
+    case kOperatorOr:
+    case kOperatorAnd:
+    case kOperatorSubtract:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// Looks up the index key `token', keeping the result as a bitmap if all its
+// lists are stored as bitmaps.
+void LookupIndexKey(const std::vector<TableWithLock>& index_tables,
+                    const char* token, OffsetSet& result) {
+  const auto unescaped_key = DecodeURIComponent(token);
+
+  for (const auto& index_table : index_tables) {
+    // Get() is thread-safe, so no lock is needed.
+    index_table.table->Get(unescaped_key, [&result](const string_view& data) {
+      OffsetSet found;
+      found.is_bitmap = ca_offset_score_parse_bitmap(data, &found.bitmap);
+      if (!found.is_bitmap) {
+        found.bitmap = OffsetBitmap();
+        ca_offset_score_parse_parallel(data, &found.offsets, DecodeThreads(),
+                                       false, &codec_context);
+      }
+      result = std::move(found);
+    });
+  }
+}
+
+// Applies the set operation `operator_type' to `lhs' and `rhs', leaving the
+// result in `lhs'.  Bitmaps are combined a word at a time, and lists are
+// filtered by bitmaps without expanding them.
+void CombineOffsetSets(OffsetSet& lhs, OffsetSet& rhs,
+                       OperatorType operator_type) {
+  switch (operator_type) {
+    case kOperatorOr:
+      if (lhs.is_bitmap && rhs.is_bitmap) {
+        lhs.bitmap.UnionWith(rhs.bitmap);
+      } else {
+        lhs.MakeList();
+        rhs.MakeList();
+        lhs.offsets = UnionOffsets(lhs.offsets, rhs.offsets);
+      }
+      break;
+
+    case kOperatorAnd:
+      if (lhs.is_bitmap && rhs.is_bitmap) {
+        lhs.bitmap.IntersectWith(rhs.bitmap);
+      } else if (rhs.is_bitmap) {
+        lhs.offsets.resize(rhs.bitmap.Filter(lhs.offsets.data(),
+                                             lhs.offsets.size(), true));
+      } else if (lhs.is_bitmap) {
+        // The bitmap has no duplicates, so neither may the result.
+        rhs.offsets.resize(lhs.bitmap.Filter(rhs.offsets.data(),
+                                             rhs.offsets.size(), true));
+        rhs.offsets.erase(
+            std::unique(rhs.offsets.begin(), rhs.offsets.end(),
+                        [](const auto& lhs, const auto& rhs) {
+                          return lhs.offset == rhs.offset;
+                        }),
+            rhs.offsets.end());
+        lhs = std::move(rhs);
+      } else {
+        lhs.offsets.resize(IntersectOffsets(lhs.offsets.data(),
+                                            lhs.offsets.size(),
+                                            rhs.offsets.data(),
+                                            rhs.offsets.size()));
+      }
+      break;
+
+    case kOperatorSubtract:
+      if (lhs.is_bitmap && rhs.is_bitmap) {
+        lhs.bitmap.Subtract(rhs.bitmap);
+      } else if (rhs.is_bitmap) {
+        lhs.offsets.resize(rhs.bitmap.Filter(lhs.offsets.data(),
+                                             lhs.offsets.size(), false));
+      } else if (lhs.is_bitmap) {
+        lhs.bitmap.Subtract(OffsetBitmap::FromOffsets(rhs.offsets.data(),
+                                                      rhs.offsets.size()));
+      } else {
+        lhs.offsets.resize(SubtractOffsets(lhs.offsets.data(),
+                                           lhs.offsets.size(),
+                                           rhs.offsets.data(),
+                                           rhs.offsets.size()));
+      }
+      break;
+
+    default:
+      KJ_FAIL_REQUIRE("Unsupported operator type", operator_type);
+  }
+}
+
+// Evaluates `query' like ProcessSubQuery() does when scores are not needed,
+// keeping bitmaps as such for as long as possible.
+void ProcessOffsetSetQuery(OffsetSet& result, const Query* query,
+                           Schema* schema, bool make_headers) {
+  if (query->type == kQueryLeaf && !IsKeyword(query->identifier)) {
+    LookupIndexKey(schema->IndexTables(), query->identifier, result);
+    return;
+  }
+
+  if (!IsSetOperation(query)) {
+    result.is_bitmap = false;
+    ProcessSubQuery(result.offsets, query, schema, make_headers, false);
+    return;
+  }
+
+  ProcessOffsetSetQuery(result, query->lhs, schema, make_headers);
+  if (query->operator_type != kOperatorOr && result.Empty()) return;
+
+  OffsetSet rhs;
+  ProcessOffsetSetQuery(rhs, query->rhs, schema, make_headers);
+
+  CombineOffsetSets(result, rhs, query->operator_type);
+}
+
+}  // namespace
+
+// If `need_scores' is false, the caller ignores the scores of `offsets', and
+// they may be left zero.
+void ProcessSubQuery(std::vector<OffsetScore>& offsets, const Query* query,
+                     Schema* schema, bool make_headers, bool need_scores) {
+  if (!need_scores && IsSetOperation(query)) {
+    OffsetSet result;
+    ProcessOffsetSetQuery(result, query, schema, make_headers);
+    result.MakeList();
+    offsets = std::move(result.offsets);
+    return;
+  }
+
   switch (query->type) {
     case kQueryKey: {
       string_view key(query->identifier);
@@ -407,45 +682,44 @@ void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
 
     case kQueryLeaf:
       LookupIndexKey(
-          schema->IndexTables(), query->identifier, make_headers,
+          schema->IndexTables(), query->identifier, make_headers, need_scores,
           [&offsets](auto new_offsets) { offsets = std::move(new_offsets); });
       break;
 
     case kQueryBinaryOperator:
-      ProcessSubQuery(offsets, query->lhs, schema, make_headers);
+      if (!query->rhs && query->lhs->type == kQueryLeaf &&
+          !ScoreFilterMayMatch(schema->IndexTables(), query)) {
+        offsets.clear();
+        return;
+      }
+
+      ProcessSubQuery(offsets, query->lhs, schema, make_headers,
+                      LhsNeedsScores(query->operator_type, need_scores));
 
       switch (query->operator_type) {
         case kOperatorOr: {
           if (offsets.empty()) {
-            ProcessSubQuery(offsets, query->rhs, schema, make_headers);
+            ProcessSubQuery(offsets, query->rhs, schema, make_headers,
+                            need_scores);
           } else {
-            std::vector<ca_offset_score> rhs;
-            ProcessSubQuery(rhs, query->rhs, schema, make_headers);
+            std::vector<OffsetScore> rhs;
+            ProcessSubQuery(rhs, query->rhs, schema, make_headers,
+                            need_scores);
 
             offsets = UnionOffsets(offsets, rhs);
           }
         } break;
 
-        case kOperatorAnd: {
-          if (offsets.empty()) return;
-
-          std::vector<ca_offset_score> rhs;
-          ProcessSubQuery(rhs, query->rhs, schema, make_headers);
-
-          const auto new_size = IntersectOffsets(offsets.data(), offsets.size(),
-                                                 rhs.data(), rhs.size());
-          offsets.resize(new_size);
-        } break;
-
+        case kOperatorAnd:
         case kOperatorSubtract: {
           if (offsets.empty()) return;
 
-          std::vector<ca_offset_score> rhs;
-          ProcessSubQuery(rhs, query->rhs, schema, make_headers);
+          OffsetSet lhs, rhs;
+          ProcessOffsetSetQuery(rhs, query->rhs, schema, make_headers);
 
-          const auto new_size = SubtractOffsets(offsets.data(), offsets.size(),
-                                                rhs.data(), rhs.size());
-          offsets.resize(new_size);
+          lhs.offsets = std::move(offsets);
+          CombineOffsetSets(lhs, rhs, query->operator_type);
+          offsets = std::move(lhs.offsets);
         } break;
 
         case kOperatorEQ:
@@ -458,8 +732,8 @@ void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
 
         case kOperatorGT:
           if (query->rhs) {
-            std::vector<ca_offset_score> rhs;
-            ProcessSubQuery(rhs, query->rhs, schema, make_headers);
+            std::vector<OffsetScore> rhs;
+            ProcessSubQuery(rhs, query->rhs, schema, make_headers, true);
 
             Join(offsets, rhs,
                  [](const auto lhs, const auto rhs) { return lhs > rhs; });
@@ -482,8 +756,8 @@ void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
 
         case kOperatorLT:
           if (query->rhs) {
-            std::vector<ca_offset_score> rhs;
-            ProcessSubQuery(rhs, query->rhs, schema, make_headers);
+            std::vector<OffsetScore> rhs;
+            ProcessSubQuery(rhs, query->rhs, schema, make_headers, true);
 
             Join(offsets, rhs,
                  [](const auto lhs, const auto rhs) { return lhs < rhs; });
@@ -517,8 +791,8 @@ void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
         } break;
 
         case kOperatorOrderBy: {
-          std::vector<ca_offset_score> rhs;
-          ProcessSubQuery(rhs, query->rhs, schema, make_headers);
+          std::vector<OffsetScore> rhs;
+          ProcessSubQuery(rhs, query->rhs, schema, make_headers, need_scores);
 
           auto l = offsets.begin();
           auto r = rhs.begin();
@@ -573,7 +847,7 @@ void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
       break;
 
     case kQueryUnaryOperator:
-      ProcessSubQuery(offsets, query->lhs, schema, make_headers);
+      ProcessSubQuery(offsets, query->lhs, schema, make_headers, need_scores);
 
       switch (query->operator_type) {
         case kOperatorMax:
@@ -621,9 +895,14 @@ void ProcessSubQuery(std::vector<ca_offset_score>& offsets, const Query* query,
   }
 }
 
-void ProcessQuery(std::vector<ca_offset_score>& offsets, const Query* query,
-                  Schema* schema, bool make_headers, bool use_max) {
-  ProcessSubQuery(offsets, query, schema, make_headers);
+void SetQueryDecodeThreads(size_t thread_count) {
+  decode_threads = thread_count;
+}
+
+void ProcessQuery(std::vector<OffsetScore>& offsets, const Query* query,
+                  Schema* schema, bool make_headers, bool use_max,
+                  bool need_scores) {
+  ProcessSubQuery(offsets, query, schema, make_headers, need_scores);
   RemoveDuplicates(offsets, use_max);
 }
 
@@ -727,7 +1006,7 @@ void ca_schema_query(Schema* schema, const struct query_statement& stmt) {
   try {
     schema->Load();
 
-    std::vector<ca_offset_score> offsets;
+    std::vector<OffsetScore> offsets;
 
     std::string key_buffer;
 
@@ -829,7 +1108,7 @@ void ca_schema_query(Schema* schema, const struct query_statement& stmt) {
     } else {
       // First, order the results by their physical location in the `summaries`
       // table, to minimize the total seek distance in rotational storage.
-      std::vector<std::pair<ca_offset_score, size_t>> sorted_offsets;
+      std::vector<std::pair<OffsetScore, size_t>> sorted_offsets;
       for (auto i = stmt.offset; i < stmt.offset + limit; ++i)
         sorted_offsets.emplace_back(offsets[i], i - stmt.offset);
       std::sort(sorted_offsets.begin(), sorted_offsets.end(),
@@ -114,6 +114,16 @@ void Schema::Load() {
     }
   }
 
+  // Offsets are mapped to the summary table with the largest base offset not
+  // above them, so each table's range must end before the next one begins.
+  for (size_t i = 1; i < summary_tables.size(); ++i) {
+    const auto& prev = summary_tables[i - 1];
+    const uint64_t prev_end = prev.first + prev.second->EndOffset();
+    KJ_REQUIRE(summary_tables[i].first >= prev_end,
+               "summary table offsets overlap; base offset must be at least",
+               i, summary_tables[i].first, prev_end);
+  }
+
   loaded_ = true;
 }
 
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <thread>
 
 #include "src/ca-table.h"
 #include "src/query.h"
@@ -33,8 +34,8 @@ std::size_t CountFields(const select_statement& select) {
 
 void GetFieldValues(std::vector<std::vector<float>>& values, std::size_t field,
                     struct Query* query, Schema* schema,
-                    const std::vector<ca_offset_score>& selection) try {
-  std::vector<ca_offset_score> field_offsets;
+                    const std::vector<OffsetScore>& selection) try {
+  std::vector<OffsetScore> field_offsets;
 
   ProcessQuery(field_offsets, query, schema, false, false);
 
@@ -83,8 +84,9 @@ void Select(Schema* schema, const select_statement& select) {
   const auto& summary_tables = schema->summary_tables;
   KJ_REQUIRE(summary_tables.size() >= 1);
 
-  std::vector<ca_offset_score> selection;
-  ProcessQuery(selection, select.query, schema, false, false);
+  // Only the offsets of the selection are used.
+  std::vector<OffsetScore> selection;
+  ProcessQuery(selection, select.query, schema, false, false, false);
 
   std::vector<std::vector<float>> values;
   values.resize(selection.size());
@@ -104,11 +106,17 @@ void Select(Schema* schema, const select_statement& select) {
     if (n_threads > MAX_THREADS) n_threads = MAX_THREADS;
     evenk::thread_pool<thread_pool_queue> thread_pool(n_threads);
 
+    // Share the CPUs between the fields decoded at once.
+    const std::size_t decode_threads = std::max<std::size_t>(
+        1, std::thread::hardware_concurrency() / n_threads);
+
     std::size_t index = 0;
     for (auto field = select.fields; field; field = field->next, ++index) {
-      thread_pool.submit([&values, index, field, schema, &selection] {
-        GetFieldValues(values, index, field->query, schema, selection);
-      });
+      thread_pool.submit(
+          [&values, index, field, schema, &selection, decode_threads] {
+            SetQueryDecodeThreads(decode_threads);
+            GetFieldValues(values, index, field->query, schema, selection);
+          });
     }
 
     thread_pool.wait();
@@ -33,14 +33,21 @@
 
 #include <err.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sysexits.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+
 #include <kj/debug.h>
+#include <leveldb/cache.h>
 #include <leveldb/env.h>
+#include <leveldb/filter_policy.h>
 #include <leveldb/iterator.h>
 #include <leveldb/options.h>
 #include <leveldb/table.h>
@@ -115,6 +122,16 @@ class LevelDBBuilder final : public TableBuilder {
             "LevelDB tables do not support given compression method");
     }
 
+    if (options.GetFilterBitsPerKey()) {
+      filter_policy_.reset(
+          leveldb::NewBloomFilterPolicy(options.GetFilterBitsPerKey()));
+      leveldb_options.filter_policy = filter_policy_.get();
+    }
+
+    if (options.GetBlockRestartInterval())
+      leveldb_options.block_restart_interval =
+          options.GetBlockRestartInterval();
+
     writable_file_ = std::make_unique<LevelDBWriter>(
         path, options.GetFileFlags(), options.GetFileMode());
     table_builder_ = std::make_unique<leveldb::TableBuilder>(
@@ -136,6 +153,7 @@ class LevelDBBuilder final : public TableBuilder {
   }
 
  private:
+  std::unique_ptr<const leveldb::FilterPolicy> filter_policy_;
   std::unique_ptr<LevelDBWriter> writable_file_;
   std::unique_ptr<leveldb::TableBuilder> table_builder_;
 
@@ -145,15 +163,201 @@ class LevelDBBuilder final : public TableBuilder {
 
 /*****************************************************************************/
 
+const size_t kDefaultBlockCacheCapacity = 64 * 1024 * 1024;
+
+// Process-wide cache of decompressed data blocks.  A leveldb::Cache can't be
+// resized, so a new one is started when the capacity changes.
+std::mutex block_cache_mutex;
+size_t block_cache_capacity = kDefaultBlockCacheCapacity;
+std::shared_ptr<leveldb::Cache> block_cache;
+
+// Returns the current block cache, or null if caching is disabled.
+std::shared_ptr<leveldb::Cache> GetBlockCache() {
+  std::unique_lock<std::mutex> lock(block_cache_mutex);
+  if (!block_cache && block_cache_capacity)
+    block_cache.reset(leveldb::NewLRUCache(block_cache_capacity));
+  return block_cache;
+}
+
+// Returns the policy for reading Bloom filters.  Filters record their own
+// number of probes, so the bits per key given here does not matter.
+const leveldb::FilterPolicy* GetBloomFilterPolicy() {
+  static const leveldb::FilterPolicy* policy =
+      leveldb::NewBloomFilterPolicy(10);
+  return policy;
+}
+
+bool GetVarint64(const char*& ptr, const char* end, uint64_t& value) {
+  value = 0;
+  for (unsigned shift = 0; shift < 64 && ptr < end; shift += 7) {
+    const uint8_t byte = *ptr++;
+    value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+uint32_t DecodeFixed32(const char* ptr) {
+  const auto p = reinterpret_cast<const uint8_t*>(ptr);
+  return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+         (uint32_t(p[3]) << 24);
+}
+
+// The filter block written by leveldb::TableBuilder, holding one filter for
+// the keys of each range of data block offsets.  leveldb::Table only
+// consults it in point lookups made by leveldb::DB, so it is read here.
+class LevelDBFilter {
+ public:
+  bool empty() const { return !num_; }
+
+  // Reads the filter of the table in `file', if it has one.  Tables whose
+  // meta index block is compressed are read without a filter.
+  void Load(const leveldb::RandomAccessFile& file, uint64_t file_size) {
+    // The footer starts with the handles of the meta index and index blocks.
+    static const size_t kFooterSize = 48;
+    if (file_size < kFooterSize) return;
+
+    std::string buffer;
+    leveldb::Slice footer;
+    if (!Read(file, file_size - kFooterSize, kFooterSize, buffer, footer))
+      return;
+
+    const char* ptr = footer.data();
+    uint64_t meta_offset, meta_size;
+    if (!GetVarint64(ptr, footer.data() + footer.size(), meta_offset) ||
+        !GetVarint64(ptr, footer.data() + footer.size(), meta_size))
+      return;
+
+    // Blocks are followed by a compression type byte and a checksum.
+    leveldb::Slice meta;
+    if (!Read(file, meta_offset, meta_size + 5, buffer, meta) ||
+        meta[meta_size] != leveldb::kNoCompression)
+      return;
+
+    uint64_t filter_offset, filter_size;
+    const std::string name =
+        std::string("filter.") + GetBloomFilterPolicy()->Name();
+    if (!FindHandle(leveldb::Slice(meta.data(), meta_size), name,
+                    filter_offset, filter_size))
+      return;
+
+    leveldb::Slice contents;
+    if (!Read(file, filter_offset, filter_size, data_, contents)) return;
+    if (contents.data() != data_.data()) data_ = contents.ToString();
+
+    // The filters are followed by their offsets, the offset of the first
+    // offset, and the base 2 logarithm of the block offset range size.
+    const size_t size = data_.size();
+    if (size < 5) return;
+    const uint32_t offsets = DecodeFixed32(&data_[size - 5]);
+    if (offsets > size - 5) return;
+
+    base_lg_ = data_[size - 1];
+    offsets_ = offsets;
+    num_ = (size - 5 - offsets) / 4;
+    data_end_ = meta_offset;
+  }
+
+  // Returns false if `key' is known not to exist in the data block at
+  // `block_offset', as returned by leveldb::Table::ApproximateOffsetOf().
+  bool KeyMayMatch(uint64_t block_offset, const leveldb::Slice& key) const {
+    if (empty()) return true;
+
+    // Keys past the last block map to the end of the data.
+    if (block_offset >= data_end_) return false;
+
+    const uint64_t index = block_offset >> base_lg_;
+    if (index >= num_) return true;
+
+    const uint32_t start = DecodeFixed32(&data_[offsets_ + index * 4]);
+    const uint32_t limit = DecodeFixed32(&data_[offsets_ + index * 4 + 4]);
+    if (start == limit) return false;
+    if (start > limit || limit > offsets_) return true;
+
+    return GetBloomFilterPolicy()->KeyMayMatch(
+        key, leveldb::Slice(&data_[start], limit - start));
+  }
+
+ private:
+  static bool Read(const leveldb::RandomAccessFile& file, uint64_t offset,
+                   size_t size, std::string& buffer, leveldb::Slice& result) {
+    buffer.resize(size);
+    return file.Read(offset, size, &result, &buffer[0]).ok() &&
+           result.size() == size;
+  }
+
+  // Finds the block handle stored under `name' in a meta index block.
+  static bool FindHandle(const leveldb::Slice& block, const std::string& name,
+                         uint64_t& offset, uint64_t& size) {
+    if (block.size() < 4) return false;
+    const uint64_t num_restarts =
+        DecodeFixed32(block.data() + block.size() - 4);
+    if ((num_restarts + 1) * 4 > block.size()) return false;
+
+    const char* ptr = block.data();
+    const char* end = block.data() + block.size() - (num_restarts + 1) * 4;
+
+    // Entries store the length of the prefix shared with the previous key,
+    // and the rest of the key.
+    std::string key;
+    while (ptr < end) {
+      uint64_t shared, non_shared, value_size;
+      if (!GetVarint64(ptr, end, shared) ||
+          !GetVarint64(ptr, end, non_shared) ||
+          !GetVarint64(ptr, end, value_size) || shared > key.size() ||
+          non_shared + value_size > uint64_t(end - ptr))
+        return false;
+
+      key.resize(shared);
+      key.append(ptr, non_shared);
+      ptr += non_shared;
+
+      if (key == name) {
+        const char* value_end = ptr + value_size;
+        return GetVarint64(ptr, value_end, offset) &&
+               GetVarint64(ptr, value_end, size);
+      }
+
+      ptr += value_size;
+    }
+
+    return false;
+  }
+
+  std::string data_;
+
+  // Start of the filter offsets, and their number.
+  size_t offsets_ = 0;
+  size_t num_ = 0;
+
+  uint8_t base_lg_ = 0;
+
+  // Offset of the first byte after the data blocks.
+  uint64_t data_end_ = 0;
+};
+
+/*****************************************************************************/
+
 class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
  public:
   LevelDBTable(const char* path, kj::AutoCloseFd fd, const struct stat& st)
-      : Table(st), fd_(std::move(fd)) {
+      : Table(st), fd_(std::move(fd)), block_cache_(GetBlockCache()) {
+    // Uncompressed blocks are then used in place, rather than copied.
+    if (memory_mapping_enabled && st.st_size > 0) {
+      void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+      if (map == MAP_FAILED) KJ_FAIL_SYSCALL("mmap", errno, path);
+      map_ = static_cast<const char*>(map);
+    }
+
+    leveldb::Options options;
+    options.block_cache = block_cache_.get();
+
     leveldb::Table* table;
-    CHECK_STATUS(
-        leveldb::Table::Open(leveldb::Options(), this, st.st_size, &table));
+    CHECK_STATUS(leveldb::Table::Open(options, this, st.st_size, &table));
     table_.reset(table);
 
+    filter_.Load(*this, st.st_size);
+
     iterator_.reset(table_->NewIterator(leveldb::ReadOptions()));
     iterator_->SeekToFirst();
     if (!iterator_->Valid()) eof_ = true;
@@ -161,6 +365,9 @@ class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
 
   ~LevelDBTable() noexcept {
     try {
+      iterator_.reset();
+      table_.reset();
+      if (map_) munmap(const_cast<char*>(map_), st.st_size);
       fd_ = nullptr;
     } catch (...) {
     }
@@ -179,6 +386,46 @@ class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
     return SeekToKey(leveldb::Slice(key.data(), key.size()));
   }
 
+  void SeekToKeys(const std::vector<string_view>& keys,
+                  const std::function<void(size_t index)>& callback) override {
+    // The index block gives the offset of each key's data block.  LevelDB
+    // blocks hold at least `block_size' bytes, so that much is requested.
+    // Keys ruled out by the filter are skipped.
+    const size_t block_size = leveldb::Options().block_size;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    std::vector<bool> may_match(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      KJ_REQUIRE(!i || keys[i - 1] <= keys[i], "keys must be sorted");
+      const leveldb::Slice key(keys[i].data(), keys[i].size());
+      const uint64_t offset = table_->ApproximateOffsetOf(key);
+      if (!filter_.KeyMayMatch(offset, key)) continue;
+      may_match[i] = true;
+      if (ranges.empty() || ranges.back().first != offset)
+        ranges.emplace_back(offset, offset + block_size);
+    }
+    AdviseWillNeed(fd_, ranges);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (!may_match[i]) continue;
+
+      const leveldb::Slice key(keys[i].data(), keys[i].size());
+
+      // Keys are often adjacent in the table, in which case stepping the
+      // iterator is cheaper than seeking.
+      if (need_seek_) {
+        iterator_->Next();
+        need_seek_ = false;
+        eof_ = !iterator_->Valid();
+      }
+
+      if (eof_ || key.compare(iterator_->key()) != 0) {
+        if (!SeekToKey(key)) continue;
+      }
+
+      callback(i);
+    }
+  }
+
   bool Skip(size_t count) override {
     while (count-- > 0) {
       if (eof_) return false;
@@ -194,6 +441,35 @@ class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
     return true;
   }
 
+  bool Get(const string_view& key,
+           const std::function<void(const string_view& value)>& callback)
+      const override {
+    // leveldb::Table supports concurrent iterators, so each call gets its
+    // own.
+    std::unique_ptr<leveldb::Iterator> iterator(
+        table_->NewIterator(leveldb::ReadOptions()));
+    return Get(iterator.get(), key, callback);
+  }
+
+  void MultiGet(const std::vector<string_view>& keys,
+                const std::function<void(size_t index,
+                                         const string_view& value)>& callback)
+      const override {
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&keys](size_t lhs, size_t rhs) {
+                       return keys[lhs] < keys[rhs];
+                     });
+
+    std::unique_ptr<leveldb::Iterator> iterator(
+        table_->NewIterator(leveldb::ReadOptions()));
+    for (size_t i : order) {
+      Get(iterator.get(), keys[i],
+          [&callback, i](const string_view& value) { callback(i, value); });
+    }
+  }
+
   bool ReadRow(string_view& key, string_view& value) {
     if (need_seek_) {
       iterator_->Next();
@@ -224,8 +500,33 @@ class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
     return 0 == key.compare(iterator_->key());
   }
 
+  bool Get(leveldb::Iterator* iterator, const string_view& key,
+           const std::function<void(const string_view& value)>& callback)
+      const {
+    const leveldb::Slice slice(key.data(), key.size());
+    if (!filter_.empty() &&
+        !filter_.KeyMayMatch(table_->ApproximateOffsetOf(slice), slice))
+      return false;
+
+    iterator->Seek(slice);
+    CHECK_STATUS(iterator->status());
+    if (!iterator->Valid() || slice.compare(iterator->key())) return false;
+
+    auto value = iterator->value();
+    callback(string_view(value.data(), value.size()));
+    return true;
+  }
+
   leveldb::Status Read(uint64_t offset, size_t n, leveldb::Slice* result,
                        char* scratch) const override {
+    if (map_) {
+      if (offset > uint64_t(st.st_size))
+        return leveldb::Status::IOError("read past end of file");
+      *result = leveldb::Slice(map_ + offset,
+                               std::min<uint64_t>(n, st.st_size - offset));
+      return leveldb::Status::OK();
+    }
+
     auto amount_read = pread(fd_, scratch, n, offset);
     if (amount_read < 0)
       return leveldb::Status::IOError("pread failed", strerror(errno));
@@ -234,7 +535,13 @@ class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
   }
 
   kj::AutoCloseFd fd_;
+
+  // The whole file, if memory mapped.
+  const char* map_ = nullptr;
+
+  std::shared_ptr<leveldb::Cache> block_cache_;
   std::unique_ptr<leveldb::Table> table_;
+  LevelDBFilter filter_;
   std::unique_ptr<leveldb::Iterator> iterator_;
   bool need_seek_ = false;
   bool eof_ = false;
@@ -244,6 +551,12 @@ class LevelDBTable final : public Table, private leveldb::RandomAccessFile {
 
 /*****************************************************************************/
 
+void LevelDBTableBackend::SetBlockCacheCapacity(size_t capacity) {
+  std::unique_lock<std::mutex> lock(block_cache_mutex);
+  block_cache_capacity = capacity;
+  block_cache.reset();
+}
+
 std::unique_ptr<TableBuilder> LevelDBTableBackend::Create(
     const char* path, const TableOptions& options) {
   return std::make_unique<LevelDBBuilder>(path, options);
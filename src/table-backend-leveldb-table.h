@@ -9,6 +9,9 @@ namespace internal {
 
 class LevelDBTableBackend final : public Backend {
  public:
+  // Sets the capacity of the backend's process-wide block cache.
+  static void SetBlockCacheCapacity(size_t capacity);
+
   std::unique_ptr<TableBuilder> Create(const char* path,
                                        const TableOptions& options) override;
 
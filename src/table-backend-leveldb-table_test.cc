@@ -61,6 +61,96 @@ TEST_F(LevelDBTest, CanWriteThenRead) {
   EXPECT_TRUE(table_handle->SeekToKey("b"));
 }
 
+TEST_F(LevelDBTest, GetAndMultiGet) {
+  auto builder = TableFactory::Create(
+      "leveldb-table", (temp_directory_ + "/table_00").c_str(), TableOptions());
+  builder->InsertRow("a", "xxx");
+  builder->InsertRow("b", "yyy");
+  builder->InsertRow("c", "zzz");
+  builder->Sync();
+
+  auto table_handle = TableFactory::Open(
+      "leveldb-table", (temp_directory_ + "/table_00").c_str());
+  std::string value;
+  auto save_value = [&value](const cantera::string_view& v) {
+    value = v.to_string();
+  };
+  EXPECT_TRUE(table_handle->Get("b", save_value));
+  EXPECT_EQ("yyy", value);
+  EXPECT_FALSE(table_handle->Get("bb", save_value));
+  EXPECT_FALSE(table_handle->Get("d", save_value));
+
+  std::vector<std::string> values(4);
+  table_handle->MultiGet(
+      {"c", "x", "a", "b"},
+      [&values](size_t index, const cantera::string_view& v) {
+        values[index] = v.to_string();
+      });
+  EXPECT_EQ((std::vector<std::string>{"zzz", "", "xxx", "yyy"}), values);
+}
+
+TEST_F(LevelDBTest, SeekToKeys) {
+  auto builder = TableFactory::Create(
+      "leveldb-table", (temp_directory_ + "/table_00").c_str(), TableOptions());
+  builder->InsertRow("a", "xxx");
+  builder->InsertRow("b", "yyy");
+  builder->InsertRow("c", "zzz");
+  builder->Sync();
+
+  auto table_handle = TableFactory::Open(
+      "leveldb-table", (temp_directory_ + "/table_00").c_str());
+  std::vector<std::string> values(5);
+  table_handle->SeekToKeys({"a", "b", "b", "bb", "c"}, [&](size_t index) {
+    cantera::string_view k, v;
+    ASSERT_TRUE(table_handle->ReadRow(k, v));
+    values[index] = v.to_string();
+  });
+  EXPECT_EQ((std::vector<std::string>{"xxx", "yyy", "yyy", "", "zzz"}),
+            values);
+}
+
+TEST_F(LevelDBTest, FilterCacheAndMemoryMapping) {
+  for (auto compression : {kTableCompressionNone, kTableCompressionDefault}) {
+    const std::string path =
+        temp_directory_ + "/table_" + std::to_string(compression);
+    auto builder = TableFactory::Create(
+        "leveldb-table", path.c_str(),
+        TableOptions().SetCompression(compression).SetFilterBitsPerKey(10));
+    char key[16];
+    for (int i = 0; i < 10000; i += 2) {
+      snprintf(key, sizeof(key), "%06d", i);
+      builder->InsertRow(key, std::to_string(i * 3));
+    }
+    builder->Sync();
+    builder.reset();
+
+    const auto capacity = GetBlockCacheStatistics().capacity;
+    for (bool memory_mapping : {false, true}) {
+      for (size_t cache_capacity : {size_t(0), capacity}) {
+        SetTableMemoryMapping(memory_mapping);
+        SetBlockCacheCapacity(cache_capacity);
+        auto table_handle = TableFactory::Open("leveldb-table", path.c_str());
+
+        for (int i = 0; i < 10001; ++i) {
+          snprintf(key, sizeof(key), "%06d", i);
+          std::string value;
+          const bool found = table_handle->Get(
+              key, [&value](const cantera::string_view& v) {
+                value = v.to_string();
+              });
+          ASSERT_EQ(i % 2 == 0 && i < 10000, found) << key;
+          if (found) EXPECT_EQ(std::to_string(i * 3), value);
+        }
+
+        EXPECT_TRUE(table_handle->SeekToKey("000100"));
+        EXPECT_FALSE(table_handle->SeekToKey("000101"));
+      }
+    }
+    SetTableMemoryMapping(true);
+    SetBlockCacheCapacity(capacity);
+  }
+}
+
 TEST_F(LevelDBTest, EmptyTableOK) {
   auto builder = TableFactory::Create(
       "leveldb-table", (temp_directory_ + "/table_00").c_str(), TableOptions());
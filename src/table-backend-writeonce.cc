@@ -24,15 +24,24 @@
 #include "src/table-backend-writeonce.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <climits>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <thread>
+#include <unordered_map>
 
 #include <err.h>
 #include <fcntl.h>
@@ -45,10 +54,12 @@
 
 #include <kj/debug.h>
 
+#include <zdict.h>
 #include <zstd.h>
 
 #include "src/util.h"
 
+#include "third_party/evenk/evenk/synch_queue.h"
 #include "third_party/oroch/oroch/integer_codec.h"
 
 #define MAGIC UINT64_C(0x6c6261742e692e70)
@@ -69,6 +80,7 @@ enum CA_wo_flags {
   // v4 flags
   CA_WO_FLAG_SEEKABLE = 0x01,
   CA_WO_FLAG_EXTENDED = 0x02,
+  CA_WO_FLAG_PREFIXED_KEYS = 0x04,
 };
 
 struct CA_wo_header {
@@ -81,6 +93,23 @@ struct CA_wo_header {
   uint64_t index_offset;
 };
 
+// Extended v4 tables store additional sections after the index.  They are
+// listed in a directory, which is located through a trailer at the very end
+// of the file.
+enum CA_wo_section_type : uint32_t {
+  CA_WO_SECTION_INDEX = 1,
+  CA_WO_SECTION_FILTER = 2,
+  CA_WO_SECTION_RESTARTS = 3,
+  CA_WO_SECTION_DICTIONARY = 4,
+  CA_WO_SECTION_STATISTICS = 5,
+  CA_WO_SECTION_KEY_STATISTICS = 6,
+};
+
+struct CA_wo_trailer {
+  uint64_t directory_offset;
+  uint64_t magic;
+};
+
 /*****************************************************************************/
 
 // If a block gets larger than this value then it is closed.
@@ -95,6 +124,25 @@ static constexpr size_t kEntrySizeLimit = kBlockSizeMax - 4;
 // really stored in a separate block.
 static constexpr size_t kBlockSizeMin = 12 * 1024;
 
+// Seekable tables record the offset of every this many entries in a block.
+static constexpr uint32_t kSeekableRestartInterval = 16;
+
+// Compressed seekable tables address entries by virtual offsets, holding the
+// block number above this many bits, and the entry number within the block
+// below them.  Blocks are closed before their entry numbers overflow.
+static constexpr unsigned kVirtualOffsetEntryBits = 16;
+static constexpr uint32_t kVirtualOffsetEntryMask =
+    (UINT32_C(1) << kVirtualOffsetEntryBits) - 1;
+
+// Compression dictionaries are trained on this many times their size worth
+// of leading blocks.  Larger blocks are not used as samples.
+static constexpr size_t kDictionarySampleRatio = 100;
+static constexpr size_t kDictionarySampleSizeMax = 128 * 1024;
+
+// Builders hold this many key statistics records in memory before spilling
+// them to a temporary file.
+static constexpr size_t kKeyStatisticsBufferRecords = 4096;
+
 /*****************************************************************************/
 
 class DataBuffer {
@@ -244,6 +292,15 @@ class ZstdCompressor {
     dst.resize(size);
   }
 
+  void Go(DataBuffer& dst, const DataBuffer& src, const ZSTD_CDict* dict) {
+    size_t size = ZSTD_compress_usingCDict(context_.get(), dst.data(),
+                                           dst.capacity(), src.data(),
+                                           src.size(), dict);
+    if (ZSTD_isError(size))
+      KJ_FAIL_REQUIRE("compression error", ZSTD_getErrorName(size));
+    dst.resize(size);
+  }
+
  private:
   // Compression context.
   typedef std::unique_ptr<ZSTD_CCtx, decltype(ZSTD_freeCCtx)*> ContextPtr;
@@ -266,6 +323,15 @@ class ZstdDecompressor {
     dst.resize(size);
   }
 
+  void Go(DataBuffer& dst, const DataBuffer& src, const ZSTD_DDict* dict) {
+    size_t size =
+        ZSTD_decompress_usingDDict(context_.get(), dst.data(), dst.capacity(),
+                                   src.data(), src.size(), dict);
+    if (ZSTD_isError(size))
+      KJ_FAIL_REQUIRE("decompression error", ZSTD_getErrorName(size));
+    dst.resize(size);
+  }
+
  private:
   // Decompression context.
   using ContextPtr = std::unique_ptr<ZSTD_DCtx, decltype(ZSTD_freeDCtx)*>;
@@ -278,6 +344,144 @@ class ZstdDecompressor {
   }
 };
 
+// A zstd dictionary, prepared for compression or decompression.
+class ZstdDictionary {
+ public:
+  bool empty() const { return data_.empty(); }
+
+  void clear() {
+    data_.clear();
+    cdict_.reset();
+    ddict_.reset();
+  }
+
+  const std::vector<char>& data() const { return data_; }
+
+  const ZSTD_CDict* cdict() const { return cdict_.get(); }
+  const ZSTD_DDict* ddict() const { return ddict_.get(); }
+
+  // Trains a dictionary of at most `size' bytes on the given samples.
+  // Leaves the dictionary empty if the samples are unsuitable.
+  void Train(size_t size, const std::vector<char>& samples,
+             const std::vector<size_t>& sample_sizes, int level) {
+    data_.resize(size);
+    size = ZDICT_trainFromBuffer(data_.data(), data_.size(), samples.data(),
+                                 sample_sizes.data(), sample_sizes.size());
+    if (ZDICT_isError(size)) {
+      data_.clear();
+      return;
+    }
+    data_.resize(size);
+
+    cdict_.reset(ZSTD_createCDict(data_.data(), data_.size(), level));
+    if (!cdict_) KJ_FAIL_REQUIRE("out of memory");
+  }
+
+  void Load(const DataBuffer& buffer) {
+    data_.assign(buffer.data(), buffer.data() + buffer.size());
+
+    ddict_.reset(ZSTD_createDDict(data_.data(), data_.size()));
+    if (!ddict_) KJ_FAIL_REQUIRE("out of memory");
+  }
+
+ private:
+  std::vector<char> data_;
+
+  std::unique_ptr<ZSTD_CDict, decltype(ZSTD_freeCDict)*> cdict_{
+      nullptr, ZSTD_freeCDict};
+  std::unique_ptr<ZSTD_DDict, decltype(ZSTD_freeDDict)*> ddict_{
+      nullptr, ZSTD_freeDDict};
+};
+
+// A marshaled block on its way to being compressed and written.
+struct PendingBlock {
+  DataBuffer input;
+  DataBuffer output;
+
+  // Index information for the block.
+  std::string last_key;
+  uint32_t num_entries = 0;
+};
+
+// Compresses blocks on a pool of threads, handing them back in the order
+// they were submitted.
+class ParallelZstdCompressor {
+ public:
+  ParallelZstdCompressor(unsigned num_threads, int level) : level_(level) {
+    for (unsigned i = 0; i < num_threads; ++i)
+      threads_.emplace_back([this] { Run(); });
+  }
+
+  ~ParallelZstdCompressor() {
+    queue_.close();
+    for (auto& thread : threads_) thread.join();
+  }
+
+  // Returns the number of submitted blocks not yet taken back.
+  size_t pending() const { return jobs_.size(); }
+
+  // Returns true if enough blocks are pending to keep all threads busy.
+  bool full() const { return jobs_.size() >= 2 * threads_.size(); }
+
+  void Submit(std::unique_ptr<PendingBlock> block,
+              const ZSTD_CDict* dict = nullptr) {
+    auto job = std::make_unique<Job>();
+    job->block = std::move(block);
+    job->dict = dict;
+    queue_.push(job.get());
+    jobs_.emplace_back(std::move(job));
+  }
+
+  // Waits for the oldest pending block to be compressed and returns it.
+  std::unique_ptr<PendingBlock> Next() {
+    KJ_REQUIRE(!jobs_.empty());
+
+    auto job = std::move(jobs_.front());
+    jobs_.pop_front();
+
+    job->done.get_future().get();
+    return std::move(job->block);
+  }
+
+ private:
+  struct Job {
+    std::unique_ptr<PendingBlock> block;
+
+    // Compression dictionary, if any.
+    const ZSTD_CDict* dict = nullptr;
+
+    std::promise<void> done;
+  };
+
+  void Run() {
+    ZstdCompressor compressor;
+    Job* job;
+    while (queue_.wait_pop(job) == evenk::queue_op_status::success) {
+      try {
+        PendingBlock& block = *job->block;
+        block.output.reserve(ZSTD_compressBound(block.input.size()));
+        if (job->dict)
+          compressor.Go(block.output, block.input, job->dict);
+        else
+          compressor.Go(block.output, block.input, level_);
+        job->done.set_value();
+      } catch (...) {
+        job->done.set_exception(std::current_exception());
+      }
+    }
+  }
+
+  const int level_;
+
+  // Jobs waiting for a thread.  The number of pending jobs is bounded by
+  // the caller through full().
+  evenk::synch_queue<Job*> queue_;
+  std::vector<std::thread> threads_;
+
+  // Submitted jobs, oldest first.
+  std::deque<std::unique_ptr<Job>> jobs_;
+};
+
 /*****************************************************************************/
 
 class WriteOnceBlock {
@@ -354,40 +558,52 @@ class WriteOnceBlock {
     }
   }
 
-  void Unmarshal(DataBuffer& buffer, size_t num, bool seekable) {
-    Clear();
+  // Marshals the block with each key stored as the length of the prefix it
+  // shares with the preceding key, followed by the remaining suffix.  Every
+  // `restart_interval' keys the full key is stored, so that lookups can
+  // binary search those.  Only used with the non-seekable format.
+  void MarshalPrefixed(DataBuffer& buffer, uint32_t restart_interval) const {
+    buffer.clear();
 
+    const size_t num = num_entries();
     if (!num) return;
 
-    const unsigned char* ptr = buffer.udata();
-    if (!seekable) {
-      key_size_.resize(num);
-      value_size_.resize(num);
+    std::vector<uint32_t> shared_size(num), suffix_size(num);
+    std::vector<char> suffix_data;
+    suffix_data.reserve(key_data_.size());
 
-      array_codec::decode(key_size_.begin(), key_size_.end(), ptr);
-      array_codec::decode(value_size_.begin(), value_size_.end(), ptr);
+    string_view prev_key;
+    size_t k_offset = 0;
+    for (size_t i = 0; i < num; i++) {
+      const string_view key(key_data_.data() + k_offset, key_size_[i]);
+      k_offset += key.size();
 
-      size_t k_total =
-          std::accumulate(key_size_.begin(), key_size_.end(), size_t(0));
-      size_t v_total =
-          std::accumulate(value_size_.begin(), value_size_.end(), size_t(0));
-      KJ_REQUIRE((ptr + k_total + v_total) <= (buffer.udata() + buffer.size()));
-
-      key_data_.insert(key_data_.end(), ptr, ptr + k_total);
-      ptr += k_total;
-      value_data_.insert(value_data_.end(), ptr, ptr + v_total);
-    } else {
-      for (size_t i = 0; i < num; i++) {
-        size_t k_size = value_codec::value_decode(ptr);
-        size_t v_size = value_codec::value_decode(ptr);
-        key_size_.push_back(k_size);
-        value_size_.push_back(v_size);
-        key_data_.insert(key_data_.end(), ptr, ptr + k_size);
-        ptr += k_size;
-        value_data_.insert(value_data_.end(), ptr, ptr + v_size);
-        ptr += v_size;
+      size_t shared = 0;
+      if (i % restart_interval) {
+        const size_t limit = std::min(key.size(), prev_key.size());
+        while (shared < limit && key[shared] == prev_key[shared]) ++shared;
       }
+
+      shared_size[i] = shared;
+      suffix_size[i] = key.size() - shared;
+      suffix_data.insert(suffix_data.end(), key.begin() + shared, key.end());
+      prev_key = key;
     }
+
+    buffer.reserve(array_codec::space(shared_size.begin(), shared_size.end()) +
+                   array_codec::space(suffix_size.begin(), suffix_size.end()) +
+                   array_codec::space(value_size_.begin(), value_size_.end()) +
+                   value_codec::value_space(restart_interval) +
+                   suffix_data.size() + value_data_.size());
+
+    unsigned char* ptr = buffer.udata();
+    value_codec::value_encode(ptr, restart_interval);
+    array_codec::encode(ptr, shared_size.begin(), shared_size.end());
+    array_codec::encode(ptr, suffix_size.begin(), suffix_size.end());
+    array_codec::encode(ptr, value_size_.begin(), value_size_.end());
+    buffer.resize(ptr - buffer.udata());
+    buffer.append(suffix_data);
+    buffer.append(value_data_);
   }
 
   // NB: This requires seekable block format.
@@ -401,6 +617,18 @@ class WriteOnceBlock {
     return offset;
   }
 
+  // Appends the offsets of every `interval'th entry, starting with the first.
+  // NB: This requires seekable block format.
+  void GetEntryOffsets(uint32_t interval, std::vector<uint32_t>& offsets) const {
+    size_t offset = 0;
+    for (uint32_t i = 0; i < num_entries(); i++) {
+      if (i % interval == 0) offsets.push_back(offset);
+      uint32_t ks = key_size_[i], vs = value_size_[i];
+      offset += value_codec::value_space(ks) + ks;
+      offset += value_codec::value_space(vs) + vs;
+    }
+  }
+
   // NB: This requires seekable block format.
   uint32_t GetEntryNumber(ssize_t offset) {
     uint32_t n = 0;
@@ -420,67 +648,294 @@ class WriteOnceBlock {
   // Accumulated value data.
   std::vector<uint32_t> value_size_;
   std::vector<char> value_data_;
+};
+
+/*****************************************************************************/
 
+// Returns the first 8 bytes of `key' as a big-endian integer, padded with
+// zeros, so that integer order agrees with key order.
+uint64_t GetKeyPrefix(const string_view& key) {
+  uint64_t result = 0;
+  const size_t size = std::min<size_t>(key.size(), 8);
+  for (size_t i = 0; i < size; i++)
+    result |= uint64_t(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+  return result;
+}
+
+/*****************************************************************************/
+
+// A block read back from a v4 table.  It is immutable once constructed, so a
+// single instance may be shared by all handles through the block cache.
+class WriteOnceReadBlock {
  public:
-  class Cache {
-   public:
-    Cache(const WriteOnceBlock& block) : block_(block) {}
+  // Full keys reconstructed from a prefix-compressed block.  Each table handle
+  // owns one, since blocks are shared.
+  struct KeyBuffer {
+    const WriteOnceReadBlock* block = nullptr;
+    uint32_t num = 0;
+    std::string key;
+  };
 
-    void Clear() {
-      keys_.clear();
-      values_.clear();
-    }
+  // Decodes a block from a temporary buffer, copying its key and value data.
+  WriteOnceReadBlock(const DataBuffer& buffer, size_t num_entries,
+                     bool prefixed)
+      : data_(buffer.data(), buffer.data() + buffer.size()) {
+    Decode(data_.data(), data_.size(), num_entries, prefixed);
+  }
+
+  // Decodes a block residing in a memory mapping.  Only the size arrays are
+  // decoded; keys and values point straight into the mapping, which is kept
+  // alive for as long as the block exists.
+  WriteOnceReadBlock(std::shared_ptr<const char> map, uint64_t offset,
+                     size_t size, size_t num_entries, bool prefixed)
+      : map_(std::move(map)) {
+    Decode(map_.get() + offset, size, num_entries, prefixed);
+  }
 
-    uint32_t FindEntryByKey(const string_view& key) {
-      if (keys_.empty()) InitializeKeys();
+  WriteOnceReadBlock(const WriteOnceReadBlock&) = delete;
+  WriteOnceReadBlock& operator=(const WriteOnceReadBlock&) = delete;
+
+  // Returns the approximate amount of memory held by this block.
+  size_t Charge() const {
+    return sizeof(*this) + data_.size() +
+           (keys_.size() + values_.size()) * sizeof(string_view) +
+           shared_size_.size() * sizeof(uint32_t);
+  }
+
+  // Returns the number of the first entry not less than `key'.
+  uint32_t FindEntryByKey(const string_view& key, KeyBuffer& buffer) const {
+    if (!restart_interval_) {
       auto pos = std::lower_bound(keys_.begin(), keys_.end(), key);
       return std::distance(keys_.begin(), pos);
     }
 
-    string_view GetKey(uint32_t num) {
-      if (keys_.empty()) InitializeKeys();
-      return keys_[num];
+    // Keys at restart points are stored in full.  Find the last one not
+    // greater than `key', and scan forward from there.
+    const uint32_t num_restarts =
+        (keys_.size() + restart_interval_ - 1) / restart_interval_;
+    uint32_t lo = 0, hi = num_restarts;
+    while (lo < hi) {
+      const uint32_t mid = lo + (hi - lo) / 2;
+      if (keys_[mid * restart_interval_] <= key)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
+    if (lo == 0) return 0;
 
-    string_view GetValue(uint32_t num) {
-      if (values_.empty()) InitializeValues();
-      return values_[num];
+    const uint32_t begin = (lo - 1) * restart_interval_;
+    const uint32_t end = std::min<uint32_t>(begin + restart_interval_,
+                                            keys_.size());
+    for (uint32_t num = begin; num < end; ++num) {
+      if (GetKey(num, buffer) >= key) return num;
     }
+    return end;
+  }
 
-   private:
-    void InitializeKeys() {
-      size_t num = block_.num_entries();
-      if (num == 0) return;
+  string_view GetKey(uint32_t num, KeyBuffer& buffer) const {
+    if (!restart_interval_) return keys_[num];
 
-      keys_.resize(num);
+    // Continue from the key held in the buffer if it precedes this one in
+    // the same restart interval, otherwise start over at the restart point.
+    uint32_t restart = num - num % restart_interval_;
+    if (buffer.block != this || buffer.num > num || buffer.num < restart) {
+      buffer.block = this;
+      buffer.num = restart;
+      buffer.key.assign(keys_[restart].data(), keys_[restart].size());
+    }
+    while (buffer.num < num) {
+      ++buffer.num;
+      buffer.key.resize(shared_size_[buffer.num]);
+      buffer.key.append(keys_[buffer.num].data(), keys_[buffer.num].size());
+    }
 
-      size_t offset = 0;
-      for (size_t i = 0; i < num; i++) {
-        size_t size = block_.key_size_[i];
-        keys_[i] = string_view(block_.key_data_.data() + offset, size);
-        offset += size;
-      }
+    return buffer.key;
+  }
+
+  string_view GetValue(uint32_t num) const { return values_[num]; }
+
+ private:
+  void Decode(const char* data, size_t size, size_t num, bool prefixed) {
+    if (!num) return;
+
+    auto ptr = reinterpret_cast<const unsigned char*>(data);
+
+    if (prefixed) {
+      restart_interval_ = WriteOnceBlock::value_codec::value_decode(ptr);
+      KJ_REQUIRE(restart_interval_ > 0);
+
+      shared_size_.resize(num);
+      WriteOnceBlock::array_codec::decode(shared_size_.begin(),
+                                          shared_size_.end(), ptr);
     }
 
-    void InitializeValues() {
-      size_t num = block_.num_entries();
-      if (num == 0) return;
+    std::vector<uint32_t> key_size(num), value_size(num);
+    WriteOnceBlock::array_codec::decode(key_size.begin(), key_size.end(), ptr);
+    WriteOnceBlock::array_codec::decode(value_size.begin(), value_size.end(),
+                                        ptr);
+
+    size_t k_total =
+        std::accumulate(key_size.begin(), key_size.end(), size_t(0));
+    size_t v_total =
+        std::accumulate(value_size.begin(), value_size.end(), size_t(0));
+    auto key_data = reinterpret_cast<const char*>(ptr);
+    KJ_REQUIRE(key_data + k_total + v_total <= data + size);
+    auto value_data = key_data + k_total;
+
+    keys_.resize(num);
+    values_.resize(num);
+    for (size_t i = 0; i < num; i++) {
+      keys_[i] = string_view(key_data, key_size[i]);
+      key_data += key_size[i];
+      values_[i] = string_view(value_data, value_size[i]);
+      value_data += value_size[i];
+    }
 
-      values_.resize(num);
+    for (size_t i = 0; i < shared_size_.size(); i += restart_interval_)
+      KJ_REQUIRE(shared_size_[i] == 0);
+  }
 
-      size_t offset = 0;
-      for (size_t i = 0; i < num; i++) {
-        size_t size = block_.value_size_[i];
-        values_[i] = string_view(block_.value_data_.data() + offset, size);
-        offset += size;
-      }
+  // The memory mapping holding the block, if any.
+  std::shared_ptr<const char> map_;
+
+  // Block data copied out of a temporary buffer, if not memory mapped.
+  std::vector<char> data_;
+
+  // Keys and values.  In prefix-compressed blocks only the keys at restart
+  // points are complete; the rest are suffixes following `shared_size_'
+  // bytes of the preceding key.
+  std::vector<string_view> keys_;
+  std::vector<string_view> values_;
+
+  uint32_t restart_interval_ = 0;
+  std::vector<uint32_t> shared_size_;
+};
+
+/*****************************************************************************/
+
+// Process-wide LRU cache of decoded v4 blocks.  Blocks are identified by the
+// file they were read from and their number within it, so all handles opened
+// on the same table share them.
+class WriteOnceBlockCache {
+ public:
+  using BlockPtr = std::shared_ptr<const WriteOnceReadBlock>;
+
+  struct Key {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime;
+    uint64_t block;
+
+    bool operator==(const Key& rhs) const {
+      return dev == rhs.dev && ino == rhs.ino && size == rhs.size &&
+             mtime == rhs.mtime && block == rhs.block;
     }
+  };
 
-    const WriteOnceBlock& block_;
+  static Key MakeKey(const struct stat& st, uint64_t block) {
+    Key key;
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.size = st.st_size;
+    key.mtime = st.st_mtim.tv_sec * INT64_C(1000000000) + st.st_mtim.tv_nsec;
+    key.block = block;
+    return key;
+  }
 
-    std::vector<string_view> keys_;
-    std::vector<string_view> values_;
+  static WriteOnceBlockCache& GetInstance() {
+    static WriteOnceBlockCache instance;
+    return instance;
+  }
+
+  BlockPtr Lookup(const Key& key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto i = map_.find(key);
+    if (i == map_.end()) {
+      ++misses_;
+      return nullptr;
+    }
+
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, i->second);
+    return i->second->block;
+  }
+
+  void Insert(const Key& key, BlockPtr block) {
+    const size_t charge = block->Charge();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (charge > capacity_ || map_.count(key)) return;
+
+    lru_.push_front(Entry{key, std::move(block), charge});
+    map_.emplace(key, lru_.begin());
+    size_ += charge;
+
+    Evict();
+  }
+
+  void SetCapacity(size_t capacity) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    Evict();
+  }
+
+  BlockCacheStatistics GetStatistics() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    BlockCacheStatistics result;
+    result.hits = hits_;
+    result.misses = misses_;
+    result.evictions = evictions_;
+    result.size = size_;
+    result.capacity = capacity_;
+    return result;
+  }
+
+ private:
+  static const size_t kDefaultCapacity = 64 * 1024 * 1024;
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      uint64_t hash = key.block;
+      for (uint64_t v : {uint64_t(key.dev), uint64_t(key.ino),
+                         uint64_t(key.size), uint64_t(key.mtime)})
+        hash = hash * UINT64_C(0x9e3779b97f4a7c15) + v;
+      return hash ^ (hash >> 29);
+    }
   };
+
+  struct Entry {
+    Key key;
+    BlockPtr block;
+    size_t charge;
+  };
+
+  // Drops the least recently used blocks until the cache fits its capacity.
+  // Handles still holding a dropped block keep it alive until they move on.
+  void Evict() {
+    while (size_ > capacity_) {
+      const Entry& entry = lru_.back();
+      size_ -= entry.charge;
+      map_.erase(entry.key);
+      lru_.pop_back();
+      ++evictions_;
+    }
+  }
+
+  std::mutex mutex_;
+
+  // Cached blocks, most recently used first.
+  std::list<Entry> lru_;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map_;
+
+  size_t size_ = 0;
+  size_t capacity_ = kDefaultCapacity;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
 };
 
 /*****************************************************************************/
@@ -517,14 +972,17 @@ class WriteOnceIndex {
     return std::accumulate(size_.begin(), size_.begin() + num, offset);
   }
 
-  size_t GetBlockSize(size_t block) { return size_[block]; }
+  size_t GetBlockSize(size_t block) const { return size_[block]; }
 
-  uint32_t GetNumEntries(size_t block) { return num_entries_[block]; }
+  uint32_t GetNumEntries(size_t block) const { return num_entries_[block]; }
 
   void Add(const WriteOnceBlock& block, uint32_t size) {
-    string_view last_key = block.GetLaskKey();
+    Add(block.GetLaskKey(), block.num_entries(), size);
+  }
+
+  void Add(const string_view& last_key, uint32_t num_entries, uint32_t size) {
     size_.push_back(size);
-    num_entries_.push_back(block.num_entries());
+    num_entries_.push_back(num_entries);
     key_size_.push_back(last_key.size());
     key_data_.insert(key_data_.end(), last_key.begin(), last_key.end());
   }
@@ -587,62 +1045,528 @@ class WriteOnceIndex {
   std::vector<char> key_data_;
 
  public:
+  // Search structures over the index, built once after it has been read.
+  // The last keys of the blocks are searched through their 8-byte prefixes
+  // laid out in Eytzinger (breadth-first) order, so that the first levels of
+  // every search share a few cache lines.  Full keys are only compared when
+  // prefixes are equal.
   class Cache {
    public:
     Cache(const WriteOnceIndex& index) : index_(index) {}
 
-    uint64_t FindBlockByKey(const string_view& key) {
-      if (keys_.empty()) InitializeKeys();
-      auto pos = std::lower_bound(keys_.begin(), keys_.end(), key);
-      return std::distance(keys_.begin(), pos);
-    }
-
-    uint64_t GetBlockOffset(size_t num) {
-      if (blocks_.empty()) InitializeBlocks();
-      return blocks_[num];
-    }
-
-   private:
-    void InitializeKeys() {
-      size_t num = index_.num_blocks();
-      if (num == 0) return;
+    void Build() {
+      const size_t num = index_.num_blocks();
 
       keys_.resize(num);
+      blocks_.resize(num);
 
-      size_t offset = 0;
+      size_t key_offset = 0;
+      uint64_t block_offset = sizeof(struct CA_wo_header);
       for (size_t i = 0; i < num; i++) {
-        size_t size = index_.key_size_[i];
-        keys_[i] = string_view(index_.key_data_.data() + offset, size);
-        offset += size;
+        const size_t size = index_.key_size_[i];
+        keys_[i] = string_view(index_.key_data_.data() + key_offset, size);
+        key_offset += size;
+
+        blocks_[i] = block_offset;
+        block_offset += index_.size_[i];
       }
+
+      // Slot 0 is unused, so that the children of slot k are 2k and 2k + 1.
+      prefixes_.resize(num + 1);
+      ranks_.resize(num + 1);
+      BuildTree(0, 1);
     }
 
-    void InitializeBlocks() {
-      size_t num = index_.num_blocks();
-      if (num == 0) return;
+    // Returns the number of the first block whose last key is not less than
+    // `key', or the number of blocks if there is none.
+    uint64_t FindBlockByKey(const string_view& key) const {
+      const size_t num = keys_.size();
+      const uint64_t prefix = GetKeyPrefix(key);
+
+      size_t k = 1;
+      while (k <= num) {
+        __builtin_prefetch(prefixes_.data() + std::min(16 * k, num));
+        const uint64_t cur = prefixes_[k];
+        const bool less =
+            cur < prefix || (cur == prefix && keys_[ranks_[k]] < key);
+        k = 2 * k + less;
+      }
 
-      blocks_.resize(num);
+      // Strip the trailing right turns, and the left turn before them, to get
+      // back to the last slot not less than the key.
+      k >>= __builtin_ffsll(~k);
+      return k ? ranks_[k] : num;
+    }
 
-      blocks_[0] = sizeof(struct CA_wo_header);
-      for (size_t i = 1; i < num; i++)
-        blocks_[i] = blocks_[i - 1] + index_.size_[i - 1];
+    uint64_t GetBlockOffset(size_t num) const { return blocks_[num]; }
+
+    const string_view& GetLastKey(size_t num) const { return keys_[num]; }
+
+   private:
+    // Fills the subtree rooted at slot `k' with the blocks starting at
+    // `rank', in order.  Returns the rank following the subtree.
+    size_t BuildTree(size_t rank, size_t k) {
+      if (k >= prefixes_.size()) return rank;
+      rank = BuildTree(rank, 2 * k);
+      prefixes_[k] = GetKeyPrefix(keys_[rank]);
+      ranks_[k] = rank++;
+      return BuildTree(rank, 2 * k + 1);
     }
 
     const WriteOnceIndex& index_;
 
+    // Last keys of the blocks, in block order.
     std::vector<string_view> keys_;
+
+    // Key prefixes in Eytzinger order, and the block each came from.
+    std::vector<uint64_t> prefixes_;
+    std::vector<uint32_t> ranks_;
+
+    // Block offsets.
     std::vector<uint64_t> blocks_;
   };
 };
 
 /*****************************************************************************/
 
+// Offsets of sampled entries within the blocks of a seekable table, relative
+// to the start of each block.  They allow binary searching a block without
+// changing how entries are addressed.
+class WriteOnceRestartIndex {
+ public:
+  bool empty() const { return offsets_.empty(); }
+
+  size_t num_blocks() const { return num_restarts_.size(); }
+
+  void Add(const WriteOnceBlock& block) {
+    const size_t size = offsets_.size();
+    block.GetEntryOffsets(kSeekableRestartInterval, offsets_);
+    num_restarts_.push_back(offsets_.size() - size);
+  }
+
+  void Marshal(DataBuffer& buffer) const {
+    buffer.clear();
+
+    std::vector<uint32_t> deltas(offsets_);
+    size_t begin = 0;
+    for (uint32_t num : num_restarts_) {
+      for (size_t i = num; i-- > 1;)
+        deltas[begin + i] -= deltas[begin + i - 1];
+      begin += num;
+    }
+
+    buffer.reserve(
+        oroch::varint_codec<size_t>::value_space(num_blocks()) +
+        oroch::varint_codec<uint32_t>::space(num_restarts_.begin(),
+                                             num_restarts_.end()) +
+        oroch::varint_codec<uint32_t>::space(deltas.begin(), deltas.end()));
+
+    unsigned char* ptr = buffer.udata();
+    oroch::varint_codec<size_t>::value_encode(ptr, num_blocks());
+    oroch::varint_codec<uint32_t>::encode(ptr, num_restarts_.begin(),
+                                          num_restarts_.end());
+    oroch::varint_codec<uint32_t>::encode(ptr, deltas.begin(), deltas.end());
+    buffer.resize(ptr - buffer.udata());
+  }
+
+  void Unmarshal(DataBuffer& buffer, const WriteOnceIndex& index) {
+    const unsigned char* ptr = buffer.udata();
+    const unsigned char* end = ptr + buffer.size();
+
+    size_t num = oroch::varint_codec<size_t>::value_decode(ptr);
+    KJ_REQUIRE(num == index.num_blocks(), num, index.num_blocks());
+
+    num_restarts_.resize(num);
+    oroch::varint_codec<uint32_t>::decode(num_restarts_.begin(),
+                                          num_restarts_.end(), ptr);
+
+    begin_.resize(num + 1);
+    begin_[0] = 0;
+    for (size_t i = 0; i < num; i++)
+      begin_[i + 1] = begin_[i] + num_restarts_[i];
+
+    offsets_.resize(begin_[num]);
+    oroch::varint_codec<uint32_t>::decode(offsets_.begin(), offsets_.end(),
+                                          ptr);
+    KJ_REQUIRE(ptr <= end);
+
+    for (size_t i = 0; i < num; i++) {
+      for (size_t j = begin_[i] + 1; j < begin_[i + 1]; j++)
+        offsets_[j] += offsets_[j - 1];
+      if (begin_[i] != begin_[i + 1])
+        KJ_REQUIRE(offsets_[begin_[i + 1] - 1] < index.GetBlockSize(i));
+    }
+  }
+
+  // Returns the offset within a block from which to scan for `key', given
+  // the block's data.
+  uint32_t FindOffsetByKey(size_t block, const unsigned char* data,
+                           const string_view& key) const {
+    const uint32_t* begin = offsets_.data() + begin_[block];
+    const uint32_t* end = offsets_.data() + begin_[block + 1];
+
+    // Find the first sampled entry greater than the key, and start at the
+    // preceding one.
+    auto pos = std::upper_bound(
+        begin, end, key, [data](const string_view& key, uint32_t offset) {
+          const unsigned char* ptr = data + offset;
+          uint32_t k_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
+          oroch::varint_codec<uint32_t>::value_decode(ptr);
+          return key < string_view(reinterpret_cast<const char*>(ptr), k_size);
+        });
+
+    return (pos == begin) ? 0 : pos[-1];
+  }
+
+ private:
+  // Number of sampled entries in each block.
+  std::vector<uint32_t> num_restarts_;
+
+  // Position of each block's first offset in `offsets_'.  Reader only.
+  std::vector<size_t> begin_;
+
+  std::vector<uint32_t> offsets_;
+};
+
+/*****************************************************************************/
+
+// Blocked Bloom filter over the keys of a table.  All bits probed for a key
+// lie within a single cache line.
+class WriteOnceFilter {
+ public:
+  bool empty() const { return bits_.empty(); }
+
+  static void Build(DataBuffer& buffer, const std::vector<uint64_t>& hashes,
+                    unsigned bits_per_key) {
+    WriteOnceFilter filter;
+    filter.num_probes_ = std::min(std::max(bits_per_key * 69 / 100, 1U), 16U);
+
+    const size_t num_lines =
+        std::max<size_t>(hashes.size() * bits_per_key / kLineBits, 1);
+    filter.bits_.resize(num_lines * kLineWords);
+
+    for (uint64_t hash : hashes) filter.Insert(hash);
+
+    filter.Marshal(buffer);
+  }
+
+  void Marshal(DataBuffer& buffer) const {
+    const uint64_t num_probes = num_probes_;
+
+    buffer.clear();
+    buffer.append(&num_probes, sizeof(num_probes));
+    buffer.append(bits_);
+  }
+
+  void Unmarshal(DataBuffer& buffer) {
+    uint64_t num_probes;
+    KJ_REQUIRE(buffer.size() >= sizeof(num_probes));
+    KJ_REQUIRE((buffer.size() - sizeof(num_probes)) % kLineBytes == 0);
+    memcpy(&num_probes, buffer.data(), sizeof(num_probes));
+    num_probes_ = num_probes;
+
+    bits_.resize((buffer.size() - sizeof(num_probes)) / sizeof(uint64_t));
+    memcpy(bits_.data(), buffer.data() + sizeof(num_probes),
+           bits_.size() * sizeof(uint64_t));
+  }
+
+  // Returns false if the key is definitely not in the table.
+  bool MayContain(const string_view& key) const {
+    if (empty()) return true;
+
+    const uint64_t hash = Hash(key);
+    const uint64_t* line = GetLine(hash);
+    uint32_t h = hash, delta = (h >> 17) | (h << 15);
+    for (unsigned i = 0; i < num_probes_; ++i, h += delta) {
+      const unsigned bit = h % kLineBits;
+      if (!(line[bit / 64] & (UINT64_C(1) << (bit % 64)))) return false;
+    }
+
+    return true;
+  }
+
+ private:
+  static constexpr size_t kLineBytes = 64;
+  static constexpr size_t kLineBits = kLineBytes * CHAR_BIT;
+  static constexpr size_t kLineWords = kLineBytes / sizeof(uint64_t);
+
+  const uint64_t* GetLine(uint64_t hash) const {
+    const uint64_t num_lines = bits_.size() / kLineWords;
+    return &bits_[((hash >> 32) * num_lines >> 32) * kLineWords];
+  }
+
+  void Insert(uint64_t hash) {
+    uint64_t* line = const_cast<uint64_t*>(GetLine(hash));
+    uint32_t h = hash, delta = (h >> 17) | (h << 15);
+    for (unsigned i = 0; i < num_probes_; ++i, h += delta) {
+      const unsigned bit = h % kLineBits;
+      line[bit / 64] |= UINT64_C(1) << (bit % 64);
+    }
+  }
+
+  unsigned num_probes_ = 0;
+  std::vector<uint64_t> bits_;
+};
+
+/*****************************************************************************/
+
+// Table statistics, gathered while writing, and stored in their own section
+// as a sequence of varints and length-prefixed keys.
+class WriteOnceStatistics {
+ public:
+  using codec = oroch::varint_codec<uint64_t>;
+
+  const TableStatistics& get() const { return statistics_; }
+
+  void Add(const string_view& key, const string_view& value,
+           bool offset_scores) {
+    if (!statistics_.row_count++) statistics_.min_key = key.to_string();
+    statistics_.max_key = key.to_string();
+    statistics_.key_bytes += key.size();
+    statistics_.value_bytes += value.size();
+
+    statistics_.has_offset_scores = offset_scores;
+    if (offset_scores && !value.empty()) {
+      const auto begin = reinterpret_cast<const uint8_t*>(value.data());
+      statistics_.offset_score_count +=
+          ca_offset_score_count(begin, begin + value.size(), &codec_context_);
+      ++statistics_.offset_score_encodings[*begin];
+    }
+  }
+
+  void Marshal(DataBuffer& buffer) const {
+    const auto& encodings = statistics_.offset_score_encodings;
+
+    buffer.clear();
+    buffer.reserve(codec::value_space(UINT64_MAX) * (8 + 2 * encodings.size()) +
+                   statistics_.min_key.size() + statistics_.max_key.size());
+
+    unsigned char* ptr = buffer.udata();
+    codec::value_encode(ptr, statistics_.row_count);
+    codec::value_encode(ptr, statistics_.key_bytes);
+    codec::value_encode(ptr, statistics_.value_bytes);
+    for (const std::string* key :
+         {&statistics_.min_key, &statistics_.max_key}) {
+      codec::value_encode(ptr, key->size());
+      ptr = std::copy(key->begin(), key->end(), ptr);
+    }
+    codec::value_encode(ptr, statistics_.has_offset_scores);
+    codec::value_encode(ptr, statistics_.offset_score_count);
+    codec::value_encode(ptr, encodings.size());
+    for (const auto& encoding : encodings) {
+      codec::value_encode(ptr, encoding.first);
+      codec::value_encode(ptr, encoding.second);
+    }
+    buffer.resize(ptr - buffer.udata());
+  }
+
+  void Unmarshal(const DataBuffer& buffer) {
+    const unsigned char* ptr = buffer.udata();
+    const unsigned char* end = ptr + buffer.size();
+
+    statistics_ = TableStatistics();
+    statistics_.row_count = codec::value_decode(ptr);
+    statistics_.key_bytes = codec::value_decode(ptr);
+    statistics_.value_bytes = codec::value_decode(ptr);
+    for (std::string* key : {&statistics_.min_key, &statistics_.max_key}) {
+      const uint64_t size = codec::value_decode(ptr);
+      KJ_REQUIRE(size <= uint64_t(end - ptr));
+      key->assign(reinterpret_cast<const char*>(ptr), size);
+      ptr += size;
+    }
+    statistics_.has_offset_scores = codec::value_decode(ptr);
+    statistics_.offset_score_count = codec::value_decode(ptr);
+    for (uint64_t i = codec::value_decode(ptr); i > 0; --i) {
+      const uint8_t type = codec::value_decode(ptr);
+      statistics_.offset_score_encodings[type] = codec::value_decode(ptr);
+    }
+    KJ_REQUIRE(ptr <= end);
+  }
+
+ private:
+  TableStatistics statistics_;
+
+  // Scratch space for counting values, reused between rows.
+  CodecContext codec_context_;
+};
+
+/*****************************************************************************/
+
+// Directory of the sections following the data blocks of a v4 table.
+class WriteOnceSections {
+ public:
+  struct Section {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+  size_t size() const { return sections_.size(); }
+
+  void Add(uint32_t type, uint64_t offset, uint64_t size) {
+    Section section;
+    section.offset = offset;
+    section.size = size;
+    sections_.emplace_back(type, section);
+  }
+
+  // Returns the section of the given type, or an empty one if the table has
+  // no such section.
+  Section Get(uint32_t type) const {
+    for (const auto& section : sections_) {
+      if (section.first == type) return section.second;
+    }
+    return Section();
+  }
+
+  // Reads the section directory of a table.  Tables without the extended
+  // flag only have an index section, which runs until the end of the file.
+  void Read(int fd, const struct stat& st, const struct CA_wo_header& header) {
+    sections_.clear();
+
+    if ((header.flags & CA_WO_FLAG_EXTENDED) == 0) {
+      KJ_REQUIRE(header.index_offset <= st.st_size);
+      Add(CA_WO_SECTION_INDEX, header.index_offset,
+          st.st_size - header.index_offset);
+      return;
+    }
+
+    struct CA_wo_trailer trailer;
+    KJ_REQUIRE(st.st_size >= header.index_offset + sizeof(trailer));
+    const uint64_t trailer_offset = st.st_size - sizeof(trailer);
+    FileIO(fd).Read(&trailer, trailer_offset, sizeof(trailer));
+    KJ_REQUIRE(trailer.magic == MAGIC, trailer.magic, MAGIC);
+    KJ_REQUIRE(trailer.directory_offset >= header.index_offset);
+    KJ_REQUIRE(trailer.directory_offset <= trailer_offset);
+
+    DataBuffer buffer;
+    buffer.resize(trailer_offset - trailer.directory_offset);
+    FileIO(fd).Read(buffer, trailer.directory_offset);
+
+    const unsigned char* ptr = buffer.udata();
+    const unsigned char* end = ptr + buffer.size();
+    KJ_REQUIRE(ptr < end);
+    size_t num = oroch::varint_codec<size_t>::value_decode(ptr);
+    for (size_t i = 0; i < num; i++) {
+      KJ_REQUIRE(ptr < end);
+      uint32_t type = oroch::varint_codec<uint32_t>::value_decode(ptr);
+      uint64_t offset = oroch::varint_codec<uint64_t>::value_decode(ptr);
+      uint64_t size = oroch::varint_codec<uint64_t>::value_decode(ptr);
+      KJ_REQUIRE(offset >= header.index_offset);
+      KJ_REQUIRE(offset + size <= trailer.directory_offset);
+      Add(type, offset, size);
+    }
+    KJ_REQUIRE(ptr <= end);
+  }
+
+  // Marshals the directory, followed by the trailer pointing back to it.
+  void Marshal(DataBuffer& buffer, uint64_t directory_offset) const {
+    buffer.clear();
+    buffer.reserve(oroch::varint_codec<size_t>::value_space(size()) +
+                   sections_.size() * 24 + sizeof(struct CA_wo_trailer));
+
+    unsigned char* ptr = buffer.udata();
+    oroch::varint_codec<size_t>::value_encode(ptr, size());
+    for (const auto& section : sections_) {
+      oroch::varint_codec<uint32_t>::value_encode(ptr, section.first);
+      oroch::varint_codec<uint64_t>::value_encode(ptr, section.second.offset);
+      oroch::varint_codec<uint64_t>::value_encode(ptr, section.second.size);
+    }
+    buffer.resize(ptr - buffer.udata());
+
+    struct CA_wo_trailer trailer;
+    trailer.directory_offset = directory_offset;
+    trailer.magic = MAGIC;
+    buffer.append(&trailer, sizeof(trailer));
+  }
+
+ private:
+  std::vector<std::pair<uint32_t, Section>> sections_;
+};
+
+/*****************************************************************************/
+
+// Returns the directory holding `path', for temporary files that should live
+// on the same file system as the table.
+std::string DirectoryOf(const char* path) {
+  const char* last_slash = strrchr(path, '/');
+  if (!last_slash) return ".";
+  KJ_REQUIRE(path != last_slash);
+  return std::string(path, last_slash);
+}
+
+// Statistics of the offset/score list stored under each key.  The section
+// holds a fixed-size record per key, in entry order, so that readers locate
+// a record from the block index alone.  Records beyond what fits in the
+// buffer are spilled to a temporary file until the section is written.
+class WriteOnceKeyStatistics {
+ public:
+  static_assert(sizeof(KeyStatistics) == 32, "unexpected record padding");
+
+  explicit WriteOnceKeyStatistics(std::string dir) : dir_(std::move(dir)) {}
+
+  bool empty() const { return spilled_ == 0 && records_.empty(); }
+
+  void Add(const KeyStatistics& record) {
+    records_.push_back(record);
+    if (records_.size() == kKeyStatisticsBufferRecords) Spill();
+  }
+
+  // Appends the section to `fd', and returns its size.
+  uint64_t Write(int fd) {
+    if (spilled_ == 0) {
+      const size_t size = records_.size() * sizeof(KeyStatistics);
+      FileIO(fd).Write(records_.data(), size);
+      return size;
+    }
+
+    Spill();
+    records_.resize(kKeyStatisticsBufferRecords);
+    for (uint64_t i = 0; i < spilled_; i += records_.size()) {
+      const size_t size =
+          std::min<uint64_t>(records_.size(), spilled_ - i) *
+          sizeof(KeyStatistics);
+      FileIO(spill_fd_).Read(records_.data(), i * sizeof(KeyStatistics), size);
+      FileIO(fd).Write(records_.data(), size);
+    }
+    records_.clear();
+
+    return spilled_ * sizeof(KeyStatistics);
+  }
+
+ private:
+  void Spill() {
+    if (records_.empty()) return;
+    if (spill_fd_ == nullptr) spill_fd_ = AnonTemporaryFile(dir_.c_str());
+    FileIO(spill_fd_).Write(records_.data(), spilled_ * sizeof(KeyStatistics),
+                            records_.size() * sizeof(KeyStatistics));
+    spilled_ += records_.size();
+    records_.clear();
+  }
+
+  const std::string dir_;
+
+  // Records not yet spilled.
+  std::vector<KeyStatistics> records_;
+
+  // Records in the temporary file, if any.
+  kj::AutoCloseFd spill_fd_;
+  uint64_t spilled_ = 0;
+};
+
+/*****************************************************************************/
+
 class WriteOnceBuilder : private PendingFile, public TableBuilder {
  public:
   WriteOnceBuilder(const char* path, const TableOptions& options)
       : PendingFile(path, options.GetFileFlags(), options.GetFileMode()),
         seekable_(options.GetOutputSeekable()),
-        no_fsync_(options.GetNoFSync()) {
+        no_fsync_(options.GetNoFSync()),
+        filter_bits_per_key_(options.GetFilterBitsPerKey()),
+        restart_interval_(options.GetBlockRestartInterval()),
+        statistics_enabled_(options.GetStatistics()),
+        offset_score_statistics_(options.GetOffsetScoreStatistics()),
+        key_statistics_(options.GetKeyStatistics()),
+        key_statistics_section_(DirectoryOf(path)) {
     KJ_REQUIRE((options.GetFileFlags() & ~(O_EXCL | O_CLOEXEC)) == 0);
 
     compression_ = options.GetCompression();
@@ -651,40 +1575,89 @@ class WriteOnceBuilder : private PendingFile, public TableBuilder {
     KJ_REQUIRE(compression_ <= kTableCompressionLast,
                "unsupported compression method");
 
+    raw_offsets_ = seekable_ && compression_ == kTableCompressionNone;
+    KJ_REQUIRE(!raw_offsets_ || !restart_interval_,
+               "uncompressed seekable tables cannot use prefix-compressed "
+               "keys");
+    KJ_REQUIRE(!raw_offsets_ || !key_statistics_,
+               "uncompressed seekable tables cannot store key statistics");
+
     compression_level_ = options.GetCompressionLevel();
     if (compression_level_ == 0 && compression_ != kTableCompressionNone)
       compression_level_ = 3;
 
+    if (compression_ != kTableCompressionNone) {
+      if (options.GetCompressionThreads() > 1) {
+        parallel_compressor_ = std::make_unique<ParallelZstdCompressor>(
+            options.GetCompressionThreads(), compression_level_);
+      }
+
+      dictionary_size_ = options.GetCompressionDictionarySize();
+      collecting_samples_ = (dictionary_size_ > 0);
+    }
+
     WriteHeader(0);
   }
 
   void InsertRow(const string_view& key, const string_view& value) override {
+    Insert(key, value, nullptr);
+  }
+
+  void InsertOffsetScoreRow(const string_view& key, const string_view& value,
+                            const KeyStatistics& statistics) override {
+    Insert(key, value, &statistics);
+  }
+
+  void Sync() override {
+    WriteBlock(block_, index_);
+    if (collecting_samples_) TrainDictionary(index_);
+    if (parallel_compressor_) {
+      while (parallel_compressor_->pending())
+        WriteCompressedBlock(*parallel_compressor_->Next(), index_);
+    }
+    WriteIndex(index_);
+  }
+
+ private:
+  // Adds a row.  Key statistics are computed from the value unless given.
+  void Insert(const string_view& key, const string_view& value,
+              const KeyStatistics* statistics) {
     KJ_REQUIRE(block_.empty() || block_.GetLaskKey() < key,
                "unsorted input data");
 
     const size_t size = key.size() + value.size();
     const size_t block_size = block_.EstimateSize();
     if ((block_size > kBlockSizeMax) ||
-        (block_size > kBlockSizeMin && size > kEntrySizeLimit)) {
+        (block_size > kBlockSizeMin && size > kEntrySizeLimit) ||
+        (seekable_ && block_.num_entries() > kVirtualOffsetEntryMask)) {
       WriteBlock(block_, index_);
       block_.Clear();
     }
 
     block_.Add(key, value);
+    if (filter_bits_per_key_) key_hashes_.push_back(Hash(key));
+    if (statistics_enabled_)
+      statistics_.Add(key, value, offset_score_statistics_);
+    if (key_statistics_) {
+      if (statistics) {
+        key_statistics_section_.Add(*statistics);
+      } else {
+        offsets_.clear();
+        ca_offset_score_parse(value, &offsets_, &codec_context_);
+        key_statistics_section_.Add(
+            ca_offset_score_statistics(offsets_.data(), offsets_.size()));
+      }
+    }
   }
 
-  void Sync() override {
-    WriteBlock(block_, index_);
-    WriteIndex(index_);
-  }
-
- private:
-  void WriteHeader(uint64_t index_offset) {
+  void WriteHeader(uint64_t index_offset, bool extended = false) {
     struct CA_wo_header header;
     header.magic = MAGIC;  // Will implicitly store endianness
     header.major_version = MAJOR_VERSION;
     header.minor_version = MINOR_VERSION;
     header.flags = seekable_ ? CA_WO_FLAG_SEEKABLE : 0;
+    if (extended) header.flags |= CA_WO_FLAG_EXTENDED;
+    if (restart_interval_) header.flags |= CA_WO_FLAG_PREFIXED_KEYS;
     header.compression = compression_;
     header.data_reserved = 0;
     header.index_offset = index_offset;
@@ -693,18 +1666,107 @@ class WriteOnceBuilder : private PendingFile, public TableBuilder {
     FileIO(get()).Write(&header, sizeof(header));
   }
 
+  void MarshalBlock(const WriteOnceBlock& block, DataBuffer& buffer) {
+    if (restart_interval_)
+      block.MarshalPrefixed(buffer, restart_interval_);
+    else
+      block.Marshal(buffer, raw_offsets_);
+  }
+
   void WriteBlock(const WriteOnceBlock& block, WriteOnceIndex& index) {
-    block.Marshal(marshal_buffer_, seekable_);
+    if (collecting_samples_ || parallel_compressor_) {
+      if (block.empty()) return;
+
+      auto pending = std::make_unique<PendingBlock>();
+      MarshalBlock(block, pending->input);
+      pending->last_key = block.GetLaskKey().to_string();
+      pending->num_entries = block.num_entries();
+
+      if (collecting_samples_) return AddSample(std::move(pending), index);
+      return WritePendingBlock(std::move(pending), index);
+    }
+
+    MarshalBlock(block, marshal_buffer_);
     if (!marshal_buffer_.size()) return;
 
-    DataBuffer& buffer = seekable_ ? marshal_buffer_ : GetWriteBuffer();
+    DataBuffer& buffer = GetWriteBuffer(true);
     FileIO(get()).Write(buffer);
 
     index.Add(block, buffer.size());
+    if (raw_offsets_) restarts_.Add(block);
 
     // KJ_DBG(block.num_entries(), buffer.size());
   }
 
+  // Holds back leading blocks until there are enough samples to train the
+  // compression dictionary.
+  void AddSample(std::unique_ptr<PendingBlock> block, WriteOnceIndex& index) {
+    sample_size_ += block->input.size();
+    samples_.emplace_back(std::move(block));
+
+    if (sample_size_ >= dictionary_size_ * kDictionarySampleRatio)
+      TrainDictionary(index);
+  }
+
+  // Trains the compression dictionary, and writes the blocks held back for
+  // it.  Without enough suitable samples, blocks are compressed without a
+  // dictionary.
+  void TrainDictionary(WriteOnceIndex& index) {
+    collecting_samples_ = false;
+
+    std::vector<char> samples;
+    std::vector<size_t> sample_sizes;
+    for (const auto& block : samples_) {
+      if (block->input.size() > kDictionarySampleSizeMax) continue;
+      samples.insert(samples.end(), block->input.data(),
+                     block->input.data() + block->input.size());
+      sample_sizes.push_back(block->input.size());
+    }
+    if (!sample_sizes.empty()) {
+      dictionary_.Train(dictionary_size_, samples, sample_sizes,
+                        compression_level_);
+    }
+
+    // Blocks that are large or repetitive enough may compress better on
+    // their own, in which case the dictionary is dropped.
+    if (!dictionary_.empty()) {
+      size_t size = 0, dictionary_size = dictionary_.data().size();
+      for (const auto& block : samples_) {
+        Compress(compress_buffer_, block->input, false);
+        size += compress_buffer_.size();
+        Compress(compress_buffer_, block->input, true);
+        dictionary_size += compress_buffer_.size();
+      }
+      if (dictionary_size >= size) dictionary_.clear();
+    }
+
+    for (auto& block : samples_) WritePendingBlock(std::move(block), index);
+    samples_.clear();
+  }
+
+  // Compresses and writes a block.  With compression threads, the block is
+  // queued instead, after writing out finished blocks while enough are in
+  // flight.  Blocks are always written in order, so the output does not
+  // depend on the number of threads.
+  void WritePendingBlock(std::unique_ptr<PendingBlock> block,
+                         WriteOnceIndex& index) {
+    if (!parallel_compressor_) {
+      Compress(block->output, block->input, true);
+      WriteCompressedBlock(*block, index);
+      return;
+    }
+
+    while (parallel_compressor_->full())
+      WriteCompressedBlock(*parallel_compressor_->Next(), index);
+
+    parallel_compressor_->Submit(std::move(block), dictionary_.cdict());
+  }
+
+  void WriteCompressedBlock(const PendingBlock& block, WriteOnceIndex& index) {
+    FileIO(get()).Write(block.output);
+    index.Add(block.last_key, block.num_entries, block.output.size());
+  }
+
   uint64_t WriteIndex(const WriteOnceIndex& index) {
     index.Marshal(marshal_buffer_);
     if (!marshal_buffer_.size()) return 0;
@@ -713,7 +1775,8 @@ class WriteOnceBuilder : private PendingFile, public TableBuilder {
     FileIO(get()).Write(buffer);
 
     uint64_t index_offset = index.GetIndexOffset();
-    WriteHeader(index_offset);
+    bool extended = WriteSections(index_offset, buffer.size());
+    WriteHeader(index_offset, extended);
     PendingFile::Finish();
 
     if (!no_fsync_) {
@@ -725,12 +1788,62 @@ class WriteOnceBuilder : private PendingFile, public TableBuilder {
     return index_offset;
   }
 
-  DataBuffer& GetWriteBuffer() {
+  // Writes the optional sections following the index, and the directory
+  // listing all sections.  Returns false if there were none to write.
+  bool WriteSections(uint64_t index_offset, uint64_t index_size) {
+    WriteOnceSections sections;
+    sections.Add(CA_WO_SECTION_INDEX, index_offset, index_size);
+    uint64_t offset = index_offset + index_size;
+
+    if (filter_bits_per_key_) {
+      WriteOnceFilter::Build(marshal_buffer_, key_hashes_,
+                             filter_bits_per_key_);
+      FileIO(get()).Write(marshal_buffer_);
+      sections.Add(CA_WO_SECTION_FILTER, offset, marshal_buffer_.size());
+      offset += marshal_buffer_.size();
+    }
+
+    if (!dictionary_.empty()) {
+      const auto& data = dictionary_.data();
+      FileIO(get()).Write(data.data(), data.size());
+      sections.Add(CA_WO_SECTION_DICTIONARY, offset, data.size());
+      offset += data.size();
+    }
+
+    if (raw_offsets_ && !restarts_.empty()) {
+      restarts_.Marshal(marshal_buffer_);
+      FileIO(get()).Write(marshal_buffer_);
+      sections.Add(CA_WO_SECTION_RESTARTS, offset, marshal_buffer_.size());
+      offset += marshal_buffer_.size();
+    }
+
+    // Stored uncompressed, so that readers fetch single records.
+    if (!key_statistics_section_.empty()) {
+      const uint64_t size = key_statistics_section_.Write(get());
+      sections.Add(CA_WO_SECTION_KEY_STATISTICS, offset, size);
+      offset += size;
+    }
+
+    if (statistics_enabled_) {
+      statistics_.Marshal(marshal_buffer_);
+      FileIO(get()).Write(marshal_buffer_);
+      sections.Add(CA_WO_SECTION_STATISTICS, offset, marshal_buffer_.size());
+      offset += marshal_buffer_.size();
+    }
+
+    if (sections.size() == 1) return false;
+
+    sections.Marshal(marshal_buffer_, offset);
+    FileIO(get()).Write(marshal_buffer_);
+
+    return true;
+  }
+
+  DataBuffer& GetWriteBuffer(bool use_dictionary = false) {
     if (compression_ == TableCompression::kTableCompressionNone)
       return marshal_buffer_;
 
-    compress_buffer_.reserve(ZSTD_compressBound(marshal_buffer_.size()));
-    compressor_.Go(compress_buffer_, marshal_buffer_, compression_level_);
+    Compress(compress_buffer_, marshal_buffer_, use_dictionary);
 
     // if (compress_buffer_.size() > marshal_buffer_.size())
     //  KJ_DBG(compress_buffer_.size() - marshal_buffer_.size());
@@ -738,174 +1851,407 @@ class WriteOnceBuilder : private PendingFile, public TableBuilder {
     return compress_buffer_;
   }
 
+  void Compress(DataBuffer& dst, const DataBuffer& src, bool use_dictionary) {
+    dst.reserve(ZSTD_compressBound(src.size()));
+    if (use_dictionary && !dictionary_.empty())
+      compressor_.Go(dst, src, dictionary_.cdict());
+    else
+      compressor_.Go(dst, src, compression_level_);
+  }
+
   // Saved table creation options.
   TableCompression compression_ = TableCompression::kTableCompressionNone;
   int compression_level_ = 0;
   const bool seekable_;
   const bool no_fsync_;
+  const unsigned filter_bits_per_key_;
+  const uint32_t restart_interval_;
+  const bool statistics_enabled_;
+  const bool offset_score_statistics_;
+  const bool key_statistics_;
+
+  // Whether entries are addressed by their file offset.  This requires
+  // uncompressed blocks in the seekable format.
+  bool raw_offsets_ = false;
 
   // Result data.
   WriteOnceIndex index_;
   WriteOnceBlock block_;
 
+  // Key hashes for the filter.
+  std::vector<uint64_t> key_hashes_;
+
+  WriteOnceStatistics statistics_;
+  WriteOnceKeyStatistics key_statistics_section_;
+
+  // Parsed value and scratch space, for key statistics of rows inserted
+  // without them.
+  std::vector<ca_offset_score> offsets_;
+  CodecContext codec_context_;
+
+  // Sampled entry offsets, for seekable tables.
+  WriteOnceRestartIndex restarts_;
+
   // A buffer for block marshaling.
   DataBuffer marshal_buffer_;
   // A buffer for block compression.
   DataBuffer compress_buffer_;
   // Compression context.
   ZstdCompressor compressor_;
+  // Compression threads, if any.
+  std::unique_ptr<ParallelZstdCompressor> parallel_compressor_;
+
+  // Compression dictionary, and the leading blocks held back to train it.
+  size_t dictionary_size_ = 0;
+  bool collecting_samples_ = false;
+  ZstdDictionary dictionary_;
+  std::vector<std::unique_ptr<PendingBlock>> samples_;
+  size_t sample_size_ = 0;
 };
 
 /*****************************************************************************/
 
+// Sorts its input with an external merge sort.  Rows are buffered in memory
+// until they reach the memory limit, at which point they are sorted and
+// written to a temporary file as a run.  Finally all runs are merged into the
+// table.  Input that fits in memory never touches the temporary file.
 class WriteOnceSortingBuilder final : public WriteOnceBuilder {
  public:
   WriteOnceSortingBuilder(const char* path, const TableOptions& options)
-      : WriteOnceBuilder(path, options) {
-    std::string dir(".");
-    if (const char* last_slash = strrchr(path, '/')) {
-      KJ_REQUIRE(path != last_slash);
-      dir = std::string(path, last_slash);
-    }
-
-    raw_fd_ = AnonTemporaryFile(dir.c_str());
-
-    raw_stream_ = fdopen(raw_fd_.get(), "w");
-    if (!raw_stream_) KJ_FAIL_SYSCALL("fdopen", errno, path);
-
-    index_.reserve(12 * 1024 * 1024);
+      : WriteOnceBuilder(path, options),
+        memory_limit_(options.GetSortMemoryLimit()),
+        sort_threads_(std::max(options.GetSortThreads(), 1U)),
+        dir_(DirectoryOf(path)) {
+    if (!memory_limit_) memory_limit_ = kSortMemoryLimitDefault;
   }
 
   virtual ~WriteOnceSortingBuilder() noexcept {
     try {
-      raw_fd_ = nullptr;
+      run_fd_ = nullptr;
     } catch (...) {
     }
-    if (raw_stream_) fclose(raw_stream_);
   }
 
   void InsertRow(const string_view& key, const string_view& value) override {
-    AddEntry(key, value);
-    WriteEntryData(key, value);
-  }
+    KJ_REQUIRE(key.size() <= std::numeric_limits<uint32_t>::max(),
+               "too long key");
+    KJ_REQUIRE(value.size() <= std::numeric_limits<uint32_t>::max(),
+               "too long value");
 
-  void Sync() override {
-    FlushEntryData();
-    SortEntries();
+    if (!entries_.empty() && MemoryUsage() + key.size() + value.size() +
+                                     sizeof(Entry) >
+                                 memory_limit_)
+      WriteRun();
 
-    DataBuffer buffer;
-    for (const Entry& entry : index_) {
-      buffer.resize(entry.key_size + entry.value_size);
-      FileIO(raw_fd_).Read(buffer, entry.offset);
+    Entry entry;
+    entry.prefix = GetKeyPrefix(key);
+    entry.offset = data_.size();
+    entry.key_size = key.size();
+    entry.value_size = value.size();
+    entries_.push_back(entry);
+
+    data_.insert(data_.end(), key.begin(), key.end());
+    data_.insert(data_.end(), value.begin(), value.end());
+  }
+
+  // Rows are buffered without their statistics, which are recomputed from
+  // the values once sorted.
+  void InsertOffsetScoreRow(const string_view& key, const string_view& value,
+                            const KeyStatistics&) override {
+    InsertRow(key, value);
+  }
 
-      const char* data = buffer.data();
-      const string_view key(data, entry.key_size);
-      const string_view value(data + entry.key_size, entry.value_size);
-      WriteOnceBuilder::InsertRow(key, value);
+  void Sync() override {
+    if (runs_.empty()) {
+      SortEntries();
+      for (const Entry& entry : entries_)
+        WriteOnceBuilder::InsertRow(GetKey(entry), GetValue(entry));
+    } else {
+      if (!entries_.empty()) WriteRun();
+      MergeRuns();
     }
 
     WriteOnceBuilder::Sync();
   }
 
  private:
+  // Used when no memory limit is given.
+  static constexpr size_t kSortMemoryLimitDefault = 256 * 1024 * 1024;
+
+  // Smallest read buffer for each run while merging.
+  static constexpr size_t kRunBufferSizeMin = 64 * 1024;
+
   struct Entry {
+    uint64_t prefix;
     uint64_t offset;
-    uint32_t value_size;
     uint32_t key_size;
-    char prefix[24];
+    uint32_t value_size;
   };
 
-  void AddEntry(const string_view& key, const string_view& value) {
-    KJ_REQUIRE(key.size() <= std::numeric_limits<uint32_t>::max(),
-               "too long key");
-    KJ_REQUIRE(value.size() <= std::numeric_limits<uint32_t>::max(),
-               "too long value");
+  // Size of the row headers in runs: the key size and the value size.
+  static constexpr size_t kRowHeaderSize = 2 * sizeof(uint32_t);
 
-    struct Entry entry;
-    size_t count = std::min(sizeof entry.prefix, key.size());
-    entry.offset = offset_;
-    entry.key_size = key.size();
-    entry.value_size = value.size();
-    std::copy_n(key.begin(), count, entry.prefix);
-    index_.push_back(entry);
+  // A run of sorted rows in the temporary file.
+  struct Run {
+    uint64_t offset;
+    uint64_t size;
+  };
 
-    offset_ += key.size() + value.size();
-    if (key_size_max_ < key.size()) key_size_max_ = key.size();
-  }
+  // Reads back the rows of a run, a buffer at a time.
+  class RunReader {
+   public:
+    RunReader(int fd, const Run& run, size_t buffer_size)
+        : fd_(fd), offset_(run.offset), end_(run.offset + run.size) {
+      buffer_.reserve(buffer_size);
+    }
+
+    const string_view& key() const { return key_; }
+    const string_view& value() const { return value_; }
+
+    // Moves to the next row.  Returns false at the end of the run.
+    bool Next() {
+      if (!Fill(kRowHeaderSize)) return false;
+
+      uint32_t sizes[2];
+      memcpy(sizes, buffer_.data() + pos_, sizeof(sizes));
+      const size_t size = kRowHeaderSize + sizes[0] + sizes[1];
+      KJ_REQUIRE(Fill(size), "truncated run");
+
+      const char* data = buffer_.data() + pos_ + kRowHeaderSize;
+      key_ = string_view(data, sizes[0]);
+      value_ = string_view(data + sizes[0], sizes[1]);
+      pos_ += size;
+      return true;
+    }
+
+   private:
+    // Makes sure `size' bytes following the current position are buffered,
+    // moving them to the start of the buffer if needed.  Returns false if
+    // the run ends first.
+    bool Fill(size_t size) {
+      size_t avail = buffer_.size() - pos_;
+      if (avail >= size) return true;
+      if (avail + (end_ - offset_) < size) {
+        KJ_REQUIRE(avail == 0 && offset_ == end_, "truncated run");
+        return false;
+      }
+
+      memmove(buffer_.data(), buffer_.data() + pos_, avail);
+      buffer_.resize(avail);
+      buffer_.reserve(size);
+      pos_ = 0;
+
+      const size_t length =
+          std::min<uint64_t>(buffer_.capacity() - avail, end_ - offset_);
+      buffer_.resize(avail + length);
+      FileIO(fd_).Read(buffer_.data() + avail, offset_, length);
+      offset_ += length;
+      return true;
+    }
+
+    const int fd_;
+    uint64_t offset_;
+    const uint64_t end_;
 
-  void WriteEntryData(const string_view& key, const string_view& value) {
-    KJ_REQUIRE(raw_stream_ != nullptr);
+    DataBuffer buffer_;
+    size_t pos_ = 0;
 
-    if (0 == fwrite(key.data(), key.size(), 1, raw_stream_) ||
-        0 == fwrite(value.data(), value.size(), 1, raw_stream_))
-      KJ_FAIL_SYSCALL("fwrite", errno);
+    string_view key_, value_;
+  };
+
+  size_t MemoryUsage() const {
+    return data_.size() + entries_.size() * sizeof(Entry);
   }
 
-  void FlushEntryData() {
-    KJ_REQUIRE(raw_stream_ != nullptr);
-    int ret = fflush(raw_stream_);
-    if (ret) KJ_FAIL_SYSCALL("fflush", errno);
+  string_view GetKey(const Entry& entry) const {
+    return string_view(data_.data() + entry.offset, entry.key_size);
   }
 
-  bool Compare(const Entry& lhs, const Entry& rhs) {
-    size_t lhs_count = std::min(sizeof lhs.prefix, size_t{lhs.key_size});
-    size_t rhs_count = std::min(sizeof rhs.prefix, size_t{rhs.key_size});
-    const string_view lhs_prefix(lhs.prefix, lhs_count);
-    const string_view rhs_prefix(rhs.prefix, rhs_count);
+  string_view GetValue(const Entry& entry) const {
+    return string_view(data_.data() + entry.offset + entry.key_size,
+                       entry.value_size);
+  }
 
-    int fast_result = lhs_prefix.compare(rhs_prefix);
-    if (fast_result) return fast_result < 0;
+  bool Compare(const Entry& lhs, const Entry& rhs) const {
+    if (lhs.prefix != rhs.prefix) return lhs.prefix < rhs.prefix;
+    return GetKey(lhs) < GetKey(rhs);
+  }
 
-    FileIO fd(raw_fd_.get());
-    fd.Read(lhs_buffer_.get(), lhs.offset, lhs.key_size);
-    fd.Read(rhs_buffer_.get(), rhs.offset, rhs.key_size);
-    read_count_ += 2;
+  // Sorts the buffered rows.  With several threads, slices of the rows are
+  // sorted concurrently and then merged.
+  void SortEntries() {
+    auto compare = [this](const Entry& lhs, const Entry& rhs) {
+      return Compare(lhs, rhs);
+    };
+
+    const size_t num_slices =
+        std::min<size_t>(sort_threads_, entries_.size() / 1024 + 1);
+    if (num_slices <= 1) {
+      std::stable_sort(entries_.begin(), entries_.end(), compare);
+      return;
+    }
 
-    string_view lhs_view(lhs_buffer_.get(), lhs.key_size);
-    string_view rhs_view(rhs_buffer_.get(), rhs.key_size);
-    return lhs_view < rhs_view;
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= num_slices; i++)
+      bounds.push_back(entries_.size() * i / num_slices);
+
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < num_slices; i++) {
+      futures.emplace_back(std::async(
+          std::launch::async, [this, &bounds, compare, i] {
+            std::stable_sort(entries_.begin() + bounds[i],
+                             entries_.begin() + bounds[i + 1], compare);
+          }));
+    }
+    for (auto& future : futures) future.get();
+
+    // Merge neighboring slices until one remains.
+    for (size_t step = 1; step < num_slices; step *= 2) {
+      futures.clear();
+      for (size_t i = 0; i + step < num_slices; i += 2 * step) {
+        const size_t end = std::min(i + 2 * step, num_slices);
+        futures.emplace_back(std::async(
+            std::launch::async, [this, &bounds, compare, i, step, end] {
+              std::inplace_merge(entries_.begin() + bounds[i],
+                                 entries_.begin() + bounds[i + step],
+                                 entries_.begin() + bounds[end], compare);
+            }));
+      }
+      for (auto& future : futures) future.get();
+    }
   }
 
-  void SortEntries() {
-    lhs_buffer_ = std::make_unique<char[]>(key_size_max_);
-    rhs_buffer_ = std::make_unique<char[]>(key_size_max_);
-
-    // Use stable_sort here. It is usually implemented using merge sort
-    // algorithm that is preferred over quick sort when disk access is
-    // involved.
-    std::stable_sort(index_.begin(), index_.end(),
-                     [this](const auto& lhs, const auto& rhs) {
-                       return this->Compare(lhs, rhs);
-                     });
+  // Sorts the buffered rows, and appends them to the temporary file as a new
+  // run.
+  void WriteRun() {
+    if (run_fd_ == nullptr) run_fd_ = AnonTemporaryFile(dir_.c_str());
 
-    // KJ_LOG(DBG, index_.size(), read_count_);
+    SortEntries();
+
+    Run run;
+    run.offset = runs_.empty() ? 0 : runs_.back().offset + runs_.back().size;
+    run.size = 0;
+
+    DataBuffer buffer(kRunBufferSizeMin);
+    for (const Entry& entry : entries_) {
+      const uint32_t sizes[2] = {entry.key_size, entry.value_size};
+      if (buffer.size() + kRowHeaderSize + entry.key_size + entry.value_size >
+          buffer.capacity()) {
+        FileIO(run_fd_).Write(buffer, run.offset + run.size);
+        run.size += buffer.size();
+        buffer.clear();
+      }
+      if (kRowHeaderSize + entry.key_size + entry.value_size >
+          buffer.capacity()) {
+        // Write large rows straight from memory.
+        FileIO(run_fd_).Write(sizes, run.offset + run.size, kRowHeaderSize);
+        run.size += kRowHeaderSize;
+        FileIO(run_fd_).Write(data_.data() + entry.offset,
+                              run.offset + run.size,
+                              entry.key_size + entry.value_size);
+        run.size += entry.key_size + entry.value_size;
+        continue;
+      }
+      buffer.append(sizes, kRowHeaderSize);
+      buffer.append(data_.data() + entry.offset,
+                    entry.key_size + entry.value_size);
+    }
+    FileIO(run_fd_).Write(buffer, run.offset + run.size);
+    run.size += buffer.size();
+
+    runs_.push_back(run);
 
-    lhs_buffer_.reset();
-    rhs_buffer_.reset();
+    entries_.clear();
+    data_.clear();
   }
 
-  // Temporary file for all added key/value pairs.
-  kj::AutoCloseFd raw_fd_;
-  FILE* raw_stream_ = nullptr;
+  // Merges all runs into the table.  Rows with equal keys are taken from
+  // runs in order, like the stable sort within runs.
+  void MergeRuns() {
+    std::vector<Entry>().swap(entries_);
+    std::vector<char>().swap(data_);
+
+    const size_t buffer_size =
+        std::max(memory_limit_ / runs_.size(), kRunBufferSizeMin);
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const Run& run : runs_)
+      readers.emplace_back(
+          std::make_unique<RunReader>(run_fd_.get(), run, buffer_size));
 
-  // Index of all added key/value pairs.
-  std::vector<Entry> index_;
+    auto greater = [&readers](size_t lhs, size_t rhs) {
+      int result = readers[lhs]->key().compare(readers[rhs]->key());
+      return result ? result > 0 : lhs > rhs;
+    };
+    std::vector<size_t> heap;
+    for (size_t i = 0; i < readers.size(); i++) {
+      if (readers[i]->Next()) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), greater);
+
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), greater);
+      RunReader& reader = *readers[heap.back()];
+      WriteOnceBuilder::InsertRow(reader.key(), reader.value());
+      if (reader.Next())
+        std::push_heap(heap.begin(), heap.end(), greater);
+      else
+        heap.pop_back();
+    }
+  }
 
-  // Running file offset.
-  uint64_t offset_ = 0;
+  size_t memory_limit_;
+  const unsigned sort_threads_;
 
-  // Longest encountered key size.
-  uint32_t key_size_max_ = 0;
-  // Buffers for key comparison.
-  std::unique_ptr<char[]> lhs_buffer_;
-  std::unique_ptr<char[]> rhs_buffer_;
+  // Directory for the temporary file.
+  std::string dir_;
 
-  // Read statistics.
-  uint64_t read_count_ = 0;
+  // Rows buffered for the next run.
+  std::vector<Entry> entries_;
+  std::vector<char> data_;
+
+  // Temporary file holding the sorted runs.
+  kj::AutoCloseFd run_fd_;
+  std::vector<Run> runs_;
 };
 
 /*****************************************************************************/
 
+// Finds the blocks of `keys', which must be sorted, for batched lookups.
+// Keys ruled out by `filter', and keys past the last block, get block number
+// UINT64_MAX.  The byte ranges of the blocks are appended to `ranges'.
+std::vector<uint64_t> FindBlocksByKeys(
+    const WriteOnceIndex& index, const WriteOnceIndex::Cache& index_cache,
+    const WriteOnceFilter& filter, const std::vector<string_view>& keys,
+    std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+  std::vector<uint64_t> result(keys.size(), UINT64_MAX);
+
+  uint64_t block_num = UINT64_MAX;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    KJ_REQUIRE(!i || keys[i - 1] <= keys[i], "keys must be sorted");
+
+    // Sorted keys often belong to the block of the previous key, whose last
+    // key is then enough to tell.
+    if (block_num == UINT64_MAX ||
+        keys[i] > index_cache.GetLastKey(block_num)) {
+      const uint64_t num = index_cache.FindBlockByKey(keys[i]);
+      if (num >= index.num_blocks()) break;
+      block_num = num;
+    }
+
+    if (!filter.MayContain(keys[i])) continue;
+
+    const uint64_t offset = index_cache.GetBlockOffset(block_num);
+    if (ranges.empty() || ranges.back().first != offset)
+      ranges.emplace_back(offset, offset + index.GetBlockSize(block_num));
+    result[i] = block_num;
+  }
+
+  return result;
+}
+
+/*****************************************************************************/
+
 class WriteOnceTableBase {
  public:
   WriteOnceTableBase(kj::AutoCloseFd fd, uint64_t index_offset)
@@ -924,13 +2270,6 @@ class WriteOnceTableBase {
   uint64_t index_offset_;
 };
 
-class WriteOnceTable : public WriteOnceTableBase, public Table {
- public:
-  WriteOnceTable(kj::AutoCloseFd fd, const struct stat& st,
-                 uint64_t index_offset)
-      : WriteOnceTableBase(std::move(fd), index_offset), Table(st) {}
-};
-
 class WriteOnceSeekableTable : public WriteOnceTableBase, public SeekableTable {
  public:
   WriteOnceSeekableTable(kj::AutoCloseFd fd, const struct stat& st,
@@ -981,32 +2320,161 @@ class WriteOnceSeekableTable : public WriteOnceTableBase, public SeekableTable {
 
 /*****************************************************************************/
 
-class WriteOnceTable_v4 final : public WriteOnceTable {
+// Reads tables block by block.  Entries are addressed by virtual offsets,
+// which are only stable for tables written as seekable.
+class WriteOnceTable_v4 final : public WriteOnceTableBase,
+                                public SeekableTable {
  public:
   WriteOnceTable_v4(kj::AutoCloseFd fd, const struct stat& st,
-                    uint64_t index_offset, TableCompression compression)
-      : WriteOnceTable(std::move(fd), st, index_offset),
+                    uint64_t index_offset, TableCompression compression,
+                    bool prefixed, const WriteOnceSections& sections)
+      : WriteOnceTableBase(std::move(fd), index_offset),
+        SeekableTable(st),
         compression_(compression),
-        index_cache_(index_),
-        block_cache_(block_) {
-    ReadIndex();
+        prefixed_(prefixed),
+        index_cache_(index_) {
+    ReadIndex(sections.Get(CA_WO_SECTION_INDEX));
+    ReadFilter(sections.Get(CA_WO_SECTION_FILTER));
+    ReadDictionary(sections.Get(CA_WO_SECTION_DICTIONARY));
+    ReadStatistics(sections.Get(CA_WO_SECTION_STATISTICS));
+    ReadKeyStatistics(sections.Get(CA_WO_SECTION_KEY_STATISTICS));
+    if (compression_ == kTableCompressionNone && memory_mapping_enabled)
+      MapData();
   }
 
   int IsSorted() override { return 1; }
 
+  bool GetStatistics(TableStatistics& statistics) override {
+    if (!has_statistics_) return false;
+    statistics = statistics_.get();
+    return true;
+  }
+
+  bool GetKeyStatistics(const string_view& key,
+                        KeyStatistics& statistics) override {
+    if (!key_statistics_section_.size) return false;
+
+    WriteOnceBlockCache::BlockPtr block;
+    uint64_t block_num = UINT64_MAX;
+    WriteOnceReadBlock::KeyBuffer key_buffer;
+
+    const uint32_t entry_num = FindEntry(key, block, block_num, key_buffer);
+    if (entry_num == UINT32_MAX) return false;
+
+    FileIO(fd_).Read(&statistics,
+                     key_statistics_section_.offset +
+                         (key_statistics_base_[block_num] + entry_num) *
+                             sizeof(KeyStatistics),
+                     sizeof(KeyStatistics));
+    return true;
+  }
+
+  bool Get(const string_view& key,
+           const std::function<void(const string_view& value)>& callback)
+      const override {
+    WriteOnceBlockCache::BlockPtr block;
+    uint64_t block_num = UINT64_MAX;
+    WriteOnceReadBlock::KeyBuffer key_buffer;
+
+    const uint32_t entry_num = FindEntry(key, block, block_num, key_buffer);
+    if (entry_num == UINT32_MAX) return false;
+
+    callback(block->GetValue(entry_num));
+    return true;
+  }
+
+  void MultiGet(const std::vector<string_view>& keys,
+                const std::function<void(size_t index,
+                                         const string_view& value)>& callback)
+      const override {
+    // Visit the keys in order, so that each block is loaded only once.
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&keys](size_t lhs, size_t rhs) {
+                       return keys[lhs] < keys[rhs];
+                     });
+
+    WriteOnceBlockCache::BlockPtr block;
+    uint64_t block_num = UINT64_MAX;
+    WriteOnceReadBlock::KeyBuffer key_buffer;
+
+    for (size_t i : order) {
+      const uint32_t entry_num =
+          FindEntry(keys[i], block, block_num, key_buffer);
+      if (entry_num != UINT32_MAX) callback(i, block->GetValue(entry_num));
+    }
+  }
+
+  void SeekToKeys(const std::vector<string_view>& keys,
+                  const std::function<void(size_t index)>& callback) override {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    const auto block_nums =
+        FindBlocksByKeys(index_, index_cache_, filter_, keys, ranges);
+    AdviseWillNeed(fd_, ranges);
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+      const uint64_t block_num = block_nums[i];
+      if (block_num == UINT64_MAX) continue;
+
+      if (block_num != block_read_num_) ReadBlock(block_num);
+      const uint32_t entry_num = block_->FindEntryByKey(keys[i], key_buffer_);
+      if (block_->GetKey(entry_num, key_buffer_) != keys[i]) continue;
+
+      block_num_ = block_num;
+      entry_num_ = entry_num;
+      callback(i);
+    }
+  }
+
   void SeekToFirst() override {
     block_num_ = 0;
     entry_num_ = 0;
   }
 
+  off_t Offset() override {
+    if (block_num_ == UINT64_MAX) return 0;
+    return (block_num_ << kVirtualOffsetEntryBits) | entry_num_;
+  }
+
+  off_t EndOffset() override {
+    return off_t(index_.num_blocks()) << kVirtualOffsetEntryBits;
+  }
+
+  void Seek(off_t offset, int whence) override {
+    KJ_REQUIRE(whence == SEEK_SET,
+               "compressed tables can only seek to absolute offsets");
+    KJ_REQUIRE(offset >= 0, "attempt to seek before start of table");
+
+    const uint64_t block_num = uint64_t(offset) >> kVirtualOffsetEntryBits;
+    const uint32_t entry_num = offset & kVirtualOffsetEntryMask;
+    if (block_num == index_.num_blocks()) {
+      KJ_REQUIRE(entry_num == 0, "attempt to seek past end of table");
+    } else {
+      KJ_REQUIRE(block_num < index_.num_blocks(),
+                 "attempt to seek past end of table");
+      KJ_REQUIRE(entry_num < index_.GetNumEntries(block_num),
+                 "invalid offset", offset);
+    }
+
+    block_num_ = block_num;
+    entry_num_ = entry_num;
+  }
+
   bool SeekToKey(const string_view& key) override {
     uint64_t block_num = index_cache_.FindBlockByKey(key);
     if (block_num >= index_.num_blocks()) return NotFound();
-    if (block_num != block_read_num_) ReadBlock(block_num);
 
     block_num_ = block_num;
-    entry_num_ = block_cache_.FindEntryByKey(key);
-    return block_cache_.GetKey(entry_num_) == key;
+    if (!filter_.MayContain(key)) {
+      // Stop at the start of the block, before any larger keys.
+      entry_num_ = 0;
+      return false;
+    }
+
+    if (block_num != block_read_num_) ReadBlock(block_num);
+    entry_num_ = block_->FindEntryByKey(key, key_buffer_);
+    return block_->GetKey(entry_num_, key_buffer_) == key;
   }
 
   bool Skip(size_t count) override {
@@ -1041,8 +2509,8 @@ class WriteOnceTable_v4 final : public WriteOnceTable {
     if (block_num_ >= index_.num_blocks()) return false;
     if (block_num_ != block_read_num_) ReadBlock(block_num_);
 
-    key = block_cache_.GetKey(entry_num_);
-    value = block_cache_.GetValue(entry_num_);
+    key = block_->GetKey(entry_num_, key_buffer_);
+    value = block_->GetValue(entry_num_);
 
     if (++entry_num_ >= index_.GetNumEntries(block_num_)) {
       ++block_num_;
@@ -1053,23 +2521,122 @@ class WriteOnceTable_v4 final : public WriteOnceTable {
   }
 
  private:
-  void ReadIndex() {
-    uint64_t size = st.st_size - index_offset_;
+  void ReadIndex(const WriteOnceSections::Section& section) {
     bool compressed = (compression_ != kTableCompressionNone);
-    index_.Unmarshal(Read(index_offset_, size, compressed));
+    index_.Unmarshal(Read(section.offset, section.size, compressed));
+    index_cache_.Build();
+  }
+
+  void ReadFilter(const WriteOnceSections::Section& section) {
+    if (!section.size) return;
+    filter_.Unmarshal(Read(section.offset, section.size, false));
+  }
+
+  void ReadDictionary(const WriteOnceSections::Section& section) {
+    if (!section.size) return;
+    dictionary_.Load(Read(section.offset, section.size, false));
+  }
+
+  void ReadStatistics(const WriteOnceSections::Section& section) {
+    if (!section.size) return;
+    statistics_.Unmarshal(Read(section.offset, section.size, false));
+    has_statistics_ = true;
+  }
+
+  // Only sizes the section; records are read one at a time on request.
+  void ReadKeyStatistics(const WriteOnceSections::Section& section) {
+    if (!section.size) return;
+
+    uint64_t num = 0;
+    key_statistics_base_.resize(index_.num_blocks());
+    for (size_t i = 0; i < index_.num_blocks(); ++i) {
+      key_statistics_base_[i] = num;
+      num += index_.GetNumEntries(i);
+    }
+    KJ_REQUIRE(section.size == num * sizeof(KeyStatistics),
+               "key statistics do not match the index", section.size, num);
+
+    key_statistics_section_ = section;
+  }
+
+  // Buffers and decompression context for reading from the file.  Each
+  // handle has one for its cursor, and each thread one for Get().
+  struct ReadContext {
+    DataBuffer read_buffer;
+    DataBuffer decompress_buffer;
+    ZstdDecompressor decompressor;
+  };
+
+  static ReadContext& GetThreadReadContext() {
+    static thread_local ReadContext context;
+    return context;
   }
 
   void ReadBlock(size_t num) {
+    block_ = LoadBlock(num, context_);
+    block_read_num_ = num;
+  }
+
+  // Returns a block from the block cache, loading it on a miss.  Safe to call
+  // from several threads with different contexts.
+  WriteOnceBlockCache::BlockPtr LoadBlock(size_t num,
+                                          ReadContext& context) const {
     KJ_REQUIRE(num < index_.num_blocks());
 
-    uint64_t offset = index_cache_.GetBlockOffset(num);
-    size_t size = index_.GetBlockSize(num);
-    uint32_t num_entries = index_.GetNumEntries(num);
-    bool compressed = (compression_ != kTableCompressionNone);
-    block_.Unmarshal(Read(offset, size, compressed), num_entries, false);
+    auto& block_cache = WriteOnceBlockCache::GetInstance();
+    const auto cache_key = WriteOnceBlockCache::MakeKey(st, num);
+
+    auto block = block_cache.Lookup(cache_key);
+    if (!block) {
+      uint64_t offset = index_cache_.GetBlockOffset(num);
+      size_t size = index_.GetBlockSize(num);
+      uint32_t num_entries = index_.GetNumEntries(num);
+      if (map_) {
+        KJ_REQUIRE(offset + size <= index_offset_);
+        block = std::make_shared<const WriteOnceReadBlock>(
+            map_, offset, size, num_entries, prefixed_);
+      } else {
+        bool compressed = (compression_ != kTableCompressionNone);
+        block = std::make_shared<const WriteOnceReadBlock>(
+            Read(context, offset, size, compressed, true), num_entries,
+            prefixed_);
+      }
+      block_cache.Insert(cache_key, block);
+    }
 
-    block_read_num_ = num;
-    block_cache_.Clear();
+    return block;
+  }
+
+  // Finds `key' without moving the cursor, for Get() and MultiGet().  Keeps
+  // `block' if it is already block number `block_num'.  Returns the entry
+  // number, or UINT32_MAX if the key does not exist.
+  uint32_t FindEntry(const string_view& key,
+                     WriteOnceBlockCache::BlockPtr& block, uint64_t& block_num,
+                     WriteOnceReadBlock::KeyBuffer& key_buffer) const {
+    const uint64_t num = index_cache_.FindBlockByKey(key);
+    if (num >= index_.num_blocks() || !filter_.MayContain(key))
+      return UINT32_MAX;
+
+    if (num != block_num) {
+      block = LoadBlock(num, GetThreadReadContext());
+      block_num = num;
+    }
+
+    const uint32_t entry_num = block->FindEntryByKey(key, key_buffer);
+    if (block->GetKey(entry_num, key_buffer) != key) return UINT32_MAX;
+    return entry_num;
+  }
+
+  // Maps the data section of an uncompressed table, so that blocks can be
+  // decoded in place.
+  void MapData() {
+    const size_t size = index_offset_;
+    void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) KJ_FAIL_SYSCALL("mmap", errno);
+
+    map_ = std::shared_ptr<const char>(
+        static_cast<const char*>(map),
+        [size](const char* map) { munmap(const_cast<char*>(map), size); });
   }
 
   bool NotFound() {
@@ -1079,34 +2646,58 @@ class WriteOnceTable_v4 final : public WriteOnceTable {
   }
 
   DataBuffer& Read(uint64_t offset, size_t size, bool compressed) {
-    read_buffer_.resize(size);
-    FileIO(fd_).Read(read_buffer_, offset);
+    return Read(context_, offset, size, compressed);
+  }
+
+  DataBuffer& Read(ReadContext& context, uint64_t offset, size_t size,
+                   bool compressed, bool use_dictionary = false) const {
+    context.read_buffer.resize(size);
+    FileIO(fd_).Read(context.read_buffer, offset);
 
-    if (!compressed) return read_buffer_;
+    if (!compressed) return context.read_buffer;
 
-    size_t decomp_size = ZSTD_getDecompressedSize(read_buffer_.data(), size);
-    decompress_buffer_.resize(decomp_size);
-    decompressor_.Go(decompress_buffer_, read_buffer_);
+    size_t decomp_size =
+        ZSTD_getDecompressedSize(context.read_buffer.data(), size);
+    context.decompress_buffer.resize(decomp_size);
+    if (use_dictionary && !dictionary_.empty())
+      context.decompressor.Go(context.decompress_buffer, context.read_buffer,
+                              dictionary_.ddict());
+    else
+      context.decompressor.Go(context.decompress_buffer, context.read_buffer);
 
-    return decompress_buffer_;
+    return context.decompress_buffer;
   }
 
   const TableCompression compression_;
+  const bool prefixed_;
 
   WriteOnceIndex index_;
   WriteOnceIndex::Cache index_cache_;
 
-  WriteOnceBlock block_;
-  WriteOnceBlock::Cache block_cache_;
+  WriteOnceFilter filter_;
+
+  WriteOnceStatistics statistics_;
+  bool has_statistics_ = false;
+
+  WriteOnceSections::Section key_statistics_section_;
+  // Number of the first key statistics record of each block.
+  std::vector<uint64_t> key_statistics_base_;
+
+  // Data section mapping, shared with the blocks decoded from it.
+  std::shared_ptr<const char> map_;
+
+  // The most recently read block, possibly shared with other handles.
+  WriteOnceBlockCache::BlockPtr block_;
+
+  // Keys reconstructed from `block_', if it uses prefix-compressed keys.
+  WriteOnceReadBlock::KeyBuffer key_buffer_;
 
   uint64_t block_read_num_ = UINT64_MAX;
   uint64_t block_num_ = UINT64_MAX;
   uint32_t entry_num_ = UINT32_MAX;
 
-  DataBuffer read_buffer_;
-  DataBuffer decompress_buffer_;
-  // Decompression context.
-  ZstdDecompressor decompressor_;
+  ReadContext context_;
+  ZstdDictionary dictionary_;
 };
 
 /*****************************************************************************/
@@ -1115,14 +2706,16 @@ class WriteOnceSeekableTable_v4 final : public WriteOnceSeekableTable {
  public:
   WriteOnceSeekableTable_v4(const std::string& path, kj::AutoCloseFd fd,
                             const struct stat& st, uint64_t index_offset,
-                            TableCompression compression)
+                            TableCompression compression,
+                            const WriteOnceSections& sections)
       : WriteOnceSeekableTable(std::move(fd), st, index_offset),
         index_cache_(index_) {
-    uint64_t size = st.st_size - index_offset_;
+    const auto index_section = sections.Get(CA_WO_SECTION_INDEX);
+    uint64_t size = index_section.size;
 
     DataBuffer read_buffer;
     read_buffer.resize(size);
-    FileIO(fd_).Read(read_buffer, index_offset_);
+    FileIO(fd_).Read(read_buffer, index_section.offset);
 
     if (compression == kTableCompressionNone) {
       index_.Unmarshal(read_buffer);
@@ -1137,6 +2730,29 @@ class WriteOnceSeekableTable_v4 final : public WriteOnceSeekableTable {
 
       index_.Unmarshal(decompress_buffer);
     }
+    index_cache_.Build();
+
+    const auto filter_section = sections.Get(CA_WO_SECTION_FILTER);
+    if (filter_section.size) {
+      read_buffer.resize(filter_section.size);
+      FileIO(fd_).Read(read_buffer, filter_section.offset);
+      filter_.Unmarshal(read_buffer);
+    }
+
+    const auto restarts_section = sections.Get(CA_WO_SECTION_RESTARTS);
+    if (restarts_section.size) {
+      read_buffer.resize(restarts_section.size);
+      FileIO(fd_).Read(read_buffer, restarts_section.offset);
+      restarts_.Unmarshal(read_buffer, index_);
+    }
+
+    const auto statistics_section = sections.Get(CA_WO_SECTION_STATISTICS);
+    if (statistics_section.size) {
+      read_buffer.resize(statistics_section.size);
+      FileIO(fd_).Read(read_buffer, statistics_section.offset);
+      statistics_.Unmarshal(read_buffer);
+      has_statistics_ = true;
+    }
 
     map_ = mmap(NULL, index_offset_, PROT_READ, MAP_SHARED, fd_, 0);
     if (MAP_FAILED == map_) KJ_FAIL_SYSCALL("mmap", errno, path);
@@ -1148,39 +2764,112 @@ class WriteOnceSeekableTable_v4 final : public WriteOnceSeekableTable {
 
   int IsSorted() override { return 1; }
 
+  bool GetStatistics(TableStatistics& statistics) override {
+    if (!has_statistics_) return false;
+    statistics = statistics_.get();
+    return true;
+  }
+
   bool SeekToKey(const string_view& key) override {
+    bool found;
+    offset_ = FindOffsetByKey(key, found);
+    return found;
+  }
+
+  void SeekToKeys(const std::vector<string_view>& keys,
+                  const std::function<void(size_t index)>& callback) override {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    const auto block_nums =
+        FindBlocksByKeys(index_, index_cache_, filter_, keys, ranges);
+    AdviseWillNeed(fd_, ranges);
+
+    // Keys are sorted, so each search can resume where the previous one
+    // ended, instead of going back to the restart point.
+    uint64_t offset = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (block_nums[i] == UINT64_MAX) continue;
+
+      bool found;
+      offset = FindOffsetInBlock(block_nums[i], keys[i], offset, found);
+      if (!found) continue;
+
+      offset_ = offset;
+      callback(i);
+    }
+  }
+
+  bool ReadRow(string_view& key, string_view& value) override {
+    if (offset_ >= index_offset_) return false;
+    offset_ = DecodeRow(offset_, key, value);
+    return true;
+  }
+
+  bool Get(const string_view& key,
+           const std::function<void(const string_view& value)>& callback)
+      const override {
+    bool found;
+    const uint64_t offset = FindOffsetByKey(key, found);
+    if (!found) return false;
+
+    string_view row_key, value;
+    DecodeRow(offset, row_key, value);
+    callback(value);
+    return true;
+  }
+
+ private:
+  // Returns the offset of the first row whose key is not less than `key',
+  // or, if the filter rules the key out, of the start of its block.
+  uint64_t FindOffsetByKey(const string_view& key, bool& found) const {
+    found = false;
+
     uint64_t block_num = index_cache_.FindBlockByKey(key);
+    if (block_num >= index_.num_blocks()) return index_offset_;
 
-    if (block_num < index_.num_blocks()) {
-      const unsigned char* base = reinterpret_cast<unsigned char*>(map_);
-      const unsigned char* ptr = base + index_cache_.GetBlockOffset(block_num);
-      const unsigned char* end = base + index_offset_;
-
-      while (ptr < end) {
-        const unsigned char* start_ptr = ptr;
-        uint32_t k_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
-        uint32_t v_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
-
-        string_view cur(reinterpret_cast<const char*>(ptr), k_size);
-        int result = cur.compare(key);
-        if (result >= 0) {
-          offset_ = start_ptr - base;
-          return result == 0;
-        }
+    // Stop at the start of the block, before any larger keys.
+    if (!filter_.MayContain(key)) return index_cache_.GetBlockOffset(block_num);
 
-        ptr += k_size + v_size;
+    return FindOffsetInBlock(block_num, key, 0, found);
+  }
+
+  // Scans block number `block_num' for the first row whose key is not less
+  // than `key', starting no earlier than `min_offset', which must not be
+  // past that row.
+  uint64_t FindOffsetInBlock(uint64_t block_num, const string_view& key,
+                             uint64_t min_offset, bool& found) const {
+    found = false;
+
+    const unsigned char* base = reinterpret_cast<unsigned char*>(map_);
+    const unsigned char* ptr = base + index_cache_.GetBlockOffset(block_num);
+    const unsigned char* end = base + index_offset_;
+
+    if (!restarts_.empty())
+      ptr += restarts_.FindOffsetByKey(block_num, ptr, key);
+    ptr = std::max(ptr, base + min_offset);
+
+    while (ptr < end) {
+      const unsigned char* start_ptr = ptr;
+      uint32_t k_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
+      uint32_t v_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
+
+      string_view cur(reinterpret_cast<const char*>(ptr), k_size);
+      int result = cur.compare(key);
+      if (result >= 0) {
+        found = (result == 0);
+        return start_ptr - base;
       }
+
+      ptr += k_size + v_size;
     }
 
-    offset_ = index_offset_;
-    return false;
+    return index_offset_;
   }
 
-  bool ReadRow(string_view& key, string_view& value) override {
-    if (offset_ >= index_offset_) return false;
-
+  // Decodes the row at `offset', and returns the offset of the next row.
+  uint64_t DecodeRow(uint64_t offset, string_view& key,
+                     string_view& value) const {
     const unsigned char* base = reinterpret_cast<unsigned char*>(map_);
-    const unsigned char* ptr = base + offset_;
+    const unsigned char* ptr = base + offset;
 
     uint32_t k_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
     uint32_t v_size = oroch::varint_codec<uint32_t>::value_decode(ptr);
@@ -1191,17 +2880,22 @@ class WriteOnceSeekableTable_v4 final : public WriteOnceSeekableTable {
     value = string_view(reinterpret_cast<const char*>(ptr), v_size);
     ptr += v_size;
 
-    offset_ = ptr - base;
-    KJ_REQUIRE(offset_ <= index_offset_);
+    offset = ptr - base;
+    KJ_REQUIRE(offset <= index_offset_);
 
-    return true;
+    return offset;
   }
 
- private:
   void* map_ = MAP_FAILED;
 
   WriteOnceIndex index_;
   WriteOnceIndex::Cache index_cache_;
+
+  WriteOnceFilter filter_;
+  WriteOnceRestartIndex restarts_;
+
+  WriteOnceStatistics statistics_;
+  bool has_statistics_ = false;
 };
 
 /*****************************************************************************/
@@ -1231,6 +2925,38 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
   }
 
   bool SeekToKey(const string_view& key) override {
+    const uint64_t offset = FindOffset(key);
+    if (!offset) return false;
+    offset_ = offset;
+    return true;
+  }
+
+  bool Get(const string_view& key,
+           const std::function<void(const string_view& value)>& callback)
+      const override {
+    const uint64_t offset = FindOffset(key);
+    if (!offset) return false;
+
+    string_view row_key, value;
+    KJ_REQUIRE(DecodeRow(offset, row_key, value));
+    callback(value);
+    return true;
+  }
+
+  bool ReadRow(string_view& key, string_view& value) override {
+    KJ_REQUIRE(offset_ >= sizeof(struct CA_wo_header));
+
+    const uint64_t next_offset = DecodeRow(offset_, key, value);
+    if (!next_offset) return false;
+    offset_ = next_offset;
+    return true;
+  }
+
+ private:
+  // Probes the hash index for `key' without moving the cursor, for
+  // SeekToKey() and Get().  Returns the offset of its row, or zero if the
+  // key does not exist.
+  uint64_t FindOffset(const string_view& key) const {
     if (!has_madvised_index_) MAdviseIndex();
 
     uint64_t hash, tmp_offset;
@@ -1262,7 +2988,7 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
           break;
       }
 
-      if (!tmp_offset) return false;
+      if (!tmp_offset) return 0;
 
       if (tmp_offset >= min_offset && tmp_offset <= max_offset) {
         auto data = reinterpret_cast<const char*>(buffer_) + tmp_offset;
@@ -1273,8 +2999,7 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
         auto cmp = key.compare(data);
 
         if (cmp == 0) {
-          offset_ = tmp_offset;
-          return true;
+          return tmp_offset;
         } else if (cmp < 0) {
           if (0 != (header_->flags & CA_WO_FLAG_ASCENDING))
             max_offset = tmp_offset;
@@ -1293,14 +3018,15 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
       }
     }
 
-    return false;
+    return 0;
   }
 
-  bool ReadRow(string_view& key, string_view& value) override {
-    KJ_REQUIRE(offset_ >= sizeof(struct CA_wo_header));
-
-    uint8_t* p = reinterpret_cast<uint8_t*>(buffer_) + offset_;
-    if (offset_ >= header_->index_offset || *p == 0) return false;
+  // Decodes the row at `offset'.  Returns the offset of the next row, or
+  // zero at the end of the data.
+  uint64_t DecodeRow(uint64_t offset, string_view& key,
+                     string_view& value) const {
+    uint8_t* p = reinterpret_cast<uint8_t*>(buffer_) + offset;
+    if (offset >= header_->index_offset || *p == 0) return 0;
 
     uint64_t size = ca_parse_integer((const uint8_t**)&p);
 
@@ -1312,12 +3038,9 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
     value = string_view(reinterpret_cast<char*>(p) + key.size() + 1,
                         size - key.size() - 1);
 
-    offset_ = p + size - reinterpret_cast<uint8_t*>(buffer_);
-
-    return true;
+    return p + size - reinterpret_cast<uint8_t*>(buffer_);
   }
 
- private:
   void MemoryMap(const std::string& path) {
     uint64_t size = st.st_size;
 
@@ -1351,7 +3074,7 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
     offset_ = sizeof(struct CA_wo_header);
   }
 
-  void MAdviseIndex() {
+  void MAdviseIndex() const {
     auto base = reinterpret_cast<ptrdiff_t>(buffer_) + header_->index_offset;
     auto end = reinterpret_cast<ptrdiff_t>(buffer_) + buffer_fill_;
     base &= ~0xfff;
@@ -1377,7 +3100,8 @@ class WriteOnceTable_v3 final : public WriteOnceSeekableTable {
   uint64_t index_size_ = 0;
   unsigned int index_bits_ = 0;
 
-  bool has_madvised_index_ = false;
+  // Set by the first lookup, from any thread.
+  mutable std::atomic<bool> has_madvised_index_{false};
 };
 
 /*****************************************************************************/
@@ -1394,15 +3118,40 @@ void ReadHeader(struct CA_wo_header& header, int fd) {
   } else {
     KJ_REQUIRE(header.compression <= kTableCompressionLast,
                "unsupported compression method", header.compression);
-    if ((header.flags & CA_WO_FLAG_EXTENDED) != 0)
-      KJ_UNIMPLEMENTED("extended write-once tables are not supported yet");
+    KJ_REQUIRE((header.flags & CA_WO_FLAG_SEEKABLE) == 0 ||
+                   (header.flags & CA_WO_FLAG_PREFIXED_KEYS) == 0 ||
+                   header.compression != kTableCompressionNone,
+               "uncompressed seekable tables cannot use prefix-compressed "
+               "keys");
   }
 }
 
+// Uncompressed seekable tables are addressed by file offsets, all others by
+// block.
+std::unique_ptr<SeekableTable> OpenTable_v4(const char* path,
+                                            kj::AutoCloseFd fd,
+                                            const struct stat& st,
+                                            const struct CA_wo_header& header,
+                                            const WriteOnceSections& sections) {
+  TableCompression compression = TableCompression(header.compression);
+  if ((header.flags & CA_WO_FLAG_SEEKABLE) == 0 ||
+      compression != kTableCompressionNone)
+    return std::make_unique<WriteOnceTable_v4>(
+        std::move(fd), st, header.index_offset, compression,
+        (header.flags & CA_WO_FLAG_PREFIXED_KEYS) != 0, sections);
+
+  return std::make_unique<WriteOnceSeekableTable_v4>(
+      path, std::move(fd), st, header.index_offset, compression, sections);
+}
+
 }  // namespace
 
 /*****************************************************************************/
 
+void WriteOnceTableBackend::SetBlockCacheCapacity(size_t capacity) {
+  WriteOnceBlockCache::GetInstance().SetCapacity(capacity);
+}
+
 std::unique_ptr<TableBuilder> WriteOnceTableBackend::Create(
     const char* path, const TableOptions& options) {
   return options.GetInputUnsorted()
@@ -1420,13 +3169,10 @@ std::unique_ptr<Table> WriteOnceTableBackend::Open(const char* path,
     return std::make_unique<WriteOnceTable_v3>(path, std::move(fd), st,
                                                header.index_offset);
 
-  TableCompression compression = TableCompression(header.compression);
-  if ((header.flags & CA_WO_FLAG_SEEKABLE) == 0)
-    return std::make_unique<WriteOnceTable_v4>(
-        std::move(fd), st, header.index_offset, compression);
+  WriteOnceSections sections;
+  sections.Read(fd, st, header);
 
-  return std::make_unique<WriteOnceSeekableTable_v4>(
-      path, std::move(fd), st, header.index_offset, compression);
+  return OpenTable_v4(path, std::move(fd), st, header, sections);
 }
 
 std::unique_ptr<SeekableTable> WriteOnceTableBackend::OpenSeekable(
@@ -1441,11 +3187,19 @@ std::unique_ptr<SeekableTable> WriteOnceTableBackend::OpenSeekable(
   if ((header.flags & CA_WO_FLAG_SEEKABLE) == 0)
     KJ_FAIL_REQUIRE("the write-once table is not seekable", path);
 
-  TableCompression compression = TableCompression(header.compression);
-  return std::make_unique<WriteOnceSeekableTable_v4>(
-      path, std::move(fd), st, header.index_offset, compression);
+  WriteOnceSections sections;
+  sections.Read(fd, st, header);
+
+  return OpenTable_v4(path, std::move(fd), st, header, sections);
 }
 
 }  // namespace internal
+
+/*****************************************************************************/
+
+BlockCacheStatistics GetBlockCacheStatistics() {
+  return internal::WriteOnceBlockCache::GetInstance().GetStatistics();
+}
+
 }  // namespace table
 }  // namespace cantera
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -111,6 +115,47 @@ TEST_F(WriteOnceTest, CanWriteThenReadUnsorted) {
   EXPECT_TRUE(table_handle->SeekToKey("b"));
 }
 
+TEST_F(WriteOnceTest, ExternalSortMatchesInMemorySort) {
+  // Keys share long prefixes, and some values are larger than a run buffer.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 5000; ++i)
+    keys.emplace_back("https://example.com/path/" + std::to_string(i));
+  std::vector<std::string> shuffled(keys);
+  for (size_t i = shuffled.size(), x = 1; i > 1; --i) {
+    x = x * 1103515245 + 12345;
+    std::swap(shuffled[i - 1], shuffled[(x >> 16) % i]);
+  }
+  auto make_value = [](const std::string& key) {
+    return std::string(key.size() % 7 ? 10 : 100000, key.back());
+  };
+
+  for (std::string name : {"memory", "runs"}) {
+    auto options =
+        TableOptions().SetInputUnsorted(true).SetSortThreads(3).SetNoFSync();
+    if (name == "runs") options.SetSortMemoryLimit(256 * 1024);
+
+    auto builder = TableFactory::Create(
+        "write-once", (temp_directory_ + "/table_" + name).c_str(), options);
+    for (const auto& key : shuffled) builder->InsertRow(key, make_value(key));
+    builder->Sync();
+  }
+
+  std::string cmd = "cmp -s " + temp_directory_ + "/table_memory " +
+                    temp_directory_ + "/table_runs";
+  EXPECT_EQ(0, system(cmd.c_str()));
+
+  std::sort(keys.begin(), keys.end());
+  auto table_handle =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_runs").c_str());
+  cantera::string_view k, v;
+  for (const auto& key : keys) {
+    ASSERT_TRUE(table_handle->ReadRow(k, v));
+    EXPECT_EQ(key, k);
+    EXPECT_EQ(make_value(key), v);
+  }
+  EXPECT_FALSE(table_handle->ReadRow(k, v));
+}
+
 TEST_F(WriteOnceTest, EmptyTableOK) {
   auto builder = TableFactory::Create(
       "write-once", (temp_directory_ + "/table_00").c_str(), TableOptions());
@@ -130,3 +175,557 @@ TEST_F(WriteOnceTest, UnsyncedTableNotWritten) {
       TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str()),
       kj::Exception);
 }
+
+TEST_F(WriteOnceTest, BlockCacheSharedBetweenHandles) {
+  auto builder = TableFactory::Create(
+      "write-once", (temp_directory_ + "/table_00").c_str(), TableOptions());
+  char key[16];
+  const std::string value(200, 'x');
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof(key), "%06d", i);
+    builder->InsertRow(key, value);
+  }
+  builder->Sync();
+  builder.reset();
+
+  auto table_a =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str());
+  auto table_b =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str());
+
+  EXPECT_TRUE(table_a->SeekToKey("000500"));
+  const auto before = GetBlockCacheStatistics();
+  EXPECT_TRUE(table_b->SeekToKey("000500"));
+  const auto after = GetBlockCacheStatistics();
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(before.misses, after.misses);
+
+  cantera::string_view k, v;
+  ASSERT_TRUE(table_b->ReadRow(k, v));
+  EXPECT_EQ("000500", k);
+  EXPECT_EQ(value, v);
+}
+
+TEST_F(WriteOnceTest, MemoryMappedReadMatchesBuffered) {
+  auto builder = TableFactory::Create(
+      "write-once", (temp_directory_ + "/table_00").c_str(), TableOptions());
+  char key[16];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(key, sizeof(key), "%06d", i);
+    builder->InsertRow(key, std::string(i % 300, 'a' + i % 26));
+  }
+  builder->Sync();
+  builder.reset();
+
+  const auto capacity = GetBlockCacheStatistics().capacity;
+  SetBlockCacheCapacity(0);
+
+  SetTableMemoryMapping(false);
+  auto buffered =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str());
+  SetTableMemoryMapping(true);
+  auto mapped =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str());
+
+  cantera::string_view key_a, value_a, key_b, value_b;
+  size_t count = 0;
+  while (buffered->ReadRow(key_a, value_a)) {
+    ASSERT_TRUE(mapped->ReadRow(key_b, value_b));
+    EXPECT_EQ(key_a, key_b);
+    EXPECT_EQ(value_a, value_b);
+    ++count;
+  }
+  EXPECT_FALSE(mapped->ReadRow(key_b, value_b));
+  EXPECT_EQ(1000U, count);
+
+  EXPECT_TRUE(mapped->SeekToKey("000777"));
+  ASSERT_TRUE(mapped->ReadRow(key_b, value_b));
+  EXPECT_EQ("000777", key_b);
+
+  SetBlockCacheCapacity(capacity);
+}
+
+TEST_F(WriteOnceTest, FilterRejectsMissingKeys) {
+  for (bool seekable : {false, true}) {
+    const auto path = temp_directory_ + (seekable ? "/table_01" : "/table_00");
+    auto builder = TableFactory::Create("write-once", path.c_str(),
+                                        TableOptions()
+                                            .SetFilterBitsPerKey(10)
+                                            .SetOutputSeekable(seekable));
+    char key[16];
+    for (int i = 0; i < 2000; i += 2) {
+      snprintf(key, sizeof(key), "%06d", i);
+      builder->InsertRow(key, "xxx");
+    }
+    builder->Sync();
+    builder.reset();
+
+    auto table_handle = TableFactory::Open("write-once", path.c_str());
+    for (int i = 0; i < 2000; i += 2) {
+      snprintf(key, sizeof(key), "%06d", i);
+      EXPECT_TRUE(table_handle->SeekToKey(key));
+    }
+
+    // A failed lookup must not move the cursor past larger keys.
+    for (int i = 1; i < 1998; i += 2) {
+      snprintf(key, sizeof(key), "%06d", i);
+      EXPECT_FALSE(table_handle->SeekToKey(key));
+
+      cantera::string_view k, v;
+      do {
+        ASSERT_TRUE(table_handle->ReadRow(k, v));
+      } while (k < key);
+      snprintf(key, sizeof(key), "%06d", i + 1);
+      EXPECT_EQ(key, k);
+    }
+  }
+}
+
+TEST_F(WriteOnceTest, PrefixCompressedKeys) {
+  for (auto compression : {kTableCompressionNone, kTableCompressionZSTD}) {
+    const auto path = temp_directory_ + "/table_" + std::to_string(compression);
+    auto builder = TableFactory::Create("write-once", path.c_str(),
+                                        TableOptions()
+                                            .SetCompression(compression)
+                                            .SetBlockRestartInterval(16));
+    std::vector<std::string> keys;
+    char key[32];
+    for (int i = 0; i < 5000; i += 2) {
+      snprintf(key, sizeof(key), "name:%03d.example.%s", i / 10,
+               (i % 10 < 5) ? "com" : "net");
+      if (!keys.empty() && keys.back() >= key) continue;
+      keys.emplace_back(key);
+      builder->InsertRow(key, std::to_string(i));
+    }
+    builder->Sync();
+    builder.reset();
+
+    auto table_handle = TableFactory::Open("write-once", path.c_str());
+
+    cantera::string_view k, v;
+    for (const auto& expected : keys) {
+      ASSERT_TRUE(table_handle->ReadRow(k, v));
+      EXPECT_EQ(expected, k);
+    }
+    EXPECT_FALSE(table_handle->ReadRow(k, v));
+
+    for (size_t i = keys.size(); i-- > 0;) {
+      EXPECT_TRUE(table_handle->SeekToKey(keys[i]));
+      ASSERT_TRUE(table_handle->ReadRow(k, v));
+      EXPECT_EQ(keys[i], k);
+
+      EXPECT_FALSE(table_handle->SeekToKey(keys[i] + "!"));
+      if (i + 1 < keys.size()) {
+        ASSERT_TRUE(table_handle->ReadRow(k, v));
+        EXPECT_EQ(keys[i + 1], k);
+      }
+    }
+    EXPECT_FALSE(table_handle->SeekToKey("a"));
+  }
+}
+
+TEST_F(WriteOnceTest, SeekableLookupsAndOffsets) {
+  for (auto compression : {kTableCompressionNone, kTableCompressionZSTD}) {
+    const std::string path =
+        temp_directory_ + "/table_" + std::to_string(compression);
+    auto builder = TableFactory::Create(
+        "write-once", path.c_str(),
+        TableOptions().SetOutputSeekable(true).SetCompression(compression));
+    char key[16];
+    for (int i = 0; i < 5000; i += 2) {
+      snprintf(key, sizeof(key), "%06d", i);
+      builder->InsertRow(key, std::string(i % 50, 'v'));
+    }
+    builder->Sync();
+    builder.reset();
+
+    auto table_handle = TableFactory::OpenSeekable("write-once", path.c_str());
+
+    std::vector<off_t> offsets;
+    cantera::string_view k, v;
+    for (;;) {
+      offsets.push_back(table_handle->Offset());
+      if (!table_handle->ReadRow(k, v)) break;
+    }
+
+    for (int i = 0; i < 5000; ++i) {
+      snprintf(key, sizeof(key), "%06d", i);
+      EXPECT_EQ(i % 2 == 0, table_handle->SeekToKey(key));
+      EXPECT_EQ(offsets[(i + 1) / 2], table_handle->Offset());
+    }
+
+    for (int i : {1234, 0, 2499, 17, 1000}) {
+      table_handle->Seek(offsets[i], SEEK_SET);
+      ASSERT_TRUE(table_handle->ReadRow(k, v));
+      snprintf(key, sizeof(key), "%06d", i * 2);
+      EXPECT_EQ(key, k);
+      EXPECT_EQ(std::string(i * 2 % 50, 'v'), v);
+    }
+
+    table_handle->Seek(offsets.back(), SEEK_SET);
+    EXPECT_FALSE(table_handle->ReadRow(k, v));
+
+    EXPECT_LE(offsets.back(), table_handle->EndOffset());
+  }
+}
+
+TEST_F(WriteOnceTest, IndexLookupsWithSharedPrefixes) {
+  // Many blocks whose last keys share their first 8 bytes, of varying length.
+  std::vector<std::string> keys;
+  char key[64];
+  for (int i = 0; i < 20000; ++i) {
+    snprintf(key, sizeof(key), "%s%0*d", (i % 3) ? "shared-prefix/" : "shared",
+             i % 7 + 5, i);
+    keys.emplace_back(key);
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  auto builder = TableFactory::Create(
+      "write-once", (temp_directory_ + "/table_00").c_str(), TableOptions());
+  for (const auto& key : keys) builder->InsertRow(key, std::string(200, 'v'));
+  builder->Sync();
+  builder.reset();
+
+  auto table_handle =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str());
+  cantera::string_view k, v;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_TRUE(table_handle->SeekToKey(keys[i]));
+    ASSERT_TRUE(table_handle->ReadRow(k, v));
+    EXPECT_EQ(keys[i], k);
+
+    // A key sorting right after this one finds the next key.
+    EXPECT_FALSE(table_handle->SeekToKey(keys[i] + std::string(1, '\0')));
+    if (i + 1 < keys.size()) {
+      ASSERT_TRUE(table_handle->ReadRow(k, v));
+      EXPECT_EQ(keys[i + 1], k);
+    } else {
+      EXPECT_FALSE(table_handle->ReadRow(k, v));
+    }
+  }
+
+  EXPECT_FALSE(table_handle->SeekToKey("a"));
+  ASSERT_TRUE(table_handle->ReadRow(k, v));
+  EXPECT_EQ(keys.front(), k);
+  EXPECT_FALSE(table_handle->SeekToKey("z"));
+  EXPECT_FALSE(table_handle->ReadRow(k, v));
+}
+
+TEST_F(WriteOnceTest, Statistics) {
+  auto builder = TableFactory::Create(
+      "write-once", (temp_directory_ + "/table_00").c_str(),
+      TableOptions().SetStatistics().SetOffsetScoreStatistics().SetInputUnsorted(
+          true));
+  std::vector<ca_offset_score> values;
+  for (int i = 0; i < 100; ++i) {
+    values.emplace_back(i * 3, i);
+    ca_table_write_offset_score(builder.get(), "key" + std::to_string(i),
+                                values.data(), values.size());
+  }
+  builder->Sync();
+  builder.reset();
+
+  auto table_handle =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_00").c_str());
+  TableStatistics statistics;
+  ASSERT_TRUE(table_handle->GetStatistics(statistics));
+  EXPECT_EQ(100U, statistics.row_count);
+  EXPECT_EQ("key0", statistics.min_key);
+  EXPECT_EQ("key99", statistics.max_key);
+  EXPECT_TRUE(statistics.has_offset_scores);
+  EXPECT_EQ(100U * 101 / 2, statistics.offset_score_count);
+
+  uint64_t key_bytes = 0, value_bytes = 0, encoded_rows = 0;
+  cantera::string_view k, v;
+  while (table_handle->ReadRow(k, v)) {
+    key_bytes += k.size();
+    value_bytes += v.size();
+  }
+  for (const auto& encoding : statistics.offset_score_encodings)
+    encoded_rows += encoding.second;
+  EXPECT_EQ(key_bytes, statistics.key_bytes);
+  EXPECT_EQ(value_bytes, statistics.value_bytes);
+  EXPECT_EQ(100U, encoded_rows);
+
+  // Statistics are only stored on request.
+  builder = TableFactory::Create(
+      "write-once", (temp_directory_ + "/table_01").c_str(),
+      TableOptions().SetOffsetScoreStatistics());
+  builder->InsertRow("a", "");
+  builder->Sync();
+  builder.reset();
+
+  EXPECT_FALSE(
+      TableFactory::Open("write-once", (temp_directory_ + "/table_01").c_str())
+          ->GetStatistics(statistics));
+}
+
+TEST_F(WriteOnceTest, KeyStatistics) {
+  // Enough keys to spill records to the builder's temporary file.
+  for (auto compression : {kTableCompressionNone, kTableCompressionZSTD}) {
+    const std::string path =
+        temp_directory_ + "/table_" + std::to_string(compression);
+    auto builder = TableFactory::Create(
+        "write-once", path.c_str(),
+        TableOptions().SetKeyStatistics().SetCompression(compression));
+    for (int i = 0; i < 10000; ++i) {
+      std::vector<ca_offset_score> values;
+      for (int j = 0; j <= i % 10; ++j)
+        values.emplace_back(i + j * 100, j - i % 3);
+      ca_table_write_offset_score(builder.get(), std::to_string(i + 10000),
+                                  values.data(), values.size());
+    }
+    builder->Sync();
+    builder.reset();
+
+    auto table_handle = TableFactory::Open("write-once", path.c_str());
+    KeyStatistics statistics;
+    for (int i = 0; i < 10000; ++i) {
+      ASSERT_TRUE(table_handle->GetKeyStatistics(std::to_string(i + 10000),
+                                                 statistics));
+      EXPECT_EQ(uint64_t(i % 10 + 1), statistics.count);
+      EXPECT_EQ(uint64_t(i), statistics.min_offset);
+      EXPECT_EQ(uint64_t(i + i % 10 * 100), statistics.max_offset);
+      EXPECT_EQ(-(i % 3), statistics.min_score);
+      EXPECT_EQ(i % 10 - i % 3, statistics.max_score);
+    }
+    EXPECT_FALSE(table_handle->GetKeyStatistics("9999", statistics));
+    EXPECT_FALSE(table_handle->GetKeyStatistics("20000", statistics));
+  }
+
+  // Tables written without them have no key statistics.
+  auto builder = TableFactory::Create(
+      "write-once", (temp_directory_ + "/table_plain").c_str(), TableOptions());
+  builder->InsertRow("a", "");
+  builder->Sync();
+  builder.reset();
+
+  KeyStatistics statistics;
+  EXPECT_FALSE(TableFactory::Open("write-once",
+                                  (temp_directory_ + "/table_plain").c_str())
+                   ->GetKeyStatistics("a", statistics));
+}
+
+// Builders open at the same time encode lists in their own formats.
+TEST_F(WriteOnceTest, OffsetScoreFormat) {
+  std::vector<ca_offset_score> values;
+  for (int i = 0; i < 1000; ++i) values.emplace_back(i * 2, 1.0f);
+
+  OffsetScoreFormat format;
+  format.bitmaps = true;
+  const std::string plain_path = temp_directory_ + "/table_plain";
+  const std::string bitmap_path = temp_directory_ + "/table_bitmap";
+  auto plain = TableFactory::Create("write-once", plain_path.c_str(),
+                                    TableOptions());
+  auto bitmap = TableFactory::Create(
+      "write-once", bitmap_path.c_str(),
+      TableOptions().SetOffsetScoreFormat(format));
+  ca_table_write_offset_score(bitmap.get(), "a", values.data(), values.size());
+  ca_table_write_offset_score(plain.get(), "a", values.data(), values.size());
+  plain->Sync();
+  bitmap->Sync();
+  plain.reset();
+  bitmap.reset();
+
+  for (const auto& path : {plain_path, bitmap_path}) {
+    uint8_t type = 0;
+    ASSERT_TRUE(TableFactory::Open("write-once", path.c_str())
+                    ->Get("a", [&type](const cantera::string_view& value) {
+                      type = value[0];
+                    }));
+    EXPECT_EQ(path == bitmap_path, type == CA_OFFSET_SCORE_BITMAP);
+  }
+}
+
+TEST_F(WriteOnceTest, ConcurrentGet) {
+  for (auto compression : {kTableCompressionNone, kTableCompressionZSTD}) {
+    for (bool seekable : {false, true}) {
+      const std::string path = temp_directory_ + "/table_" +
+                               std::to_string(compression) +
+                               std::to_string(seekable);
+      auto builder = TableFactory::Create(
+          "write-once", path.c_str(),
+          TableOptions().SetCompression(compression).SetOutputSeekable(
+              seekable));
+      char key[16];
+      for (int i = 0; i < 20000; i += 2) {
+        snprintf(key, sizeof(key), "%06d", i);
+        builder->InsertRow(key, std::to_string(i * 3));
+      }
+      builder->Sync();
+      builder.reset();
+
+      auto table_handle = TableFactory::Open("write-once", path.c_str());
+
+      // Concurrent lookups must neither disturb each other nor the cursor.
+      cantera::string_view k, v;
+      ASSERT_TRUE(table_handle->SeekToKey("000100"));
+
+      std::vector<std::thread> threads;
+      std::atomic<int> errors(0);
+      for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&table_handle, &errors, t] {
+          char key[16];
+          for (int i = t; i < 20000; i += 4) {
+            snprintf(key, sizeof(key), "%06d", i);
+            std::string value;
+            const bool found = table_handle->Get(
+                key,
+                [&value](const cantera::string_view& v) {
+                  value = v.to_string();
+                });
+            if (found != (i % 2 == 0) ||
+                (found && value != std::to_string(i * 3)))
+              ++errors;
+          }
+        });
+      }
+      for (auto& thread : threads) thread.join();
+      EXPECT_EQ(0, errors);
+
+      ASSERT_TRUE(table_handle->ReadRow(k, v));
+      EXPECT_EQ("000100", k);
+
+      std::vector<cantera::string_view> keys = {"019998", "000001", "000000",
+                                                "010000", "zzz"};
+      std::vector<std::string> values(keys.size());
+      table_handle->MultiGet(
+          keys, [&values](size_t index, const cantera::string_view& v) {
+            values[index] = v.to_string();
+          });
+      EXPECT_EQ((std::vector<std::string>{"59994", "", "0", "30000", ""}),
+                values);
+    }
+  }
+}
+
+TEST_F(WriteOnceTest, SeekToKeys) {
+  for (auto compression : {kTableCompressionNone, kTableCompressionZSTD}) {
+    for (bool seekable : {false, true}) {
+      const std::string path = temp_directory_ + "/table_" +
+                               std::to_string(compression) +
+                               std::to_string(seekable);
+      auto builder = TableFactory::Create(
+          "write-once", path.c_str(),
+          TableOptions().SetCompression(compression).SetOutputSeekable(
+              seekable));
+      char key[16];
+      for (int i = 0; i < 20000; i += 2) {
+        snprintf(key, sizeof(key), "%06d", i);
+        builder->InsertRow(key, std::to_string(i * 3));
+      }
+      builder->Sync();
+      builder.reset();
+
+      auto table_handle = TableFactory::Open("write-once", path.c_str());
+      auto seekable_table = static_cast<SeekableTable*>(table_handle.get());
+
+      std::vector<cantera::string_view> keys = {
+          "",       "000000", "000000", "000001",
+          "000002", "010000", "019998", "zzz"};
+      std::vector<std::string> values(keys.size());
+      std::vector<off_t> offsets(keys.size(), -1);
+      table_handle->SeekToKeys(keys, [&](size_t index) {
+        offsets[index] = seekable_table->Offset();
+        cantera::string_view k, v;
+        ASSERT_TRUE(table_handle->ReadRow(k, v));
+        EXPECT_EQ(keys[index], k);
+        values[index] = v.to_string();
+      });
+      EXPECT_EQ((std::vector<std::string>{"", "0", "0", "", "6", "30000",
+                                          "59994", ""}),
+                values);
+
+      // The offsets must agree with those found by SeekToKey().
+      for (size_t i = 0; i < keys.size(); ++i) {
+        if (values[i].empty()) continue;
+        ASSERT_TRUE(table_handle->SeekToKey(keys[i]));
+        EXPECT_EQ(seekable_table->Offset(), offsets[i]);
+      }
+    }
+  }
+}
+
+TEST_F(WriteOnceTest, ParallelCompressionMatchesSerial) {
+  for (unsigned threads : {0, 4}) {
+    auto builder = TableFactory::Create(
+        "write-once",
+        (temp_directory_ + "/table_" + std::to_string(threads)).c_str(),
+        TableOptions()
+            .SetCompression(kTableCompressionZSTD)
+            .SetCompressionThreads(threads)
+            .SetNoFSync());
+    char key[16];
+    for (int i = 0; i < 20000; ++i) {
+      snprintf(key, sizeof(key), "%06d", i);
+      builder->InsertRow(key, std::string(i % 100, 'a' + i % 7));
+    }
+    builder->Sync();
+  }
+
+  std::string cmd = "cmp -s " + temp_directory_ + "/table_0 " +
+                    temp_directory_ + "/table_4";
+  EXPECT_EQ(0, system(cmd.c_str()));
+
+  auto table_handle =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_4").c_str());
+  cantera::string_view k, v;
+  EXPECT_TRUE(table_handle->SeekToKey("012345"));
+  ASSERT_TRUE(table_handle->ReadRow(k, v));
+  EXPECT_EQ(std::string(45, 'a' + 12345 % 7), v);
+}
+
+TEST_F(WriteOnceTest, CompressionDictionary) {
+  // Values repeat text from a set too large to fit in a single block, which
+  // is where a dictionary helps.
+  std::vector<std::string> templates;
+  for (uint32_t i = 0, x = 1; i < 40; ++i) {
+    std::string text;
+    while (text.size() < 2000) {
+      x = x * 1103515245 + 12345;
+      text.push_back('a' + (x >> 16) % 26);
+    }
+    templates.emplace_back(std::move(text));
+  }
+  auto make_value = [&templates](int i) {
+    return templates[i * 7 % templates.size()] + std::to_string(i);
+  };
+
+  for (std::string name : {"plain", "0", "3"}) {
+    auto options = TableOptions()
+                       .SetCompression(kTableCompressionZSTD)
+                       .SetNoFSync();
+    if (name != "plain") {
+      options.SetCompressionDictionarySize(16384)
+          .SetCompressionThreads(std::stoi(name));
+    }
+
+    auto builder = TableFactory::Create(
+        "write-once", (temp_directory_ + "/table_" + name).c_str(), options);
+    char key[16];
+    for (int i = 0; i < 2000; ++i) {
+      snprintf(key, sizeof(key), "%06d", i);
+      builder->InsertRow(key, make_value(i));
+    }
+    builder->Sync();
+  }
+
+  struct stat plain_st, dict_st;
+  ASSERT_EQ(0, stat((temp_directory_ + "/table_plain").c_str(), &plain_st));
+  ASSERT_EQ(0, stat((temp_directory_ + "/table_0").c_str(), &dict_st));
+  EXPECT_LT(dict_st.st_size, plain_st.st_size);
+
+  std::string cmd = "cmp -s " + temp_directory_ + "/table_0 " +
+                    temp_directory_ + "/table_3";
+  EXPECT_EQ(0, system(cmd.c_str()));
+
+  auto table_handle =
+      TableFactory::Open("write-once", (temp_directory_ + "/table_3").c_str());
+  cantera::string_view k, v;
+  for (int i = 0; i < 2000; ++i) {
+    ASSERT_TRUE(table_handle->ReadRow(k, v));
+    EXPECT_EQ(make_value(i), v);
+  }
+  EXPECT_FALSE(table_handle->ReadRow(k, v));
+}
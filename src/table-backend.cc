@@ -9,6 +9,8 @@ namespace cantera {
 namespace table {
 namespace internal {
 
+std::atomic<bool> memory_mapping_enabled(true);
+
 Backend* ca_table_backend(const char* name) {
   static std::unique_ptr<Backend> leveldb_table_backend;
   static std::unique_ptr<Backend> writeonce_backend;
@@ -30,5 +32,17 @@ Backend* ca_table_backend(const char* name) {
 }
 
 }  // namespace internal
+
+/*****************************************************************************/
+
+void SetBlockCacheCapacity(size_t capacity) {
+  internal::LevelDBTableBackend::SetBlockCacheCapacity(capacity);
+  internal::WriteOnceTableBackend::SetBlockCacheCapacity(capacity);
+}
+
+void SetTableMemoryMapping(bool enable) {
+  internal::memory_mapping_enabled = enable;
+}
+
 }  // namespace table
 }  // namespace cantera
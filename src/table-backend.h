@@ -3,6 +3,8 @@
 
 #include "src/ca-table.h"
 
+#include <atomic>
+
 #include <kj/io.h>
 
 namespace cantera {
@@ -25,6 +27,10 @@ class Backend {
 
 Backend* ca_table_backend(const char* name);
 
+// Whether tables opened from now on may be read through a memory mapping.
+// Set by SetTableMemoryMapping().
+extern std::atomic<bool> memory_mapping_enabled;
+
 }  // namespace internal
 }  // namespace table
 }  // namespace cantera
@@ -21,9 +21,11 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <limits>
 
 #include <kj/debug.h>
 
@@ -34,22 +36,47 @@
 namespace cantera {
 namespace table {
 
+KeyStatistics ca_offset_score_statistics(const struct ca_offset_score* values,
+                                         size_t count) {
+  KeyStatistics result;
+  result.count = count;
+  result.min_offset = count ? UINT64_MAX : 0;
+  result.min_score = std::numeric_limits<float>::infinity();
+  result.max_score = -std::numeric_limits<float>::infinity();
+
+  for (size_t i = 0; i < count; ++i) {
+    result.min_offset = std::min(result.min_offset, values[i].offset);
+    result.max_offset = std::max(result.max_offset, values[i].offset);
+    if (std::isnan(values[i].score)) continue;
+    result.min_score = std::min(result.min_score, values[i].score);
+    result.max_score = std::max(result.max_score, values[i].score);
+  }
+
+  return result;
+}
+
 void ca_table_write_offset_score(TableBuilder* table,
                                  const string_view& key,
                                  const struct ca_offset_score* values,
-                                 size_t count) {
-  auto buffer_alloc = ca_offset_score_size(values, count);
-  std::vector<uint8_t> buffer(buffer_alloc);
+                                 size_t count, CodecContext* context) {
+  CodecContext local_context;
+  if (!context) context = &local_context;
+
+  const auto& format = table->GetOffsetScoreFormat();
+
+  auto buffer_alloc = ca_offset_score_size(count, format);
+  auto& buffer = context->output;
+  if (buffer.size() < buffer_alloc) buffer.resize(buffer_alloc);
 
-  auto size =
-      ca_format_offset_score(buffer.data(), buffer_alloc, values, count);
+  auto size = ca_format_offset_score(buffer.data(), buffer_alloc, values,
+                                     count, context, format);
 
   KJ_ASSERT(size <= buffer_alloc, size, buffer_alloc);
-  buffer.resize(size);
 
-  string_view buffer_view{reinterpret_cast<const char*>(buffer.data()), buffer.size()};
+  string_view buffer_view{reinterpret_cast<const char*>(buffer.data()), size};
 
-  table->InsertRow(key, buffer_view);
+  table->InsertOffsetScoreRow(key, buffer_view,
+                              ca_offset_score_statistics(values, count));
 
 #ifdef HARDEN
   std::vector<ca_offset_score> tmp;
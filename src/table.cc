@@ -1,5 +1,6 @@
 #include <cstring>
 #include <memory>
+#include <mutex>
 
 #include <kj/debug.h>
 
@@ -56,12 +57,57 @@ static Backend* get_backend(const char* backend_name, const char* path, int fd,
 
 TableBuilder::~TableBuilder() {}
 
+void TableBuilder::InsertOffsetScoreRow(const string_view& key,
+                                        const string_view& value,
+                                        const KeyStatistics&) {
+  InsertRow(key, value);
+}
+
 Table::Table(const struct stat& s) : st(s) {}
 
 Table::~Table() {}
 
+void Table::SeekToKeys(const std::vector<string_view>& keys,
+                       const std::function<void(size_t index)>& callback) {
+  for (size_t i = 0; i < keys.size(); ++i) {
+    KJ_REQUIRE(!i || keys[i - 1] <= keys[i], "keys must be sorted");
+    if (SeekToKey(keys[i])) callback(i);
+  }
+}
+
+bool Table::GetStatistics(TableStatistics&) { return false; }
+
+bool Table::GetKeyStatistics(const string_view&, KeyStatistics&) {
+  return false;
+}
+
+bool Table::Get(
+    const string_view& key,
+    const std::function<void(const string_view& value)>& callback) const {
+  std::unique_lock<std::mutex> lock(get_mutex_);
+
+  auto table = const_cast<Table*>(this);
+  if (!table->SeekToKey(key)) return false;
+
+  string_view row_key, value;
+  KJ_REQUIRE(table->ReadRow(row_key, value));
+  callback(value);
+  return true;
+}
+
+void Table::MultiGet(
+    const std::vector<string_view>& keys,
+    const std::function<void(size_t index, const string_view& value)>&
+        callback) const {
+  for (size_t i = 0; i < keys.size(); ++i)
+    Get(keys[i],
+        [&callback, i](const string_view& value) { callback(i, value); });
+}
+
 SeekableTable::SeekableTable(const struct stat& s) : Table(s) {}
 
+off_t SeekableTable::EndOffset() { return st.st_size; }
+
 Backend::~Backend() {}
 
 ca_offset_score::ca_offset_score(uint64_t offset, const ca_score& score)
@@ -76,7 +122,9 @@ ca_offset_score::ca_offset_score(uint64_t offset, const ca_score& score)
 
 std::unique_ptr<TableBuilder> TableFactory::Create(
     const char* backend_name, const char* path, const TableOptions& options) {
-  return get_backend(backend_name, path)->Create(path, options);
+  auto builder = get_backend(backend_name, path)->Create(path, options);
+  builder->SetOffsetScoreFormat(options.GetOffsetScoreFormat());
+  return builder;
 }
 
 std::unique_ptr<Table> TableFactory::Open(const char* backend_name,
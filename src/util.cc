@@ -4,6 +4,7 @@
 
 #include "src/util.h"
 
+#include <algorithm>
 #include <cstring>
 #include <random>
 
@@ -36,6 +37,21 @@ off_t FileSize(int fd) {
   return st.st_size;
 }
 
+void AdviseWillNeed(int fd,
+                    const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+#ifdef POSIX_FADV_WILLNEED
+  for (size_t i = 0; i < ranges.size();) {
+    const uint64_t begin = ranges[i].first;
+    uint64_t end = ranges[i].second;
+    for (++i; i < ranges.size() && ranges[i].first <= end; ++i)
+      end = std::max(end, ranges[i].second);
+
+    // This is only a hint, so failure is not an error.
+    posix_fadvise(fd, begin, end - begin, POSIX_FADV_WILLNEED);
+  }
+#endif
+}
+
 /*****************************************************************************/
 
 TemporaryFile::~TemporaryFile() noexcept {
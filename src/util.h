@@ -1,8 +1,11 @@
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <memory>
 #include <experimental/string_view>
+#include <utility>
+#include <vector>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -32,6 +35,12 @@ inline void ReadWithOffset(int fd, void* dest, size_t size, off_t offset) {
   ReadWithOffset(fd, dest, size, size, offset);
 }
 
+// Asks the kernel to start reading the given [begin, end) byte ranges of
+// `fd', so that later reads don't wait for the disk one at a time.  Ranges
+// must be sorted by their start; overlapping and adjacent ranges are merged.
+void AdviseWillNeed(int fd,
+                    const std::vector<std::pair<uint64_t, uint64_t>>& ranges);
+
 // A temporary file in a given directory.
 class TemporaryFile : public kj::AutoCloseFd {
  public:
@@ -106,6 +115,18 @@ inline uint64_t StringToUInt64(const char* string) {
   return value;
 }
 
+inline double StringToDouble(const char* string) {
+  KJ_REQUIRE(*string != 0);
+  char* endptr = nullptr;
+  errno = 0;
+  const auto value = std::strtod(string, &endptr);
+  KJ_REQUIRE(*endptr == 0, "unexpected character in numeric string", string);
+  if (errno != 0) {
+    KJ_FAIL_SYSCALL("strtod", errno, string);
+  }
+  return value;
+}
+
 inline std::string StringPrintf(const char* format, ...) {
   va_list args;
   char* buf;